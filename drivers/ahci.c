@@ -0,0 +1,489 @@
+/*
+ * 本文件提供一个AHCI SATA硬盘驱动程序实现，只使用第一个连接了SATA硬盘的端口。
+ * 硬盘支持NCQ时，最多可同时提交32个命令（READ/WRITE FPDMA QUEUED），一次中断中完成所有已完成的命令；
+ * 否则使用READ/WRITE DMA EXT，每次只提交一个命令。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "ahci.h"
+#include "blk_dev.h"
+#include "buf_cache.h"
+#include "io_sched.h"
+#include "pci.h"
+#include "x86.h"
+#include "idt.h"
+#include "vmm.h"
+#include "vm_tools.h"
+#include "process.h"
+#include "string.h"
+#include "parameters.h"
+
+#include "terminal_io.h"
+
+
+/* HBA全局寄存器，相对于BAR5（ABAR）给出的基址 */
+#define HBA_CAP			0x00	//HBA能力
+#define HBA_GHC			0x04	//全局控制
+#define HBA_IS			0x08	//各端口的中断状态，写1清除
+#define HBA_PI			0x0C	//实现了的端口
+#define HBA_MEM_SIZE		0x1100	//寄存器区域大小（32个端口）
+
+/* some flags in CAP/GHC */
+#define HBA_CAP_SNCQ		(1 << 30)	//支持NCQ
+#define HBA_CAP_NCS(cap)	((((cap) >> 8) & 0x1F) + 1)	//每个端口的命令槽数
+#define HBA_GHC_IE		(1 << 1)	//允许中断
+#define HBA_GHC_AE		(1u << 31)	//AHCI模式
+
+/* 端口寄存器，相对于该端口寄存器的基址 */
+#define PORT_BASE(p)		(0x100 + (p) * 0x80)
+#define PORT_CLB		0x00	//command list基址
+#define PORT_CLBU		0x04
+#define PORT_FB			0x08	//received FIS基址
+#define PORT_FBU		0x0C
+#define PORT_IS			0x10	//中断状态，写1清除
+#define PORT_IE			0x14	//中断允许
+#define PORT_CMD		0x18
+#define PORT_TFD		0x20	//task file data，低8位为ATA状态寄存器
+#define PORT_SIG		0x24	//设备签名
+#define PORT_SSTS		0x28	//SATA状态
+#define PORT_SERR		0x30	//SATA错误，写1清除
+#define PORT_SACT		0x34	//尚未完成的NCQ命令
+#define PORT_CI			0x38	//已提交且尚未完成的命令
+
+/* some flags in PORT_CMD */
+#define PORT_CMD_ST		(1 << 0)	//开始处理command list
+#define PORT_CMD_FRE		(1 << 4)	//允许接收FIS
+#define PORT_CMD_FR		(1 << 14)	//FIS接收正在运行
+#define PORT_CMD_CR		(1 << 15)	//command list处理正在运行
+
+/* some flags in PORT_IS/PORT_IE */
+#define PORT_INT_DHRS		(1 << 0)	//收到D2H Register FIS
+#define PORT_INT_PSS		(1 << 1)	//收到PIO Setup FIS
+#define PORT_INT_DSS		(1 << 2)	//收到DMA Setup FIS
+#define PORT_INT_SDBS		(1 << 3)	//收到Set Device Bits FIS（NCQ命令完成）
+#define PORT_INT_ERR		0x7DC00050	//各种错误，包括TFES
+#define PORT_INT_TFES		(1 << 30)	//task file错误
+
+#define PORT_SSTS_DET_PRESENT	3	//SSTS低4位，设备存在且已建立通信
+#define PORT_SIG_ATA		0x00000101	//SATA硬盘的签名
+
+/* ATA状态寄存器中的标志 */
+#define ATA_STATUS_BSY		0x80
+#define ATA_STATUS_DRQ		0x08
+#define ATA_STATUS_ERR		0x01
+
+/* 使用的ATA命令 */
+#define ATA_CMD_READ_DMA_EXT	0x25
+#define ATA_CMD_WRITE_DMA_EXT	0x35
+#define ATA_CMD_READ_FPDMA	0x60	//NCQ读
+#define ATA_CMD_WRITE_FPDMA	0x61	//NCQ写
+#define ATA_CMD_IDENTIFY	0xEC
+
+#define FIS_TYPE_REG_H2D	0x27
+
+/* 命令槽数；每个命令最多包含的buf数，即PRDT项数 */
+#define AHCI_SLOTS		32
+#define AHCI_MAX_SEGS		16
+/* 每个command table的大小：0x80字节的命令FIS等，以及PRDT，需按128字节对齐 */
+#define AHCI_CMD_TABLE_SIZE	0x200
+#define AHCI_TABLES_PER_PAGE	(PAGE_SIZE / AHCI_CMD_TABLE_SIZE)
+
+/* 轮询等待硬件时的最多次数 */
+#define AHCI_SPIN_COUNT		1000000
+
+/* command list中的一项 */
+typedef struct {
+	uint32_t flags; //低5位为命令FIS长度（双字），bit 6表示写，高16位为PRDT项数
+	uint32_t prdbc; //已传输的字节数
+	uint32_t ctba; //command table的物理地址
+	uint32_t ctbau;
+	uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_hdr_t;
+
+/* PRDT中的一项 */
+typedef struct {
+	uint32_t dba; //数据的物理地址
+	uint32_t dbau;
+	uint32_t reserved;
+	uint32_t dbc; //低22位为字节数减1，bit 31表示完成时中断
+} __attribute__((packed)) ahci_prd_t;
+
+/* command table */
+typedef struct {
+	uint8_t cfis[64]; //命令FIS
+	uint8_t acmd[16];
+	uint8_t reserved[48];
+	ahci_prd_t prdt[AHCI_MAX_SEGS];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+static struct {
+	volatile uint8_t * abar; //寄存器的虚拟地址，为NULL时表示没有找到设备
+	uint32_t irq;
+	uint32_t port;
+	uint32_t ncq; //是否使用NCQ
+	uint32_t depth; //同时提交的最多命令数
+	uint64_t capacity;
+	ahci_cmd_hdr_t * cmd_list;
+	uint8_t * fis;
+	ahci_cmd_table_t * tables[AHCI_SLOTS];
+	uint32_t active; //已提交的命令槽
+	uint32_t inflight; //已提交的命令数
+	buf_t * bufs[AHCI_SLOTS][AHCI_MAX_SEGS]; //每个命令槽中的命令包含的buf，它们的扇区连续
+	uint32_t count[AHCI_SLOTS];
+	ahci_stats_t stats;
+} ahci;
+
+/* 对应的块设备，以及其请求队列使用的存储空间 */
+static blk_dev_t ahci_dev;
+static buf_t * ahci_sched_slots[BUF_MAX_COUNT];
+
+
+static inline uint32_t hba_read(uint32_t reg)
+{
+	return *(volatile uint32_t *)(ahci.abar + reg);
+}
+
+static inline void hba_write(uint32_t reg, uint32_t val)
+{
+	*(volatile uint32_t *)(ahci.abar + reg) = val;
+}
+
+static inline uint32_t port_read(uint32_t reg)
+{
+	return hba_read(PORT_BASE(ahci.port) + reg);
+}
+
+static inline void port_write(uint32_t reg, uint32_t val)
+{
+	hba_write(PORT_BASE(ahci.port) + reg, val);
+}
+
+
+/*
+ * 轮询端口寄存器reg，直到(reg & mask) == val；超时返回0，否则返回1
+ */
+static uint32_t wait_port(uint32_t reg, uint32_t mask, uint32_t val)
+{
+	for(uint32_t i = 0; i < AHCI_SPIN_COUNT; i++)
+		if((port_read(reg) & mask) == val)
+			return 1;
+	return 0;
+}
+
+
+/*
+ * 填写命令槽slot的command list项及命令FIS；NCQ命令的扇区数放在features中，tag放在count中
+ */
+static void build_cmd(uint32_t slot, uint8_t command, uint64_t lba, uint32_t count, uint32_t nprd, uint32_t write)
+{
+	ahci_cmd_hdr_t * hdr = &ahci.cmd_list[slot];
+	uint8_t * fis = ahci.tables[slot]->cfis;
+	uint32_t ncq = command == ATA_CMD_READ_FPDMA || command == ATA_CMD_WRITE_FPDMA;
+
+	memset(fis, 0, 20);
+	fis[0] = FIS_TYPE_REG_H2D;
+	fis[1] = 0x80; //表示这是一个命令
+	fis[2] = command;
+	if(command != ATA_CMD_IDENTIFY)
+	{
+		fis[4] = lba & 0xFF;
+		fis[5] = (lba >> 8) & 0xFF;
+		fis[6] = (lba >> 16) & 0xFF;
+		fis[7] = 0x40; //使用LBA
+		fis[8] = (lba >> 24) & 0xFF;
+		fis[9] = (lba >> 32) & 0xFF;
+		fis[10] = (lba >> 40) & 0xFF;
+	}
+	if(ncq)
+	{
+		fis[3] = count & 0xFF;
+		fis[11] = (count >> 8) & 0xFF;
+		fis[12] = slot << 3;
+	}
+	else
+	{
+		fis[12] = count & 0xFF;
+		fis[13] = (count >> 8) & 0xFF;
+	}
+
+	hdr->flags = 5 | (write ? 0x40 : 0) | (nprd << 16);
+	hdr->prdbc = 0;
+}
+
+
+/*
+ * 设置命令槽slot的PRDT第i项
+ */
+static inline void set_prd(uint32_t slot, uint32_t i, void * addr, uint32_t len)
+{
+	ahci.tables[slot]->prdt[i].dba = K_V2P(addr);
+	ahci.tables[slot]->prdt[i].dbau = 0;
+	ahci.tables[slot]->prdt[i].dbc = len - 1;
+}
+
+
+/*
+ * 将请求队列中的请求尽可能多地提交给硬件，扇区连续的请求合并为一个命令。调用者需关闭中断。
+ */
+static void start_ahci_requests(void)
+{
+	buf_t * buf;
+	buf_t * b;
+	uint32_t slot, n, write, issue = 0;
+
+	while(ahci.inflight < ahci.depth && (buf = io_sched_next(&ahci_dev.queue)) != NULL)
+	{
+		if(buf->io_dev != AHCI_DEV_NO)
+			PANIC("start_ahci_requests: illegal request");
+
+		/* 找一个空闲的命令槽 */
+		for(slot = 0; slot < AHCI_SLOTS && ((ahci.active | issue) & (1u << slot)); slot++)
+			;
+
+		ahci.bufs[slot][0] = buf;
+		n = 1;
+		while(n < AHCI_MAX_SEGS && (b = io_sched_next_contig(&ahci_dev.queue, ahci.bufs[slot][n - 1])) != NULL)
+			ahci.bufs[slot][n++] = b;
+		ahci.count[slot] = n;
+
+		write = (buf->flags & BUF_DIRTY) != 0;
+		for(uint32_t i = 0; i < n; i++)
+			set_prd(slot, i, ahci.bufs[slot][i]->data, BUF_SIZE);
+		if(ahci.ncq)
+			build_cmd(slot, write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA, buf->io_sector, n, n, write);
+		else
+			build_cmd(slot, write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT, buf->io_sector, n, n, write);
+
+		issue |= 1u << slot;
+		ahci.inflight++;
+		ahci.stats.cmds++;
+		ahci.stats.sectors += n;
+	}
+
+	if(issue == 0)
+		return;
+	/* NCQ命令需要先设置SACT，再设置CI */
+	if(ahci.ncq)
+		port_write(PORT_SACT, issue);
+	port_write(PORT_CI, issue);
+	ahci.active |= issue;
+
+	if(ahci.inflight > ahci.stats.max_inflight)
+		ahci.stats.max_inflight = ahci.inflight;
+}
+
+
+/*
+ * ahci中断处理，完成所有已完成的命令
+ */
+static void ahci_handler(trapframe_t * tf)
+{
+	/* 由于CPU处理该中断时自动关闭了中断，所以不再调用pushcli/popcli */
+	uint32_t is, done, batch = 0;
+	buf_t * buf;
+
+	(void)tf;
+	if( ! (hba_read(HBA_IS) & (1u << ahci.port)))
+		return;
+	is = port_read(PORT_IS);
+	port_write(PORT_IS, is);
+	hba_write(HBA_IS, 1u << ahci.port);
+	ahci.stats.irqs++;
+
+	if(is & PORT_INT_ERR)
+		PANIC("ahci_handler: maybe a disk error ?");
+
+	/* 已提交且CI/SACT中对应位被清除的命令已经完成 */
+	done = ahci.active & ~(port_read(PORT_CI) | port_read(PORT_SACT));
+	for(uint32_t slot = 0; slot < AHCI_SLOTS; slot++)
+	{
+		if( ! (done & (1u << slot)))
+			continue;
+		for(uint32_t i = 0; i < ahci.count[slot]; i++)
+		{
+			buf = ahci.bufs[slot][i];
+			/* 此时buf变为VALID且UN-DIRTY的 */
+			complete_blk(buf);
+		}
+		ahci.active &= ~(1u << slot);
+		ahci.inflight--;
+		batch++;
+	}
+	if(batch > ahci.stats.max_batch)
+		ahci.stats.max_batch = batch;
+
+	/* 继续提交队列中的请求 */
+	start_ahci_requests();
+}
+
+
+/*
+ * 将buf加入请求队列并尽可能提交给硬件
+ */
+static void ahci_submit(blk_dev_t * bd, buf_t * buf)
+{
+	io_sched_add(&bd->queue, buf);
+	start_ahci_requests();
+}
+
+static const blk_dev_ops_t ahci_ops = {
+	.submit = ahci_submit,
+};
+
+
+/*
+ * 停止端口，设置command list和received FIS的地址后重新启动；失败返回0
+ */
+static uint32_t init_ahci_port(void)
+{
+	port_write(PORT_CMD, port_read(PORT_CMD) & ~PORT_CMD_ST);
+	if( ! wait_port(PORT_CMD, PORT_CMD_CR, 0))
+		return 0;
+	port_write(PORT_CMD, port_read(PORT_CMD) & ~PORT_CMD_FRE);
+	if( ! wait_port(PORT_CMD, PORT_CMD_FR, 0))
+		return 0;
+
+	port_write(PORT_CLB, K_V2P(ahci.cmd_list));
+	port_write(PORT_CLBU, 0);
+	port_write(PORT_FB, K_V2P(ahci.fis));
+	port_write(PORT_FBU, 0);
+	for(uint32_t slot = 0; slot < AHCI_SLOTS; slot++)
+	{
+		ahci.cmd_list[slot].ctba = K_V2P(ahci.tables[slot]);
+		ahci.cmd_list[slot].ctbau = 0;
+	}
+
+	port_write(PORT_CMD, port_read(PORT_CMD) | PORT_CMD_FRE);
+	port_write(PORT_SERR, 0xFFFFFFFF);
+	port_write(PORT_IS, 0xFFFFFFFF);
+	if( ! wait_port(PORT_TFD, ATA_STATUS_BSY | ATA_STATUS_DRQ, 0))
+		return 0;
+	port_write(PORT_CMD, port_read(PORT_CMD) | PORT_CMD_ST);
+	return 1;
+}
+
+
+/*
+ * 用IDENTIFY命令获取硬盘的容量及NCQ支持，轮询完成；id为512字节的缓冲区。失败返回0
+ */
+static uint32_t identify_ahci(uint16_t * id)
+{
+	build_cmd(0, ATA_CMD_IDENTIFY, 0, 0, 1, 0);
+	set_prd(0, 0, id, 512);
+	port_write(PORT_CI, 1);
+	if( ! wait_port(PORT_CI, 1, 0) || (port_read(PORT_TFD) & ATA_STATUS_ERR))
+		return 0;
+	port_write(PORT_IS, 0xFFFFFFFF);
+
+	/* word 83的bit 10表示支持LBA48，容量在word 100～103中，否则在word 60～61中 */
+	if(id[83] & (1 << 10))
+		ahci.capacity = id[100] | ((uint32_t)id[101] << 16) | ((uint64_t)id[102] << 32);
+	else
+		ahci.capacity = id[60] | ((uint32_t)id[61] << 16);
+
+	/* word 76的bit 8表示支持NCQ，word 75的低5位为队列深度减1 */
+	ahci.ncq = (hba_read(HBA_CAP) & HBA_CAP_SNCQ) && (id[76] & (1 << 8));
+	ahci.depth = 1;
+	if(ahci.ncq)
+	{
+		ahci.depth = (id[75] & 0x1F) + 1;
+		if(ahci.depth > HBA_CAP_NCS(hba_read(HBA_CAP)))
+			ahci.depth = HBA_CAP_NCS(hba_read(HBA_CAP));
+	}
+	return 1;
+}
+
+
+/*
+ * 查找AHCI控制器并初始化第一个连接了SATA硬盘的端口，成功时注册为AHCI_DEV_NO，否则什么也不做
+ */
+void init_ahci(void)
+{
+	pci_addr_t addr;
+	uint32_t bar5, pi;
+	uint8_t * page;
+
+	/* class 0x01 subclass 0x06为SATA控制器，prog if 0x01为AHCI */
+	if(pci_find_class(0x01, 0x06, 0, &addr) < 0 || pci_read_config8(addr, PCI_PROG_IF) != 0x01)
+		return;
+	bar5 = pci_read_config32(addr, PCI_BAR0 + 5 * 4);
+	if(bar5 & PCI_BAR_IO)
+		return;
+	ahci.irq = pci_read_config8(addr, PCI_INTERRUPT_LINE);
+	pci_enable(addr, PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+	ahci.abar = map_mmio_noint(bar5 & 0xFFFFFFF0, HBA_MEM_SIZE);
+
+	hba_write(HBA_GHC, hba_read(HBA_GHC) | HBA_GHC_AE);
+
+	/* 查找连接了SATA硬盘的端口 */
+	pi = hba_read(HBA_PI);
+	for(ahci.port = 0; ahci.port < 32; ahci.port++)
+		if((pi & (1u << ahci.port)) && (port_read(PORT_SSTS) & 0xF) == PORT_SSTS_DET_PRESENT &&
+				port_read(PORT_SIG) == PORT_SIG_ATA)
+			break;
+	if(ahci.port == 32)
+	{
+		ahci.abar = NULL;
+		return;
+	}
+
+	/* 第一个页面存放command list（1KB），received FIS（256字节）以及IDENTIFY的数据，其余存放command table */
+	if((page = alloc_page_noint()) == NULL)
+		PANIC("init_ahci: alloc page failed");
+	ahci.cmd_list = (ahci_cmd_hdr_t *)page;
+	ahci.fis = page + 0x400;
+	for(uint32_t slot = 0; slot < AHCI_SLOTS; slot++)
+	{
+		if(slot % AHCI_TABLES_PER_PAGE == 0 && (page = alloc_page_noint()) == NULL)
+			PANIC("init_ahci: alloc page failed");
+		ahci.tables[slot] = (ahci_cmd_table_t *)(page + (slot % AHCI_TABLES_PER_PAGE) * AHCI_CMD_TABLE_SIZE);
+	}
+
+	if( ! init_ahci_port() || ! identify_ahci((uint16_t *)((uint8_t *)ahci.cmd_list + 0x800)))
+	{
+		printk("init_ahci: port %u not responding\n", ahci.port);
+		ahci.abar = NULL;
+		return;
+	}
+
+	init_blk_dev(&ahci_dev, "ahci", &ahci_ops, blk_sched_policy("ahci_sched", IO_SCHED_CLOOK),
+			ahci_sched_slots, BUF_MAX_COUNT);
+	ahci_dev.max_sectors = AHCI_MAX_SEGS;
+	ahci_dev.sectors = ahci.capacity;
+	ahci_dev.queue_depth = ahci.depth;
+	register_blk_dev(AHCI_DEV_NO, &ahci_dev);
+
+	register_shared_irq_handler(ahci.irq, ahci_handler);
+	port_write(PORT_IE, PORT_INT_DHRS | PORT_INT_PSS | PORT_INT_DSS | PORT_INT_SDBS | PORT_INT_ERR);
+	hba_write(HBA_GHC, hba_read(HBA_GHC) | HBA_GHC_IE);
+
+	printk("init_ahci: port %u irq %u, %u sectors, %s depth %u, %s scheduler\n", ahci.port, ahci.irq,
+			(uint32_t)ahci.capacity, ahci.ncq ? "ncq" : "dma", ahci.depth,
+			io_sched_policy_name(ahci_dev.queue.policy));
+}
+
+
+/*
+ * 获取ahci驱动的统计数据
+ */
+void get_ahci_stats(ahci_stats_t * st)
+{
+	pushcli();
+	*st = ahci.stats;
+	popcli();
+}
+
+
+/* DEBUG */
+void dump_ahci_stats(void)
+{
+	if(ahci.abar == NULL)
+	{
+		printk("ahci: not present\n");
+		return;
+	}
+	printk("ahci: cmds %u sectors %u irqs %u max batch %u max inflight %u\n",
+			ahci.stats.cmds, ahci.stats.sectors, ahci.stats.irqs, ahci.stats.max_batch, ahci.stats.max_inflight);
+}
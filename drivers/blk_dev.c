@@ -0,0 +1,194 @@
+/*
+ * 本文件提供通用的块设备层：块设备表及请求的提交、同步接口，块缓冲通过它访问各种块设备。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "blk_dev.h"
+#include "buf_cache.h"
+#include "io_sched.h"
+#include "process.h"
+#include "x86.h"
+#include "string.h"
+#include "parameters.h"
+#include "multiboot.h"
+#include "blk_trace.h"
+
+#include "terminal_io.h"
+
+/* 块设备表，以设备号为下标 */
+static blk_dev_t * blk_dev_table[BLK_DEV_COUNT];
+
+
+/*
+ * 初始化块设备结构bd及其请求队列，slots为请求队列所使用的存储空间，参考io_sched_init
+ */
+void init_blk_dev(blk_dev_t * bd, const char * name, const blk_dev_ops_t * ops, uint32_t policy,
+		buf_t ** slots, uint32_t capacity)
+{
+	memset(bd, 0, sizeof(*bd));
+	bd->name = name;
+	bd->ops = ops;
+	bd->max_sectors = 1;
+	bd->queue_depth = 1;
+	io_sched_init(&bd->queue, policy, slots, capacity);
+}
+
+
+/*
+ * 根据内核命令行参数arg（取值fifo|clook）获取请求队列的调度策略，没有指定或不认识时返回def
+ */
+uint32_t blk_sched_policy(const char * arg, uint32_t def)
+{
+	char name[8];
+	int32_t policy;
+
+	if(get_boot_arg(arg, name, sizeof(name)) <= 0)
+		return def;
+	if((policy = io_sched_policy(name)) < 0)
+	{
+		printk("blk_sched_policy: unknown %s `%s', use %s\n", arg, name, io_sched_policy_name(def));
+		return def;
+	}
+	return policy;
+}
+
+
+/*
+ * 将bd注册为设备号dev
+ */
+void register_blk_dev(int32_t dev, blk_dev_t * bd)
+{
+	if(dev < 0 || dev >= BLK_DEV_COUNT)
+		PANIC("register_blk_dev: illegal dev");
+	if(blk_dev_table[dev] != NULL)
+		PANIC("register_blk_dev: dev already registered");
+	blk_dev_table[dev] = bd;
+}
+
+
+/*
+ * 获取设备号dev对应的块设备，不存在时返回NULL
+ */
+blk_dev_t * get_blk_dev(int32_t dev)
+{
+	if(dev < 0 || dev >= BLK_DEV_COUNT)
+		return NULL;
+	return blk_dev_table[dev];
+}
+
+
+/*
+ * 将buf加入其设备的请求队列，不等待请求完成；请求完成后buf将是VALID且UN-DIRTY，注意buf必须是BUSY的
+ */
+void submit_blk(buf_t * buf)
+{
+	blk_dev_t * bd;
+
+	if( ! (buf->flags & BUF_BUSY))
+		PANIC("submit_blk: no process has owned this buf");
+	if((buf->flags & (BUF_VALID | BUF_DIRTY)) == BUF_VALID)
+		PANIC("submit_blk: nothing to do");
+	if((bd = get_blk_dev(buf->dev)) == NULL)
+		PANIC("submit_blk: no such device");
+	buf->io_dev = buf->dev;
+	buf->io_sector = buf->sector;
+
+	pushcli(); //保证同时只有一个进程能够访问请求队列
+	bd->stats.submits++;
+	if(++bd->stats.inflight > bd->stats.max_inflight)
+		bd->stats.max_inflight = bd->stats.inflight;
+	bd->stats.depth_total += bd->stats.inflight;
+	buf->io_start = (uint32_t)rdtsc();
+	buf->io_pid = (uint16_t)cpu.cur_proc->pid;
+	bd->ops->submit(bd, buf);
+	popcli(); //恢复原来的中断状态
+}
+
+
+/*
+ * 同步buf和磁盘，同步之后的buf将是VALID且UN-DIRTY，注意buf必须是BUSY的
+ */
+void sync_blk(buf_t * buf)
+{
+	blk_dev_t * bd;
+	uint64_t start;
+	uint32_t polled = 0;
+
+	pushcli();
+
+	start = rdtsc();
+	submit_blk(buf);
+	bd = blk_dev_table[buf->dev];
+
+	if(bd->ops->poll != NULL && (buf->flags & (BUF_VALID | BUF_DIRTY)) != BUF_VALID)
+		polled = bd->ops->poll(bd, buf, start);
+
+	/* 等待buf变为VALID且UN-DIRTY */
+	while((buf->flags & (BUF_VALID | BUF_DIRTY)) != BUF_VALID)
+		sleep(buf);
+
+	if(bd->ops->account != NULL)
+		bd->ops->account(bd, polled, rdtsc() - start);
+
+	popcli(); //恢复原来的中断状态
+}
+
+
+/*
+ * 完成buf的请求：记录统计数据，将buf设为VALID且UN-DIRTY，
+ * 没有进程等待的buf（如预读）直接释放，否则唤醒在等待这个buf的进程；由驱动调用，调用者需关闭中断。
+ */
+void complete_blk(buf_t * buf)
+{
+	blk_dev_t * bd = blk_dev_table[buf->dev];
+	uint32_t w = (buf->flags & BUF_DIRTY) ? 1 : 0;
+	uint64_t now = rdtsc();
+
+	bd->stats.reqs[w]++;
+	bd->stats.inflight--;
+	io_lat_add(&bd->stats.lat[w], (uint32_t)now - buf->io_start);
+	blk_trace_complete(buf, now);
+
+	buf->flags |= BUF_VALID;
+	buf->flags &= ~BUF_DIRTY;
+	if(buf->flags & BUF_ASYNC)
+		release_buf_noint(buf);
+	else
+		wakeup_noint(buf);
+}
+
+
+/*
+ * 获取设备号dev对应块设备的统计数据，设备不存在时返回-1，否则返回0
+ */
+int32_t get_blk_stats(int32_t dev, blk_stats_t * st)
+{
+	blk_dev_t * bd;
+
+	if((bd = get_blk_dev(dev)) == NULL)
+		return -1;
+	pushcli();
+	*st = bd->stats;
+	popcli();
+	return 0;
+}
+
+
+/* DEBUG */
+void dump_blk_devs(void)
+{
+	blk_dev_t * bd;
+
+	for(int32_t dev = 0; dev < BLK_DEV_COUNT; dev++)
+	{
+		if((bd = blk_dev_table[dev]) == NULL)
+			continue;
+		printk("blk %d: %s sectors %u max_sectors %u depth %u %s queued %u dispatched %u merged %u\n", dev,
+				bd->name, bd->sectors, bd->max_sectors, bd->queue_depth, io_sched_policy_name(bd->queue.policy),
+				bd->queue.count, bd->queue.stats.dispatched, bd->queue.stats.merged);
+		printk("blk %d: read %u write %u inflight %u max %u\n", dev, bd->stats.reqs[0], bd->stats.reqs[1],
+				bd->stats.inflight, bd->stats.max_inflight);
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ * 本文件提供块I/O跟踪：将块缓冲的每次访问和提交给设备的每个请求记录到内存中的环形缓冲区，
+ * 用户进程通过blktrace系统调用取出记录，之后可以在主机上用mkfs_tools中的回放工具分析。
+ * 通过内核命令行参数blktrace=1打开，默认关闭。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "blk_trace.h"
+#include "buf_cache.h"
+#include "process.h"
+#include "multiboot.h"
+#include "x86.h"
+#include "parameters.h"
+
+#include "terminal_io.h"
+
+static struct {
+	uint32_t enabled;
+	uint32_t head; //已写入的记录总数，下一条记录写入ring[head % BLK_TRACE_COUNT]
+	uint32_t tail; //已取出的记录总数
+	uint32_t lost; //尚未取出就被覆盖的记录数
+	blk_trace_t ring[BLK_TRACE_COUNT];
+} blk_trace;
+
+
+/*
+ * 根据内核命令行参数决定是否打开跟踪
+ */
+void init_blk_trace(void)
+{
+	blk_trace.enabled = get_boot_arg_uint("blktrace", 0) != 0;
+	blk_trace.head = blk_trace.tail = blk_trace.lost = 0;
+	if(blk_trace.enabled)
+		printk("init_blk_trace: %u records\n", BLK_TRACE_COUNT);
+}
+
+
+/*
+ * 在环形缓冲区中分配一条记录，缓冲区满时覆盖最早的记录；调用者需关闭中断。
+ */
+static blk_trace_t * alloc_trace(void)
+{
+	if(blk_trace.head - blk_trace.tail == BLK_TRACE_COUNT)
+	{
+		blk_trace.tail++;
+		blk_trace.lost++;
+	}
+	return &blk_trace.ring[blk_trace.head++ % BLK_TRACE_COUNT];
+}
+
+
+/*
+ * 记录当前进程对buf的一次访问，hit表示数据已经在块缓冲中，start为开始请求时的时钟周期数；调用者需关闭中断。
+ */
+void blk_trace_access(buf_t * buf, uint32_t hit, uint64_t start)
+{
+	blk_trace_t * t;
+
+	if( ! blk_trace.enabled)
+		return;
+	t = alloc_trace();
+	t->sector = buf->sector;
+	t->dev = (uint8_t)buf->dev;
+	t->flags = BLK_TRACE_ACCESS | (hit ? BLK_TRACE_HIT : 0);
+	t->pid = (uint16_t)cpu.cur_proc->pid;
+	t->submit = start;
+	t->complete = rdtsc();
+}
+
+
+/*
+ * 记录buf对应的一个已完成的设备请求，now为完成时的时钟周期数；由complete_blk调用，调用者需关闭中断。
+ */
+void blk_trace_complete(buf_t * buf, uint64_t now)
+{
+	blk_trace_t * t;
+
+	if( ! blk_trace.enabled)
+		return;
+	t = alloc_trace();
+	t->sector = buf->sector;
+	t->dev = (uint8_t)buf->dev;
+	t->flags = ((buf->flags & BUF_DIRTY) ? BLK_TRACE_WRITE : 0) | ((buf->flags & BUF_ASYNC) ? BLK_TRACE_ASYNC : 0);
+	t->pid = buf->io_pid;
+	/* 提交时只记录了时钟周期数的低32位 */
+	t->submit = now - (uint32_t)((uint32_t)now - buf->io_start);
+	t->complete = now;
+}
+
+
+/*
+ * 取出最多n条最早的记录到recs中，返回取出的记录数；*lost为上次取出之后被覆盖的记录数
+ */
+uint32_t read_blk_trace(blk_trace_t * recs, uint32_t n, uint32_t * lost)
+{
+	uint32_t i;
+
+	pushcli();
+	for(i = 0; i < n && blk_trace.tail != blk_trace.head; i++)
+		recs[i] = blk_trace.ring[blk_trace.tail++ % BLK_TRACE_COUNT];
+	*lost = blk_trace.lost;
+	blk_trace.lost = 0;
+	popcli();
+	return i;
+}
@@ -6,107 +6,530 @@
 #include <stddef.h>
 #include "debug.h"
 #include "buf_cache.h"
-#include "ide.h"
+#include "blk_dev.h"
 #include "process.h"
 #include "parameters.h"
+#include "vmm.h"
+#include "8253pit.h"
+#include "string.h"
+#include "x86.h"
+#include "blk_trace.h"
 
 #include "terminal_io.h"
 
+static inline void unhash_buf(buf_t * buf);
+
+/* 每个数据页面所能容纳的buf个数，块缓冲按页面为单位分配和回收buf */
+#define BUFS_PER_PAGE	(PAGE_SIZE / BUF_SIZE)
+/* 数据页面的最多个数；第i个数据页面对应bufs中第i组BUFS_PER_PAGE个buf头部 */
+#define BUF_PAGE_COUNT	(BUF_MAX_COUNT / BUFS_PER_PAGE)
+
+/*
+ * 块缓冲使用2Q替换策略：
+ * A1in为FIFO队列，保存只被访问过一次的buf，其中的buf再次被访问时不改变位置；
+ * Am为LRU队列，保存被多次访问的buf以及元数据buf；
+ * A1out为ghost队列，只记录最近从A1in中被替换出去的dev/sector，不保存数据；
+ * 未cache的dev/sector如果在A1out中，说明它在短时间内被再次访问，直接放入Am；否则放入A1in。
+ * 这样一次顺序扫描大文件只会替换A1in中的buf，而不会影响Am中经常被访问的超级块、位图和i节点。
+ */
+#define BUF_Q_A1IN	0
+#define BUF_Q_AM	1
+#define BUF_Q_COUNT	2
+
+/* A1out中记录的dev/sector */
+typedef struct _ghost_t {
+	int32_t dev; //为负数时表示该项无效
+	uint32_t sector;
+	struct _ghost_t * hnext;
+} ghost_t;
+
 struct {
-	buf_t buf[BUF_COUNT]; //块缓冲区
-	buf_t head; //访问块缓冲区的链表头
+	buf_t bufs[BUF_MAX_COUNT]; //所有buf头部，连续存放，只有数据页面存在的组才被使用
+	uint8_t * pages[BUF_PAGE_COUNT]; //数据页面，为NULL时对应的一组buf不存在
+	uint32_t count; //当前块缓冲中buf的个数，总为BUFS_PER_PAGE的整数倍
+	uint32_t target; //启动时根据空闲内存确定的buf个数，内存充足时块缓冲会增长到该值
+	buf_t queue[BUF_Q_COUNT]; //A1in/Am队列的链表头，head.next为MRU端，head.prev为LRU端
+	uint32_t qcount[BUF_Q_COUNT]; //A1in/Am队列中buf的个数
+	buf_t * hash[BUF_HASH_SIZE]; //按dev/sector散列的桶，每个桶为一个单向链表，只包含dev有效的buf
+
+	ghost_t ghost[BUF_GHOST_COUNT]; //A1out，按FIFO的顺序循环使用
+	uint32_t ghost_limit; //A1out实际使用的项数
+	uint32_t ghost_next; //A1out中下一个被覆盖的项
+	ghost_t * ghost_hash[BUF_HASH_SIZE];
+
+	uint32_t waiters; //因没有空闲buf而在&buf_cache上休眠的进程数
+
+	buf_cache_stats_t stats;
 }buf_cache;
 
 
 /*
- * 初始化块缓冲，使得所有的buf形成一个双向链表；初始化之后，所有操作都通过双向链表完成。
+ * 将buf从其所在队列中移除；调用者需关闭中断。
+ */
+static inline void unlink_buf(buf_t * buf)
+{
+	buf->next->prev = buf->prev;
+	buf->prev->next = buf->next;
+	buf_cache.qcount[buf->queue]--;
+}
+
+
+/*
+ * 将buf加入队列q的MRU端或LRU端；调用者需关闭中断。
+ */
+static inline void link_buf(buf_t * buf, uint32_t q, uint32_t at_mru)
+{
+	buf_t * head = &buf_cache.queue[q];
+
+	if(at_mru)
+	{
+		buf->prev = head;
+		buf->next = head->next;
+	}
+	else
+	{
+		buf->prev = head->prev;
+		buf->next = head;
+	}
+	buf->next->prev = buf;
+	buf->prev->next = buf;
+	buf->queue = q;
+	buf_cache.qcount[q]++;
+}
+
+
+/*
+ * 将指定buf移动到队列q的MRU端；调用者需关闭中断。
+ */
+static inline void move_buf(buf_t * buf, uint32_t q)
+{
+	if(buf->queue == q && buf == buf_cache.queue[q].next)
+		return; //此时buf已经处于MRU端，无需移动，直接返回
+	
+	unlink_buf(buf);
+	link_buf(buf, q, 1);
+}
+
+
+/*
+ * 将page作为第i个数据页面，划分给第i组的BUFS_PER_PAGE个buf，并依次加入A1in的LRU端；
+ * 调用者需关闭中断或保证没有其他进程在使用块缓冲。
+ */
+static void add_buf_page(uint32_t i, uint8_t * page)
+{
+	buf_t * buf;
+
+	buf_cache.pages[i] = page;
+	for(uint32_t j = 0; j < BUFS_PER_PAGE; j++)
+	{
+		buf = &buf_cache.bufs[i * BUFS_PER_PAGE + j];
+		buf->data = page + j * BUF_SIZE;
+		buf->dev = -1;
+		buf->flags = 0;
+		buf->refs = 0;
+		buf->qnext = NULL;
+		buf->hnext = NULL;
+		link_buf(buf, BUF_Q_A1IN, 0);
+	}
+	buf_cache.count += BUFS_PER_PAGE;
+}
+
+
+/*
+ * 初始化块缓冲：根据当前空闲内存确定buf个数，从页分配器中分配所需页面，所有的buf都放入A1in中；
+ * 此时所有buf的dev均无效，所以散列表和A1out为空。
+ * 块缓冲最多占用空闲内存的1/BUF_MEM_RATIO，buf个数在BUF_MIN_COUNT和BUF_MAX_COUNT之间。
+ *
+ * 注意：使用不带锁的内存分配接口，必须在创建第一个进程之前调用。
  */
 void init_buf_cache(void)
 {	
-	int32_t i;
+	uint32_t pages;
+	uint8_t * page;
 	
-	for(i = BUF_COUNT - 1; i > 0; i--)
+	for(uint32_t q = 0; q < BUF_Q_COUNT; q++)
 	{
-		buf_cache.buf[i].next = &buf_cache.buf[i - 1];
-		buf_cache.buf[i - 1].prev = &buf_cache.buf[i];
-		buf_cache.buf[i].dev = -1;
+		buf_cache.queue[q].prev = &buf_cache.queue[q];
+		buf_cache.queue[q].next = &buf_cache.queue[q];
+		buf_cache.qcount[q] = 0;
 	}
+	buf_cache.count = 0;
+	for(uint32_t i = 0; i < BUF_PAGE_COUNT; i++)
+		buf_cache.pages[i] = NULL;
+
+	for(uint32_t i = 0; i < BUF_HASH_SIZE; i++)
+	{
+		buf_cache.hash[i] = NULL;
+		buf_cache.ghost_hash[i] = NULL;
+	}
+
+	/* 确定buf个数 */
+	pages = count_free_pages() / BUF_MEM_RATIO;
+	if(pages * BUFS_PER_PAGE < BUF_MIN_COUNT)
+		pages = (BUF_MIN_COUNT + BUFS_PER_PAGE - 1) / BUFS_PER_PAGE;
+	if(pages * BUFS_PER_PAGE > BUF_MAX_COUNT)
+		pages = BUF_MAX_COUNT / BUFS_PER_PAGE;
+	buf_cache.target = pages * BUFS_PER_PAGE;
 	
-	buf_cache.buf[BUF_COUNT - 1].prev = &buf_cache.head;
-	buf_cache.buf[0].next = &buf_cache.head;
-	buf_cache.buf[0].dev = -1;
-	
-	buf_cache.head.prev = &buf_cache.buf[0];
-	buf_cache.head.next = &buf_cache.buf[BUF_COUNT - 1];
+	for(uint32_t i = 0; i < pages; i++)
+	{
+		if((page = alloc_page_noint()) == NULL)
+			break;
+		add_buf_page(i, page);
+	}
+	if(buf_cache.count < BUF_MIN_COUNT)
+		PANIC("init_buf_cache: no enough memory");
+
+	/* A1out记录的项数为buf个数的一半 */
+	buf_cache.ghost_limit = buf_cache.target / 2;
+	if(buf_cache.ghost_limit > BUF_GHOST_COUNT)
+		buf_cache.ghost_limit = BUF_GHOST_COUNT;
+	buf_cache.ghost_next = 0;
+	for(uint32_t i = 0; i < BUF_GHOST_COUNT; i++)
+		buf_cache.ghost[i].dev = -1;
+
+	buf_cache.waiters = 0;
+	memset(&buf_cache.stats, 0, sizeof(buf_cache.stats));
+
+	printk("init_buf_cache: %u bufs (%u KB)\n", buf_cache.count, buf_cache.count * BUF_SIZE / 1024);
 }
 
 
 /*
- * 将指定buf移动到链表MRU端
+ * 回收块缓冲所占用的内存，最多释放npages个页面，返回实际释放的页面数。
+ * 只有当一个页面中所有的buf都不是BUSY或DIRTY的时候，该页面才会被释放，其中的buf也将不再被cache；
+ * 块缓冲中buf的个数不会少于BUF_MIN_COUNT。
+ * 在空闲内存不足时由alloc_page调用。
  */
-static inline void move_buf(buf_t * buf)
+uint32_t shrink_buf_cache(uint32_t npages)
 {
-	if(buf == buf_cache.head.next)
-		return; //此时buf已经处于MRU端，无需移动，直接返回
-	
-	buf->next->prev = buf->prev;
-	buf->prev->next = buf->next;
+	buf_t * buf;
+	buf_t * b;
+	buf_t * group;
+	uint8_t * page;
+	uint32_t i, freed = 0;
 
-	buf_cache.head.next->prev = buf;
-	buf->next = buf_cache.head.next;
-	
-	buf->prev = &buf_cache.head;
-	buf_cache.head.next = buf;
+	pushcli();
+
+	rescan:
+	/* 先从A1in再从Am，由LRU端开始查找可以被整体释放的页面 */
+	for(uint32_t q = 0; q < BUF_Q_COUNT; q++)
+	{
+		for(buf = buf_cache.queue[q].prev; buf != &buf_cache.queue[q] && freed < npages; buf = buf->prev)
+		{
+			if(buf_cache.count < BUF_MIN_COUNT + BUFS_PER_PAGE)
+				break;
+			if((buf->flags & (BUF_BUSY | BUF_DIRTY)) || buf->refs > 0)
+				continue;
+
+			i = (buf - buf_cache.bufs) / BUFS_PER_PAGE;
+			group = &buf_cache.bufs[i * BUFS_PER_PAGE];
+			for(b = group; b < group + BUFS_PER_PAGE; b++)
+				if((b->flags & (BUF_BUSY | BUF_DIRTY)) || b->refs > 0)
+					break;
+			if(b < group + BUFS_PER_PAGE)
+				continue;
+
+			/* 该页面中的buf都是空闲的，将它们移出散列表和队列 */
+			for(b = group; b < group + BUFS_PER_PAGE; b++)
+			{
+				unhash_buf(b);
+				unlink_buf(b);
+				b->data = NULL;
+			}
+			page = buf_cache.pages[i];
+			buf_cache.pages[i] = NULL;
+			buf_cache.count -= BUFS_PER_PAGE;
+			freed++;
+
+			/* free_page可能睡眠，所以先恢复中断状态；之后队列可能已经改变，需要重新查找 */
+			popcli();
+			free_page(page);
+			pushcli();
+			goto rescan;
+		}
+	}
+
+	popcli();
+	return freed;
+}
+
+
+/*
+ * 如果块缓冲曾因内存不足而收缩，且当前空闲内存充足，则为块缓冲增加一个页面的buf。
+ */
+static void grow_buf_cache(void)
+{
+	uint8_t * page;
+	uint32_t i;
+
+	if(buf_cache.count >= buf_cache.target || count_free_pages() <= VMM_HIGH_WATERMARK)
+		return;
+	if((page = alloc_page()) == NULL)
+		return;
+
+	pushcli();
+	/* alloc_page可能睡眠，其间其他进程可能已经使块缓冲增长 */
+	for(i = 0; i < buf_cache.target / BUFS_PER_PAGE && buf_cache.pages[i] != NULL; i++)
+		;
+	if(i < buf_cache.target / BUFS_PER_PAGE)
+	{
+		add_buf_page(i, page);
+		page = NULL;
+	}
+	popcli();
+	if(page != NULL)
+		free_page(page);
 }
 
 
 /*
- * 获取一个映射到指定dev/sector上的buf，该buf将移动到MRU的位置且设置为BUSY的。
- * 如果buf已经用完了，目前的处理是PANIC。
+ * 在散列表中查找映射到dev/sector上的buf，没有则返回NULL；调用者需关闭中断。
  */
-static buf_t * get_buf(int32_t dst_dev, uint32_t dst_sector)
+static inline buf_t * lookup_buf(int32_t dev, uint32_t sector)
 {
 	buf_t * buf;
-	pushcli(); //关闭中断，保存原来的中断状态
 
-	continue_check:
-	/* 查看dst_dev/dst_sector是否已经cache了 */
-	/* 按照MRU的顺序查找，更容易找到 */
-	for(buf = buf_cache.head.next; buf != &buf_cache.head; buf = buf->next)
+	for(buf = buf_cache.hash[BUF_HASH(dev, sector, BUF_HASH_SIZE)]; buf != NULL; buf = buf->hnext)
+		if(buf->dev == dev && buf->sector == sector)
+			return buf;
+	return NULL;
+}
+
+
+/*
+ * 将buf加入其dev/sector对应的桶中；调用者需关闭中断。
+ */
+static inline void hash_buf(buf_t * buf)
+{
+	buf_t ** bpp = &buf_cache.hash[BUF_HASH(buf->dev, buf->sector, BUF_HASH_SIZE)];
+
+	buf->hnext = *bpp;
+	*bpp = buf;
+}
+
+
+/*
+ * 将buf从其dev/sector对应的桶中移除，dev无效的buf不在散列表中；调用者需关闭中断。
+ */
+static inline void unhash_buf(buf_t * buf)
+{
+	buf_t ** bpp;
+
+	if(buf->dev < 0)
+		return;
+	for(bpp = &buf_cache.hash[BUF_HASH(buf->dev, buf->sector, BUF_HASH_SIZE)]; *bpp != NULL; bpp = &((*bpp)->hnext))
 	{
-		if(buf->dev == dst_dev && buf->sector == dst_sector)
+		if(*bpp == buf)
 		{
-			if( ! (buf->flags & BUF_BUSY))
+			*bpp = buf->hnext;
+			buf->hnext = NULL;
+			return;
+		}
+	}
+	PANIC("unhash_buf: buf is not in hash table");
+}
+
+
+/*
+ * 将dev/sector记录到A1out中，覆盖其中最早的一项；调用者需关闭中断。
+ */
+static void remember_ghost(int32_t dev, uint32_t sector)
+{
+	ghost_t * g;
+	ghost_t ** gpp;
+
+	if(buf_cache.ghost_limit == 0)
+		return;
+
+	g = &buf_cache.ghost[buf_cache.ghost_next];
+	buf_cache.ghost_next = (buf_cache.ghost_next + 1) % buf_cache.ghost_limit;
+
+	/* 移除被覆盖的项 */
+	if(g->dev >= 0)
+	{
+		for(gpp = &buf_cache.ghost_hash[BUF_HASH(g->dev, g->sector, BUF_HASH_SIZE)]; *gpp != NULL; gpp = &((*gpp)->hnext))
+		{
+			if(*gpp == g)
 			{
-				buf->flags |= BUF_BUSY;
-				move_buf(buf);
-				
-				popcli(); //恢复原来的中断状态
-				return buf;
+				*gpp = g->hnext;
+				break;
 			}
-			sleep(buf);
-			goto continue_check;
 		}
 	}
 
-	/* dst_dev/dst_sector尚未cache，则寻找一个空闲的buf */
-	/* 按照LRU的顺序查找 */
-	for(buf = buf_cache.head.prev; buf != &buf_cache.head; buf = buf->prev)
+	g->dev = dev;
+	g->sector = sector;
+	gpp = &buf_cache.ghost_hash[BUF_HASH(dev, sector, BUF_HASH_SIZE)];
+	g->hnext = *gpp;
+	*gpp = g;
+}
+
+
+/*
+ * 查看dev/sector是否在A1out中，如果在则将其移除并返回1，否则返回0；调用者需关闭中断。
+ * 被移除的项仍占据A1out中的位置，直到被覆盖。
+ */
+static uint32_t forget_ghost(int32_t dev, uint32_t sector)
+{
+	ghost_t ** gpp;
+	ghost_t * g;
+
+	for(gpp = &buf_cache.ghost_hash[BUF_HASH(dev, sector, BUF_HASH_SIZE)]; *gpp != NULL; gpp = &((*gpp)->hnext))
 	{
-		if( ! (buf->flags & BUF_BUSY))
+		g = *gpp;
+		if(g->dev == dev && g->sector == sector)
 		{
-			buf->dev = dst_dev;
-			buf->sector = dst_sector;
-			buf->flags = BUF_BUSY; //只设置BUSY
-			move_buf(buf);
+			*gpp = g->hnext;
+			g->dev = -1;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * 选择一个可被替换的buf，其flags中不能含有mask中的任何标志，没有则返回NULL；调用者需关闭中断。
+ * A1in超过buf总数的1/BUF_A1IN_RATIO时优先替换A1in的LRU端，否则优先替换Am的LRU端；
+ * 元数据buf只有在没有其他buf可替换时才会被替换。
+ */
+static buf_t * find_victim(uint32_t mask)
+{
+	uint32_t order[BUF_Q_COUNT];
+	buf_t * buf;
+
+	if(buf_cache.qcount[BUF_Q_A1IN] > buf_cache.count / BUF_A1IN_RATIO)
+	{
+		order[0] = BUF_Q_A1IN;
+		order[1] = BUF_Q_AM;
+	}
+	else
+	{
+		order[0] = BUF_Q_AM;
+		order[1] = BUF_Q_A1IN;
+	}
+
+	/* 第一遍跳过元数据buf，第二遍不再跳过 */
+	for(uint32_t pass = 0; pass < 2; pass++)
+	{
+		for(uint32_t i = 0; i < BUF_Q_COUNT; i++)
+		{
+			for(buf = buf_cache.queue[order[i]].prev; buf != &buf_cache.queue[order[i]]; buf = buf->prev)
+			{
+				if((buf->flags & mask) || buf->refs > 0)
+					continue;
+				if(pass == 0 && (buf->flags & BUF_META))
+					continue;
+				return buf;
+			}
+		}
+	}
+	return NULL;
+}
 
+
+/*
+ * 替换一个空闲且干净的buf，使之映射到dev/sector上并设置为BUSY的，没有则返回NULL；调用者需关闭中断，且dev/sector尚未cache。
+ */
+static buf_t * replace_buf(int32_t dst_dev, uint32_t dst_sector)
+{
+	buf_t * buf;
+
+	if((buf = find_victim(BUF_BUSY | BUF_DIRTY)) == NULL)
+		return NULL;
+
+	/* 被替换出A1in的dev/sector记录到A1out中 */
+	if(buf->queue == BUF_Q_A1IN && buf->dev >= 0)
+		remember_ghost(buf->dev, buf->sector);
+
+	unhash_buf(buf);
+	buf->dev = dst_dev;
+	buf->sector = dst_sector;
+	buf->flags = BUF_BUSY; //只设置BUSY
+	hash_buf(buf);
+
+	/* 最近刚从A1in中被替换出去的，说明会被多次访问，放入Am中 */
+	if(forget_ghost(dst_dev, dst_sector))
+	{
+		buf_cache.stats.ghost_hits++;
+		move_buf(buf, BUF_Q_AM);
+	}
+	else
+		move_buf(buf, BUF_Q_A1IN);
+
+	return buf;
+}
+
+
+/*
+ * 获取一个映射到指定dev/sector上的buf，该buf设置为BUSY的，并按照2Q策略调整其所在队列；
+ * buf被其他进程BUSY或共享持有时需要等待。
+ * 优先替换干净的buf，如果空闲的buf都是DIRTY的，则先写回其中最应该被替换的一个。
+ * 如果所有buf都是BUSY的，nowait为1时返回NULL，否则休眠直到有buf被释放。
+ */
+static buf_t * get_buf(int32_t dst_dev, uint32_t dst_sector, uint32_t nowait)
+{
+	buf_t * buf;
+	pushcli(); //关闭中断，保存原来的中断状态
+
+	continue_check:
+	/* 查看dst_dev/dst_sector是否已经cache了 */
+	/* 通过散列表查找，不必遍历整个链表 */
+	if((buf = lookup_buf(dst_dev, dst_sector)) != NULL)
+	{
+		if( ! (buf->flags & BUF_BUSY) && buf->refs == 0)
+		{
+			buf->flags |= BUF_BUSY;
+			/* A1in为FIFO，只有Am中的buf被访问时才移动到MRU端 */
+			if(buf->queue == BUF_Q_AM)
+				move_buf(buf, BUF_Q_AM);
+			buf_cache.stats.hits++;
+			/* 预读的数据被使用了 */
+			if(buf->flags & BUF_PREFETCHED)
+			{
+				buf->flags &= ~BUF_PREFETCHED;
+				buf_cache.stats.ra_hits++;
+			}
+			
 			popcli(); //恢复原来的中断状态
 			return buf;
 		}
+		sleep(buf);
+		goto continue_check;
+	}
+
+	/* dst_dev/dst_sector尚未cache，则寻找一个空闲且干净的buf */
+	if((buf = replace_buf(dst_dev, dst_sector)) != NULL)
+	{
+		buf_cache.stats.misses++;
+
+		popcli(); //恢复原来的中断状态
+		return buf;
 	}
 	
-	/* 没有buf可用了，目前暂时是PANIC */
-	PANIC("get_buf: no free buf available");
+	/* 空闲的buf都是DIRTY的，写回最应该被替换的一个后重新查找；
+	 * 写回时可能有其他进程cache了dst_dev/dst_sector，所以需要从头检查 */
+	if((buf = find_victim(BUF_BUSY)) != NULL)
+	{
+		buf->flags |= BUF_BUSY;
+		popcli();
+		sync_blk(buf);
+		release_buf(buf);
+		pushcli();
+		goto continue_check;
+	}
+	
+	/* 没有buf可用了，等待其他进程释放buf */
+	if(nowait)
+	{
+		popcli();
+		return NULL;
+	}
+	buf_cache.waiters++;
+	sleep(&buf_cache);
+	buf_cache.waiters--;
+	goto continue_check;
 }
 
 
@@ -116,28 +539,202 @@ static buf_t * get_buf(int32_t dst_dev, uint32_t dst_sector)
 buf_t * acquire_buf(int32_t dst_dev, uint32_t dst_sector)
 {
 	buf_t * buf;
+	uint64_t start = rdtsc();
+	io_lat_hist_t * lat;
 	
+	/* 内存充足时恢复之前被回收的buf */
+	grow_buf_cache();
+
 	/* 获得一个与dst_dev/dst_sector对应的buf，该buf为BUSY的，即被当前进程占有 */
-	buf = get_buf(dst_dev, dst_sector);
+	buf = get_buf(dst_dev, dst_sector, 0);
 
 	/* 该buf中是否有可用数据 ? */
+	lat = &buf_cache.stats.lat_hit;
 	if( ! (buf->flags & BUF_VALID))
-		sync_ide(buf); //没有则同步一次
+	{
+		sync_blk(buf); //没有则同步一次
+		lat = &buf_cache.stats.lat_miss;
+	}
+
+	/* 记录延迟，包括等待其他进程释放buf的时间 */
+	pushcli();
+	io_lat_add(lat, (uint32_t)(rdtsc() - start));
+	blk_trace_access(buf, lat == &buf_cache.stats.lat_hit, start);
+	popcli();
 	
-	/* 此时buf是BUSY、VALID、UN-DIRTY的 */
+	/* 此时buf是BUSY、VALID的 */
 	return buf;
 }
 
 
 /*
- * 同步buf和对应sector
+ * 以共享方式请求一个映射到指定dev/sector上的buf，返回时buf是VALID的，调用者只能读取其中的数据，
+ * 读取完毕后调用release_buf_shared释放。
+ * 已经cache且没有被BUSY地占有的buf可以同时被多个进程共享持有，如超级块、i节点所在的块等经常被读取的buf；
+ * 尚未cache时先BUSY地读入，再转为共享持有。
+ * 注意：共享持有期间其他进程不能BUSY地获得该buf，调用者不应长时间持有。
+ */
+buf_t * acquire_buf_shared(int32_t dst_dev, uint32_t dst_sector)
+{
+	buf_t * buf;
+	uint64_t start = rdtsc();
+
+	grow_buf_cache();
+
+	pushcli();
+	while((buf = lookup_buf(dst_dev, dst_sector)) != NULL && (buf->flags & BUF_BUSY))
+		sleep(buf);
+	if(buf != NULL && (buf->flags & BUF_VALID))
+	{
+		buf->refs++;
+		if(buf->queue == BUF_Q_AM)
+			move_buf(buf, BUF_Q_AM);
+		buf_cache.stats.hits++;
+		buf_cache.stats.shared++;
+		if(buf->flags & BUF_PREFETCHED)
+		{
+			buf->flags &= ~BUF_PREFETCHED;
+			buf_cache.stats.ra_hits++;
+		}
+		blk_trace_access(buf, 1, start);
+		popcli();
+		return buf;
+	}
+	popcli();
+
+	buf = acquire_buf(dst_dev, dst_sector);
+
+	/* 此时buf是BUSY、VALID的，转为共享持有，并唤醒等待它的其他读者 */
+	pushcli();
+	buf->flags &= ~BUF_BUSY;
+	buf->refs++;
+	wakeup(buf);
+	popcli();
+	return buf;
+}
+
+
+/*
+ * 释放以共享方式持有的buf，最后一个持有者释放时唤醒等待该buf的进程
+ */
+void release_buf_shared(buf_t * buf)
+{
+	pushcli();
+	if(buf->refs == 0)
+		PANIC("release_buf_shared: no process has shared this buf");
+	if(--buf->refs == 0)
+	{
+		wakeup(buf);
+		if(buf_cache.waiters > 0)
+			wakeup(&buf_cache);
+	}
+	popcli();
+}
+
+
+/*
+ * 请求一个映射到指定dev/sector上的buf，但不等待其数据读入：
+ * 如果buf中没有可用数据，则将读请求提交给磁盘后立即返回，之后需调用wait_buf等待读取完成。
+ * 这样可以先提交多个请求，再依次等待，使磁盘的处理与CPU的处理重叠。
+ * 如果所有buf都被占用则返回NULL，调用者应先处理、释放已获得的buf。
+ */
+buf_t * acquire_buf_async(int32_t dst_dev, uint32_t dst_sector)
+{
+	buf_t * buf;
+	uint64_t start = rdtsc();
+	
+	grow_buf_cache();
+
+	if((buf = get_buf(dst_dev, dst_sector, 1)) == NULL)
+		return NULL;
+
+	pushcli();
+	blk_trace_access(buf, buf->flags & BUF_VALID, start);
+	popcli();
+	if( ! (buf->flags & BUF_VALID))
+		submit_blk(buf);
+
+	/* 此时buf是BUSY的，但可能尚未VALID */
+	return buf;
+}
+
+
+/*
+ * 预读dev/sector：如果尚未cache，则替换一个空闲且干净的buf并提交读请求，不等待；
+ * 该buf在读取完成时由磁盘中断处理程序释放，调用者不占有它。
+ * 已经cache（包括正在读取）或提交成功返回0；没有可替换的buf时返回-1，调用者应停止预读。
+ */
+int32_t prefetch_buf(int32_t dst_dev, uint32_t dst_sector)
+{
+	buf_t * buf;
+
+	pushcli();
+	if(lookup_buf(dst_dev, dst_sector) != NULL)
+	{
+		popcli();
+		return 0;
+	}
+	if((buf = replace_buf(dst_dev, dst_sector)) == NULL)
+	{
+		popcli();
+		return -1;
+	}
+	buf->flags |= BUF_ASYNC | BUF_PREFETCHED;
+	buf_cache.stats.ra_issued++;
+	popcli();
+
+	submit_blk(buf);
+	return 0;
+}
+
+
+/*
+ * 等待由acquire_buf_async获得的buf读取完成，返回时buf是BUSY、VALID的
+ */
+void wait_buf(buf_t * buf)
+{
+	if( ! (buf->flags & BUF_BUSY))
+		PANIC("wait_buf: no process has owned this buf");
+
+	pushcli();
+	while( ! (buf->flags & BUF_VALID))
+		sleep(buf);
+	popcli();
+}
+
+
+/*
+ * 将buf标记为元数据（超级块、位图、i节点、间接块等），buf必须是BUSY或被共享持有的；
+ * 元数据buf直接放入Am中，且只有在没有其他buf可替换时才会被替换。该标记在buf被替换后失效。
+ */
+void mark_buf_meta(buf_t * buf)
+{
+	if( ! (buf->flags & BUF_BUSY) && buf->refs == 0)
+		PANIC("mark_buf_meta: no process has owned this buf");
+
+	pushcli();
+	if( ! (buf->flags & BUF_META))
+	{
+		buf->flags |= BUF_META;
+		move_buf(buf, BUF_Q_AM);
+	}
+	popcli();
+}
+
+
+/*
+ * 标记buf中的数据已被修改，数据将在之后由写回线程、替换buf或sync时写入磁盘；
+ * 在写回之前对同一buf的多次修改只会产生一次写操作。
  */
 void write_buf(buf_t * buf)
 {
 	if( !(buf->flags & BUF_BUSY))
 		PANIC("write_buf: no process has owned this buf");
-	buf->flags |= BUF_DIRTY;
-	sync_ide(buf);
+	if( ! (buf->flags & BUF_DIRTY))
+	{
+		buf->flags |= BUF_DIRTY;
+		buf->dirty_tick = ticks;
+	}
 }
 
 
@@ -150,6 +747,119 @@ void release_buf(buf_t * buf)
 		PANIC("release_buf: no process has owned this buf");
 	buf->flags &= ~BUF_BUSY;
 	wakeup(buf);
+	if(buf_cache.waiters > 0)
+		wakeup(&buf_cache);
+}
+
+
+/*
+ * 在中断处理程序中释放带有BUF_ASYNC标志的buf，即I/O完成后无人等待的buf
+ */
+void release_buf_noint(buf_t * buf)
+{
+	if( ! (buf->flags & BUF_BUSY))
+		PANIC("release_buf_noint: no process has owned this buf");
+	buf->flags &= ~(BUF_BUSY | BUF_ASYNC);
+	wakeup_noint(buf);
+	if(buf_cache.waiters > 0)
+		wakeup_noint(&buf_cache);
+}
+
+
+/*
+ * 获取块缓冲的命中统计
+ */
+void get_buf_cache_stats(buf_cache_stats_t * st)
+{
+	pushcli();
+	*st = buf_cache.stats;
+	st->a1in_count = buf_cache.qcount[BUF_Q_A1IN];
+	st->am_count = buf_cache.qcount[BUF_Q_AM];
+	popcli();
+}
+
+
+/*
+ * 写回dev上DIRTY时间不少于age个时钟滴答的buf，dev为负数时表示所有设备；
+ * 如果need_wait为1，则等待被其他进程占用的DIRTY buf，否则跳过它们。
+ */
+static void flush_bufs(int32_t dev, uint32_t age, uint32_t need_wait)
+{
+	buf_t * buf;
+
+	pushcli();
+
+	rescan:
+	/* 按照LRU的顺序，先写回最久未使用的buf */
+	for(uint32_t q = 0; q < BUF_Q_COUNT; q++)
+	{
+		for(buf = buf_cache.queue[q].prev; buf != &buf_cache.queue[q]; buf = buf->prev)
+		{
+			if( ! (buf->flags & BUF_DIRTY))
+				continue;
+			if(dev >= 0 && buf->dev != dev)
+				continue;
+			if(ticks - buf->dirty_tick < age)
+				continue;
+			if(buf->flags & BUF_BUSY)
+			{
+				if( ! need_wait)
+					continue;
+				sleep(buf);
+				goto rescan;
+			}
+
+			/* 占有该buf后写回；写回期间链表可能已经改变，所以需要重新查找。
+			 * 共享持有者只读取数据，不必等待它们释放 */
+			buf->flags |= BUF_BUSY;
+			popcli();
+			sync_blk(buf);
+			release_buf(buf);
+			pushcli();
+			goto rescan;
+		}
+	}
+
+	popcli();
+}
+
+
+/*
+ * 将dev上所有DIRTY的buf写回磁盘，dev为负数时表示所有设备；返回时这些buf都已经写回。
+ */
+void sync_buf_cache(int32_t dev)
+{
+	flush_bufs(dev, 0, 1);
+}
+
+
+/*
+ * 块缓冲写回线程，周期性的写回DIRTY时间超过BUF_DIRTY_EXPIRE的buf
+ */
+static void buf_flusher(void)
+{
+	uint32_t start;
+
+	for(;;)
+	{
+		flush_bufs(-1, BUF_DIRTY_EXPIRE, 0);
+
+		pushcli();
+		start = ticks;
+		while(ticks - start < BUF_FLUSH_INTERVAL)
+			sleep((void *)&ticks);
+		popcli();
+	}
+}
+
+
+/*
+ * 创建块缓冲写回线程，必须在create_first_proc之后、scheduler之前调用
+ */
+void start_buf_flusher(void)
+{
+	if(create_kernel_thread_noint("buf_flusher", buf_flusher) == NULL)
+		PANIC("start_buf_flusher: create kernel thread failed");
 }
 
 
@@ -162,11 +872,20 @@ void dump_buf(buf_t * buf)
 	print_log("(%X: %d,%u: %X: ", buf, buf->dev, buf->sector, buf->data);
 	if(buf->flags & BUF_BUSY)
 		print_log("BUSY, ");
+	if(buf->refs > 0)
+		print_log("SHARED(%u), ", buf->refs);
 	if(buf->flags & BUF_VALID)
 		print_log("VALID, ");
 	if(buf->flags & BUF_DIRTY)
-		print_log("DIRTY, ");
-	print_log("qnext: %X)", buf->qnext);
+		print_log("DIRTY(%u), ", buf->dirty_tick);
+	if(buf->flags & BUF_META)
+		print_log("META, ");
+	if(buf->flags & BUF_ASYNC)
+		print_log("ASYNC, ");
+	if(buf->flags & BUF_PREFETCHED)
+		print_log("PREFETCHED, ");
+	print_log("%s, ", buf->queue == BUF_Q_AM ? "Am" : "A1in");
+	print_log("qnext: %X hnext: %X)", buf->qnext, buf->hnext);
 	print_log("->%X\n", buf->next);
 
 	popcli();
@@ -176,8 +895,22 @@ void dump_buf_cache(void)
 {
 	buf_t * buf;
 
-	for(buf = buf_cache.head.next; buf != &buf_cache.head; buf = buf->next)
+	for(uint32_t q = 0; q < BUF_Q_COUNT; q++)
 	{
-		dump_buf(buf);
+		print_log("%s: %u bufs\n", q == BUF_Q_AM ? "Am" : "A1in", buf_cache.qcount[q]);
+		for(buf = buf_cache.queue[q].next; buf != &buf_cache.queue[q]; buf = buf->next)
+		{
+			dump_buf(buf);
+		}
 	}
 }
+
+void dump_buf_cache_stats(void)
+{
+	buf_cache_stats_t st;
+
+	get_buf_cache_stats(&st);
+	printk("buf_cache: hits %u misses %u ghost_hits %u A1in %u Am %u\n",
+			st.hits, st.misses, st.ghost_hits, st.a1in_count, st.am_count);
+	printk("buf_cache: readahead issued %u used %u, shared hits %u\n", st.ra_issued, st.ra_hits, st.shared);
+}
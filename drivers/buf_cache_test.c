@@ -0,0 +1,126 @@
+/*
+ * 本文件提供块缓冲相关的测试函数
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "buf_cache.h"
+#include "parameters.h"
+#include "vmm.h"
+#include "x86.h"
+
+#include "terminal_io.h"
+
+/* 测试用的buf头部，仅包含查找时会访问到的成员 */
+typedef struct _test_buf_t {
+	int32_t dev;
+	uint32_t sector;
+	struct _test_buf_t * next; //模拟MRU链表
+	struct _test_buf_t * hnext; //模拟散列链表
+} test_buf_t;
+
+/* 测试所使用的缓冲区大小，最后一个应不超过TEST_MAX_BUFS */
+static const uint32_t test_sizes[] = {BUF_MIN_COUNT, 64, 256, 1024};
+#define TEST_MAX_BUFS	1024
+/* 每种大小下进行的查找次数 */
+#define TEST_LOOKUPS	4096
+/* 每页可容纳的test_buf_t个数 */
+#define TEST_BUFS_PER_PAGE	(PAGE_SIZE / sizeof(test_buf_t))
+#define TEST_PAGES	((TEST_MAX_BUFS + TEST_BUFS_PER_PAGE - 1) / TEST_BUFS_PER_PAGE)
+
+/*
+ * 比较原有的按MRU顺序遍历链表与按dev/sector散列查找两种方式的开销，以内核命令行参数bufselftest=1启动时调用。
+ * 对每种缓冲区大小，分别用两种方式查找相同的一组dev/sector，输出平均每次查找所用的时钟周期数；
+ * 如果两种方式查找的结果不同则PANIC。
+ *
+ * 注意：该函数使用不带锁的内存分配接口，只能在创建第一个进程之前调用。
+ */
+void test_buf_cache_lookup(void)
+{
+	test_buf_t * pages[TEST_PAGES];
+	test_buf_t ** hash;
+	test_buf_t * head;
+	test_buf_t * b;
+	test_buf_t * h;
+	uint32_t n, i, sector;
+	uint64_t scan_cycles, hash_cycles, start;
+
+	for(i = 0; i < TEST_PAGES; i++)
+		if((pages[i] = alloc_page_noint()) == NULL)
+			PANIC("test_buf_cache_lookup: alloc page failed");
+	if((hash = alloc_page_noint()) == NULL)
+		PANIC("test_buf_cache_lookup: alloc page failed");
+	if(BUF_HASH_SIZE * sizeof(test_buf_t *) > PAGE_SIZE)
+		PANIC("test_buf_cache_lookup: hash table too large");
+
+#define TEST_BUF(x) (&pages[(x) / TEST_BUFS_PER_PAGE][(x) % TEST_BUFS_PER_PAGE])
+
+	printk("buf_cache lookup selftest (cycles/lookup):\n");
+	for(uint32_t t = 0; t < sizeof(test_sizes)/sizeof(test_sizes[0]); t++)
+	{
+		n = test_sizes[t];
+
+		/* 构造n个buf，扇区号分散在磁盘上，依次插入链表MRU端和散列表中 */
+		head = NULL;
+		for(i = 0; i < BUF_HASH_SIZE; i++)
+			hash[i] = NULL;
+		for(i = 0; i < n; i++)
+		{
+			b = TEST_BUF(i);
+			b->dev = 0;
+			b->sector = i * 37 + 11;
+			b->next = head;
+			head = b;
+			b->hnext = hash[BUF_HASH(b->dev, b->sector, BUF_HASH_SIZE)];
+			hash[BUF_HASH(b->dev, b->sector, BUF_HASH_SIZE)] = b;
+		}
+
+		/* 原有方式：按MRU顺序遍历 */
+		start = rdtsc();
+		for(i = 0; i < TEST_LOOKUPS; i++)
+		{
+			sector = ((i * 2654435761u) % n) * 37 + 11;
+			for(b = head; b != NULL; b = b->next)
+				if(b->dev == 0 && b->sector == sector)
+					break;
+			if(b == NULL)
+				PANIC("test_buf_cache_lookup: scan lookup failed");
+		}
+		scan_cycles = rdtsc() - start;
+
+		/* 散列查找 */
+		start = rdtsc();
+		for(i = 0; i < TEST_LOOKUPS; i++)
+		{
+			sector = ((i * 2654435761u) % n) * 37 + 11;
+			for(h = hash[BUF_HASH(0, sector, BUF_HASH_SIZE)]; h != NULL; h = h->hnext)
+				if(h->dev == 0 && h->sector == sector)
+					break;
+			if(h == NULL)
+				PANIC("test_buf_cache_lookup: hash lookup failed");
+		}
+		hash_cycles = rdtsc() - start;
+
+		/* 两种方式查找的结果必须一致 */
+		for(i = 0; i < n; i++)
+		{
+			sector = i * 37 + 11;
+			for(b = head; b != NULL && b->sector != sector; b = b->next)
+				;
+			for(h = hash[BUF_HASH(0, sector, BUF_HASH_SIZE)]; h != NULL && h->sector != sector; h = h->hnext)
+				;
+			if(b != h)
+				PANIC("test_buf_cache_lookup: results mismatch");
+		}
+
+		printk("  %u bufs: scan %u, hash %u\n", n,
+				(uint32_t)(scan_cycles / TEST_LOOKUPS),
+				(uint32_t)(hash_cycles / TEST_LOOKUPS));
+	}
+
+#undef TEST_BUF
+
+	free_page_noint(hash);
+	for(i = 0; i < TEST_PAGES; i++)
+		free_page_noint(pages[i]);
+}
@@ -12,50 +12,150 @@
 #include "8259A.h"
 #include "process.h"
 #include "idt.h"
+#include "io_sched.h"
+#include "blk_dev.h"
+#include "multiboot.h"
+#include "pci.h"
+#include "vmm.h"
+#include "parameters.h"
 
 #include "terminal_io.h"
 
 
-/* some ide ports which related with one or two registers */
-#define IDE_DATA_REG		0x1F0
-#define IDE_ERR_REG		0x1F1
-#define IDE_FEATURE_REG		0x1F1
-#define IDE_SECTOR_COUNT_REG	0x1F2
-#define	IDE_LBAlo_REG		0x1F3
-#define IDE_LBAmid_REG		0x1F4
-#define IDE_LBAhi_REG		0x1F5
-#define IDE_DRIVE_HEAD_REG	0x1F6
-#define IDE_STATUS_REG		0x1F7
-#define IDE_CMD_REG		0x1F7
-/* 在bochsrc文件中，针对ata0默认生成的这个端口起始地址是0x3F0，但是如果在程序中使用0x3F6也是可以的 */
-#define IDE_CTRL_ALT_STATUS_REG	0x3F6
-#define	IDE_CTRL_DEV_CONTROL_REG	0x3F6
+/* some ide ports which related with one or two registers，相对于通道命令寄存器组的基址 */
+#define IDE_DATA_REG		0x0
+#define IDE_ERR_REG		0x1
+#define IDE_FEATURE_REG		0x1
+#define IDE_SECTOR_COUNT_REG	0x2
+#define	IDE_LBAlo_REG		0x3
+#define IDE_LBAmid_REG		0x4
+#define IDE_LBAhi_REG		0x5
+#define IDE_DRIVE_HEAD_REG	0x6
+#define IDE_STATUS_REG		0x7
+#define IDE_CMD_REG		0x7
+/* 控制寄存器（读时为alternate status，写时为device control）的端口由各通道给出；
+ * 在bochsrc文件中，针对ata0默认生成的这个端口起始地址是0x3F0，但是如果在程序中使用0x3F6也是可以的 */
+
+/* some flags in ide device control register */
+#define IDE_CTRL_nIEN		0x02	//Set this to stop the current device from sending interrupts.
 
 /* some flags in ide status register and alternate status register */
 #define IDE_STATUS_BSY		0x80	//Indicates the drive is preparing to send/receive data (wait for it to clear).
 #define IDE_STATUS_DRDY		0x40	//Bit is clear when drive is spun down, or after an error. Set otherwise.
 #define IDE_STATUS_DF		0x20	//Drive Fault Error.
+#define IDE_STATUS_DRQ		0x08	//Set when the drive has PIO data to transfer, or is ready to accept PIO data.
 #define IDE_STATUS_ERR		0x01	//Indicates an error occurred.
 
 /* commands used in ide command register */
 #define IDE_CMD_READ		0x20	//read command
 #define IDE_CMD_WRITE		0x30	//write command
+#define IDE_CMD_READ_MULTIPLE	0xC4	//read multiple command
+#define IDE_CMD_WRITE_MULTIPLE	0xC5	//write multiple command
+#define IDE_CMD_SET_MULTIPLE	0xC6	//set multiple mode command
+#define IDE_CMD_IDENTIFY	0xEC	//identify device command
+#define IDE_CMD_READ_DMA	0xC8	//read dma command
+#define IDE_CMD_WRITE_DMA	0xCA	//write dma command
+
+/* 一次READ/WRITE MULTIPLE命令最多传输的扇区数，实际值还受限于硬盘支持的值 */
+#define IDE_MULTIPLE_MAX	16
+
+/* 探测硬盘时轮询状态寄存器的最多次数，超过时认为硬盘不存在 */
+#define IDE_SPIN_COUNT		100000
+
+/* PCI IDE控制器总线主控（bus-master）寄存器，相对于BAR4给出的基址；每个通道占8个端口，primary在前 */
+#define BM_CMD_REG		0x0
+#define BM_STATUS_REG		0x2
+#define BM_PRDT_REG		0x4
+#define BM_CHANNEL_SIZE		0x8
+
+/* some flags in bus-master command register */
+#define BM_CMD_START		0x01	//开始/停止DMA传输
+#define BM_CMD_READ		0x08	//为1时从硬盘传输到内存，为0时从内存传输到硬盘
+
+/* some flags in bus-master status register */
+#define BM_STATUS_ACTIVE	0x01	//DMA传输进行中
+#define BM_STATUS_ERR		0x02	//DMA传输出错，写1清除
+#define BM_STATUS_IRQ		0x04	//硬盘产生了中断，写1清除
+#define BM_STATUS_DRV0_DMA	0x20	//master驱动可以使用DMA
+#define BM_STATUS_DRV1_DMA	0x40	//slave驱动可以使用DMA
+
+/* PRD表中的项数，即一次DMA命令最多传输的扇区数；每项描述一个buf->data */
+#define IDE_PRD_COUNT		32
+/* PRD项中表示最后一项的标志 */
+#define IDE_PRD_EOT		0x80000000
+
+/* 一个命令最多包含的buf数 */
+#define IDE_CMD_MAX		(IDE_PRD_COUNT > IDE_MULTIPLE_MAX ? IDE_PRD_COUNT : IDE_MULTIPLE_MAX)
+
+/* 通道数 */
+#define IDE_CHANNEL_COUNT	(IDE_DRIVE_COUNT / 2)
+
+/* Physical Region Descriptor，描述一段物理地址连续且不跨越64K边界的内存 */
+typedef struct {
+	uint32_t addr; //物理地址
+	uint16_t count; //字节数，0表示64K
+	uint16_t flags; //最高位为EOT
+} __attribute__((packed)) ide_prd_t;
 
-/* 硬盘请求队列头部 */
-static buf_t * ide_queue;
+struct _ide_channel_t;
+
+/* 一个IDE硬盘，以及其对应的块设备和请求队列C-LOOK调度使用的存储空间；每个buf最多只有一个请求在队列中 */
+typedef struct {
+	struct _ide_channel_t * chan; //所在的通道
+	uint32_t present; //硬盘是否存在
+	uint32_t slave; //0为master，1为slave
+	int32_t dev_no; //设备号
+	uint32_t dma; //是否使用DMA传输数据，为0时使用PIO
+	uint32_t multiple; //硬盘支持的每次READ/WRITE MULTIPLE的扇区数，为0时表示不使用MULTIPLE命令
+	uint32_t sectors; //容量（扇区数）
+	blk_dev_t dev;
+	buf_t * slots[BUF_MAX_COUNT];
+} ide_drive_t;
+
+/*
+ * 一个IDE通道；通道上的两个硬盘共用寄存器和中断线，同一时刻只能有一个命令，
+ * 两个硬盘的请求队列轮流取出请求。
+ */
+typedef struct _ide_channel_t {
+	uint16_t base; //命令寄存器组的I/O基址
+	uint16_t ctrl; //控制寄存器的端口
+	uint8_t irq; //中断线
+	uint16_t bm_base; //总线主控寄存器的I/O基址，为0时表示不能使用DMA
+	ide_prd_t * prdt; //PRD表，占用一个页面以保证不跨越64K边界
+	ide_drive_t drives[2];
+	/* 当前已提交给硬件的命令所属的硬盘及其包含的buf，它们的扇区连续 */
+	ide_drive_t * cur_drive;
+	buf_t * cur[IDE_CMD_MAX];
+	uint32_t cur_count;
+	uint32_t next; //下一次优先从哪个硬盘的队列取出请求
+} ide_channel_t;
+
+/* primary和secondary通道，使用ISA兼容模式下的固定端口和中断线 */
+static ide_channel_t ide_channels[IDE_CHANNEL_COUNT] = {
+	{ .base = 0x1F0, .ctrl = 0x3F6, .irq = IRQ14_INT_VECTOR - IRQ0_INT_VECTOR },
+	{ .base = 0x170, .ctrl = 0x376, .irq = IRQ15_INT_VECTOR - IRQ0_INT_VECTOR },
+};
+
+static const char * ide_names[IDE_DRIVE_COUNT] = { "ide0", "ide1", "ide2", "ide3" };
+
+/* 同步读请求轮询的最长时间（CPU时钟周期数），为0时不轮询 */
+static uint32_t ide_poll_cycles;
+
+/* 统计数据，所有硬盘共用 */
+static ide_stats_t ide_stats;
 
 /*
- * 轮询ide drive的状态寄存器，看其是否UN-BSY且RDY；如果需要检查是否出错且发现出错，则返回0，其余情况返回1。
+ * 轮询通道中当前选中硬盘的状态寄存器，看其是否UN-BSY且RDY；如果需要检查是否出错且发现出错，则返回0，其余情况返回1。
  */
-static uint32_t wait_ide(uint32_t need_check_err)
+static uint32_t wait_ide(ide_channel_t * chan, uint32_t need_check_err)
 {
 	uint8_t r;
 	/* 在bochs中测试时，似乎不应该检测IDE_STATUS_DRDY */
 	/*
-	while(((r = inb(IDE_STATUS_REG)) & (IDE_STATUS_BSY | IDE_STATUS_DRDY)) != IDE_STATUS_DRDY)
+	while(((r = inb(chan->base + IDE_STATUS_REG)) & (IDE_STATUS_BSY | IDE_STATUS_DRDY)) != IDE_STATUS_DRDY)
 		;
 		*/
-	while((r = inb(IDE_STATUS_REG)) & IDE_STATUS_BSY)
+	while((r = inb(chan->base + IDE_STATUS_REG)) & IDE_STATUS_BSY)
 		;
 	if(need_check_err && (r & (IDE_STATUS_DF | IDE_STATUS_ERR)) != 0)
 		return 0;
@@ -64,107 +164,469 @@ static uint32_t wait_ide(uint32_t need_check_err)
 
 
 /*
- * 将请求提交给硬件
+ * 与wait_ide类似，但最多轮询IDE_SPIN_COUNT次，用于探测可能不存在的硬盘；返回最后读到的状态
+ */
+static uint8_t spin_ide(ide_channel_t * chan)
+{
+	uint8_t r = IDE_STATUS_BSY;
+
+	for(uint32_t i = 0; i < IDE_SPIN_COUNT && (r & IDE_STATUS_BSY); i++)
+		r = inb(chan->base + IDE_STATUS_REG);
+	return r;
+}
+
+
+/*
+ * 选中通道上的master/slave硬盘，使用LBA28，head为LBA28的高4位；之后读4次alternate status以等待约400ns
+ */
+static void select_ide(ide_channel_t * chan, uint32_t slave, uint32_t head)
+{
+	outb(chan->base + IDE_DRIVE_HEAD_REG, 0xe0 | (slave << 4) | (head & 0xF));
+	for(uint32_t i = 0; i < 4; i++)
+		inb(chan->ctrl);
+}
+
+
+/*
+ * 为chan->cur中的buf填写PRD表并启动DMA传输，write为真时写入硬盘；
+ * 调用者已经写好了扇区数和LBA等寄存器。此后数据由控制器直接在buf->data和硬盘之间传输，
+ * 完成时产生中断。
+ */
+static void start_ide_dma(ide_channel_t * chan, uint32_t write)
+{
+	for(uint32_t i = 0; i < chan->cur_count; i++)
+	{
+		/* buf->data位于一个页面之内，不会跨越64K边界 */
+		chan->prdt[i].addr = K_V2P(chan->cur[i]->data);
+		chan->prdt[i].count = BUF_SIZE;
+		chan->prdt[i].flags = 0;
+	}
+	chan->prdt[chan->cur_count - 1].flags = IDE_PRD_EOT >> 16;
+
+	outb(chan->bm_base + BM_CMD_REG, 0); //确保DMA已停止
+	outl(chan->bm_base + BM_PRDT_REG, K_V2P(chan->prdt));
+	outb(chan->bm_base + BM_STATUS_REG, inb(chan->bm_base + BM_STATUS_REG) | BM_STATUS_ERR | BM_STATUS_IRQ); //清除上一次的状态
+	outb(chan->base + IDE_CMD_REG, write ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA);
+	outb(chan->bm_base + BM_CMD_REG, (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+	ide_stats.dma++;
+}
+
+
+/*
+ * 从通道上某个硬盘的请求队列中取出下一个请求提交给硬件，与其扇区连续的后续请求合并为一个命令
+ * （DMA方式下为READ/WRITE DMA，否则为READ/WRITE MULTIPLE）；两个硬盘都有请求时轮流处理。
+ * 队列都为空时什么也不做。调用者需关闭中断，且通道当前没有在处理命令。
  */
-static void start_ide_request(buf_t * buf)
+static void start_ide_request(ide_channel_t * chan)
 {
-	if(buf == NULL || buf->dev < 0)
+	ide_drive_t * drive = NULL;
+	buf_t * buf;
+	buf_t * b;
+	uint32_t max;
+
+	for(uint32_t i = 0; i < 2 && drive == NULL; i++)
+	{
+		ide_drive_t * d = &chan->drives[(chan->next + i) % 2];
+		if(d->present && d->dev.queue.count > 0)
+			drive = d;
+	}
+	if(drive == NULL)
+		return;
+	chan->next = ! drive->slave;
+
+	buf = io_sched_next(&drive->dev.queue);
+	if(buf->io_dev != drive->dev_no)
 		PANIC("start_ide_request: illegal request");
 
-	wait_ide(0); //等待硬件做好准备
-	outb(IDE_CTRL_DEV_CONTROL_REG, 0); //配置硬件在完成请求后产生中断
-	outb(IDE_SECTOR_COUNT_REG, 1); //一次处理一个sector
-	outb(IDE_LBAlo_REG, buf->sector & 0xFF); //依次写入LBA28的低24位
-	outb(IDE_LBAmid_REG, (buf->sector >> 8) & 0xFF);
-	outb(IDE_LBAhi_REG, (buf->sector >> 16) & 0xFF);
-	outb(IDE_DRIVE_HEAD_REG, 0xe0 | ((buf->sector >> 24) & 0xF)); //使用LBA28，选择master驱动，并给出LBA28的高4位
+	/* 合并扇区连续的请求 */
+	max = drive->dma ? IDE_PRD_COUNT : drive->multiple;
+	chan->cur_drive = drive;
+	chan->cur[0] = buf;
+	chan->cur_count = 1;
+	while(max != 0 && chan->cur_count < max &&
+			(b = io_sched_next_contig(&drive->dev.queue, chan->cur[chan->cur_count - 1])) != NULL)
+		chan->cur[chan->cur_count++] = b;
+
+	ide_stats.cmds++;
+	ide_stats.sectors += chan->cur_count;
+	if(chan->cur_count > 1)
+		ide_stats.merged += chan->cur_count - 1;
+
+	select_ide(chan, drive->slave, buf->io_sector >> 24); //选择硬盘，并给出LBA28的高4位
+	wait_ide(chan, 0); //等待硬件做好准备
+	outb(chan->ctrl, 0); //配置硬件在完成请求后产生中断
+	outb(chan->base + IDE_SECTOR_COUNT_REG, chan->cur_count); //一次处理cur_count个sector
+	outb(chan->base + IDE_LBAlo_REG, buf->io_sector & 0xFF); //依次写入LBA28的低24位
+	outb(chan->base + IDE_LBAmid_REG, (buf->io_sector >> 8) & 0xFF);
+	outb(chan->base + IDE_LBAhi_REG, (buf->io_sector >> 16) & 0xFF);
+
+	if(drive->dma)
+	{
+		start_ide_dma(chan, buf->flags & BUF_DIRTY);
+		return;
+	}
 
 	if(buf->flags & BUF_DIRTY) //如果是DIRTY的则写入，否则读取
 	{
-		outb(IDE_CMD_REG, IDE_CMD_WRITE);
-		outsl(IDE_DATA_REG, buf->data, sizeof(buf->data)/4);
+		outb(chan->base + IDE_CMD_REG, drive->multiple ? IDE_CMD_WRITE_MULTIPLE : IDE_CMD_WRITE);
+		/* 所有扇区作为一个DRQ块写入 */
+		wait_ide(chan, 0);
+		for(uint32_t i = 0; i < chan->cur_count; i++)
+			outsl(chan->base + IDE_DATA_REG, chan->cur[i]->data, BUF_SIZE/4);
 	}
 	else
-		outb(IDE_CMD_REG, IDE_CMD_READ);
+		outb(chan->base + IDE_CMD_REG, drive->multiple ? IDE_CMD_READ_MULTIPLE : IDE_CMD_READ);
 }
 
 
 /*
- * ide中断处理
+ * 检查通道当前提交给硬件的命令是否已经完成，不会清除硬盘的中断
  */
-static void ide_handler(trapframe_t * tf)
+static uint32_t ide_cmd_done(ide_channel_t * chan)
 {
-	/* 由于CPU处理该中断时自动关闭了中断，所以不再调用pushcli/popcli */
-	buf_t * buf;
-	
-	/* 检查是否有supurious irq */
-	if((buf = ide_queue) == NULL)
-		PANIC("ide_handler: maybe a supurious irq ?");
+	uint8_t r = inb(chan->ctrl);
+
+	if(r & IDE_STATUS_BSY)
+		return 0;
+	if(r & (IDE_STATUS_DF | IDE_STATUS_ERR))
+		return 1;
+	if(chan->cur_drive->dma)
+		return (inb(chan->bm_base + BM_STATUS_REG) & (BM_STATUS_ACTIVE | BM_STATUS_IRQ)) == BM_STATUS_IRQ;
+	/* PIO读命令完成时硬盘准备好了数据；写命令的数据在提交时已经写入 */
+	return (chan->cur[0]->flags & BUF_DIRTY) || (r & IDE_STATUS_DRQ);
+}
 
-	/* 移除队列头部的请求 */
-	ide_queue = ide_queue->qnext;
 
-	/* 如果buf是UN-DIRTY，说明之前发起的是读请求，此时还需要从硬件读出数据到buf->data中 */
-	if( ! (buf->flags & BUF_DIRTY))
+/*
+ * 完成通道当前提交给硬件的命令，并开始下一个请求；由中断处理函数或轮询的ide_poll调用，调用者需关闭中断。
+ */
+static void finish_ide_request(ide_channel_t * chan)
+{
+	uint32_t dma = chan->cur_drive->dma;
+	buf_t * buf;
+
+	/* DMA方式下数据已经传输到位，停止DMA并检查是否出错；读取状态寄存器同时清除了硬盘的中断 */
+	if(dma)
 	{
-		if(wait_ide(1) > 0)
-			insl(IDE_DATA_REG, buf->data, sizeof(buf->data)/4);
-		else
-			PANIC("ide_handler: maybe a disk error ?");
+		uint8_t bm_status = inb(chan->bm_base + BM_STATUS_REG);
+
+		outb(chan->bm_base + BM_CMD_REG, 0);
+		outb(chan->bm_base + BM_STATUS_REG, bm_status | BM_STATUS_ERR | BM_STATUS_IRQ);
+		if((bm_status & BM_STATUS_ERR) || wait_ide(chan, 1) == 0)
+			PANIC("finish_ide_request: dma error");
 	}
 
-	/* 此时buf为VALID且UN-DIRTY的 */
-	buf->flags |= BUF_VALID;
-	buf->flags &= ~BUF_DIRTY;
-	/* 唤醒在等待这个buf的进程 */
-	wakeup_noint(buf);
+	/* 当前命令包含cur_count个buf，依次完成它们 */
+	for(uint32_t i = 0; i < chan->cur_count; i++)
+	{
+		buf = chan->cur[i];
+
+		/* 如果buf是UN-DIRTY，说明之前发起的是PIO读请求，此时还需要从硬件读出数据到buf->data中 */
+		if( ! (buf->flags & BUF_DIRTY) && ! dma)
+		{
+			if(wait_ide(chan, 1) > 0)
+				insl(chan->base + IDE_DATA_REG, buf->data, BUF_SIZE/4);
+			else
+				PANIC("finish_ide_request: maybe a disk error ?");
+		}
+
+		/* 此时buf变为VALID且UN-DIRTY的 */
+		complete_blk(buf);
+	}
+	chan->cur_count = 0;
+	chan->cur_drive = NULL;
 
 	/* 如果队列中还有请求未完成，那么现在就开始 */
-	if(ide_queue)
-		start_ide_request(ide_queue);
+	start_ide_request(chan);
+}
+
+
+/*
+ * ide中断处理，IRQ14对应primary通道，IRQ15对应secondary通道
+ */
+static void ide_handler(trapframe_t * tf)
+{
+	ide_channel_t * chan = &ide_channels[tf->trap_no == IRQ15_INT_VECTOR ? 1 : 0];
+
+	/* 由于CPU处理该中断时自动关闭了中断，所以不再调用pushcli/popcli */
+
+	/* 轮询完成的命令仍会产生中断，它可能在下一个命令完成之前到达，此时只需清除硬盘的中断 */
+	if(chan->cur_count == 0 || ! ide_cmd_done(chan))
+	{
+		inb(chan->base + IDE_STATUS_REG);
+		ide_stats.stale_irqs++;
+		return;
+	}
+	ide_stats.irqs++;
 
+	finish_ide_request(chan);
 }
 
 
 /*
- * IDE硬盘初始化，配置PIC以允许相关中断通过，注册中断处理函数，且等待驱动准备好
+ * 通过IDENTIFY命令探测通道上的master/slave硬盘，获取其容量和支持的MULTIPLE扇区数，并用SET MULTIPLE命令设置；
+ * 执行期间关闭硬盘的中断，轮询完成。不响应IDENTIFY的设备（包括ATAPI光驱）视为不存在；
+ * SET MULTIPLE失败时不使用MULTIPLE命令。返回硬盘是否支持DMA。
+ */
+static uint32_t init_ide_drive(ide_channel_t * chan, uint32_t slave)
+{
+	ide_drive_t * drive = &chan->drives[slave];
+	uint16_t id[256];
+	uint32_t max, dma;
+	uint8_t r;
+
+	drive->chan = chan;
+	drive->slave = slave;
+	drive->present = 0;
+	drive->multiple = 0;
+
+	/* 状态为0xFF时通道上没有设备（总线悬空），为0时没有这个硬盘 */
+	outb(chan->ctrl, IDE_CTRL_nIEN);
+	select_ide(chan, slave, 0);
+	r = inb(chan->base + IDE_STATUS_REG);
+	if(r == 0 || r == 0xFF)
+		return 0;
+	if(spin_ide(chan) & IDE_STATUS_BSY)
+		return 0;
+
+	outb(chan->base + IDE_CMD_REG, IDE_CMD_IDENTIFY);
+	if(inb(chan->base + IDE_STATUS_REG) == 0)
+		return 0;
+	r = spin_ide(chan);
+	if((r & (IDE_STATUS_BSY | IDE_STATUS_DF | IDE_STATUS_ERR)) || ! (r & IDE_STATUS_DRQ))
+		return 0;
+	insl(chan->base + IDE_DATA_REG, id, sizeof(id)/4);
+	drive->present = 1;
+
+	/* word 60-61为LBA28可寻址的扇区数 */
+	drive->sectors = id[60] | ((uint32_t)id[61] << 16);
+
+	/* word 49的bit 8表示支持DMA */
+	dma = (id[49] & 0x100) != 0;
+
+	/* word 47的低8位为每次READ/WRITE MULTIPLE最多传输的扇区数 */
+	max = id[47] & 0xFF;
+	if(max > IDE_MULTIPLE_MAX)
+		max = IDE_MULTIPLE_MAX;
+	if(max <= 1)
+		return dma;
+
+	select_ide(chan, slave, 0);
+	outb(chan->base + IDE_SECTOR_COUNT_REG, max);
+	outb(chan->base + IDE_CMD_REG, IDE_CMD_SET_MULTIPLE);
+	if(wait_ide(chan, 1) == 0)
+		return dma;
+	drive->multiple = max;
+	return dma;
+}
+
+
+/*
+ * 查找PCI IDE控制器并为两个通道设置总线主控寄存器基址和PRD表，同时允许控制器作为总线主控；
+ * 找不到控制器或其不支持总线主控时返回0，两个通道都不使用DMA。
+ */
+static uint32_t init_ide_dma(void)
+{
+	pci_addr_t addr;
+	uint32_t bar4;
+	uint16_t base;
+
+	/* class 0x01 subclass 0x01为IDE控制器，prog if的bit 7表示支持总线主控 */
+	if(pci_find_class(0x01, 0x01, 0, &addr) < 0)
+		return 0;
+	if( ! (pci_read_config8(addr, PCI_PROG_IF) & 0x80))
+		return 0;
+	bar4 = pci_read_config32(addr, PCI_BAR0 + 4 * 4);
+	if( ! (bar4 & PCI_BAR_IO) || (bar4 & ~0x3) == 0)
+		return 0;
+	base = bar4 & 0xFFFC;
+
+	pci_enable(addr, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	for(uint32_t i = 0; i < IDE_CHANNEL_COUNT; i++)
+	{
+		ide_channel_t * chan = &ide_channels[i];
+
+		if((chan->prdt = alloc_page_noint()) == NULL)
+			PANIC("init_ide_dma: alloc page failed");
+		chan->bm_base = base + i * BM_CHANNEL_SIZE;
+		outb(chan->bm_base + BM_CMD_REG, 0);
+	}
+	return 1;
+}
+
+
+static void ide_submit(blk_dev_t * bd, buf_t * buf);
+static uint32_t ide_poll(blk_dev_t * bd, buf_t * buf, uint64_t start);
+static void ide_account(blk_dev_t * bd, uint32_t polled, uint64_t cycles);
+
+static const blk_dev_ops_t ide_ops = {
+	.submit = ide_submit,
+	.poll = ide_poll,
+	.account = ide_account,
+};
+
+
+/*
+ * IDE硬盘初始化：探测两个通道上的四个硬盘，将存在的硬盘注册为IDE_DEV_NO + 2 * 通道 + slave，
+ * 配置PIC以允许有硬盘的通道的中断通过，并注册中断处理函数
  */
 void init_ide(void)
 {
-	enable_IRline(IRQ14_INT_VECTOR - IRQ0_INT_VECTOR);
-	register_interrupt_handler(IRQ14_INT_VECTOR, ide_handler);
-	wait_ide(0);
+	char arg[8];
+	uint32_t policy, dma[IDE_DRIVE_COUNT], use_dma, count = 0;
+
+	/* 调度策略可通过内核命令行参数ide_sched=fifo|clook指定，所有硬盘相同 */
+	policy = blk_sched_policy("ide_sched", IO_SCHED_CLOOK);
+	ide_poll_cycles = get_boot_arg_uint("ide_poll", IDE_POLL_CYCLES);
+
+	for(uint32_t i = 0; i < IDE_DRIVE_COUNT; i++)
+		dma[i] = init_ide_drive(&ide_channels[i / 2], i % 2);
+
+	/* 硬盘和控制器都支持时使用DMA，可通过内核命令行参数ide_dma=0关闭 */
+	use_dma = 0;
+	for(uint32_t i = 0; i < IDE_DRIVE_COUNT; i++)
+		use_dma |= ide_channels[i / 2].drives[i % 2].present && dma[i];
+	if(get_boot_arg("ide_dma", arg, sizeof(arg)) > 0 && arg[0] == '0')
+		use_dma = 0;
+	if(use_dma)
+		use_dma = init_ide_dma();
+
+	for(uint32_t i = 0; i < IDE_DRIVE_COUNT; i++)
+	{
+		ide_channel_t * chan = &ide_channels[i / 2];
+		ide_drive_t * drive = &chan->drives[i % 2];
+
+		if( ! drive->present)
+			continue;
+
+		/* 通知控制器该硬盘可以使用DMA */
+		drive->dma = use_dma && dma[i];
+		if(drive->dma)
+			outb(chan->bm_base + BM_STATUS_REG, inb(chan->bm_base + BM_STATUS_REG) |
+					(drive->slave ? BM_STATUS_DRV1_DMA : BM_STATUS_DRV0_DMA));
+
+		drive->dev_no = IDE_DEV_NO + i;
+		init_blk_dev(&drive->dev, ide_names[i], &ide_ops, policy, drive->slots, BUF_MAX_COUNT);
+		drive->dev.sectors = drive->sectors;
+		drive->dev.max_sectors = drive->dma ? IDE_PRD_COUNT : (drive->multiple ? drive->multiple : 1);
+		drive->dev.priv = drive;
+		register_blk_dev(drive->dev_no, &drive->dev);
+		count++;
+
+		printk("init_ide: %s %s %s, %u sectors, %u sectors per command, %s scheduler\n", ide_names[i],
+				i / 2 ? "secondary" : "primary", drive->slave ? "slave" : "master", drive->sectors,
+				drive->dev.max_sectors, io_sched_policy_name(policy));
+	}
+	if(count == 0)
+		printk("init_ide: no ide drive\n");
+
+	for(uint32_t i = 0; i < IDE_CHANNEL_COUNT; i++)
+	{
+		ide_channel_t * chan = &ide_channels[i];
+
+		if( ! chan->drives[0].present && ! chan->drives[1].present)
+			continue;
+		chan->cur_count = 0;
+		/* 允许硬盘产生中断，之后才能打开中断线 */
+		outb(chan->ctrl, 0);
+		register_interrupt_handler(IRQ0_INT_VECTOR + chan->irq, ide_handler);
+		enable_IRline(chan->irq);
+		wait_ide(chan, 0);
+	}
+}
+
+
+/*
+ * 获取ide驱动的统计数据
+ */
+void get_ide_stats(ide_stats_t * st)
+{
+	pushcli();
+	*st = ide_stats;
+	popcli();
 }
 
 
 /*
- * 同步buf和磁盘，同步之后的buf将是VALID且UN-DIRTY，注意buf必须是BUSY的
+ * 将buf加入所属硬盘的请求队列，如果通道空闲则立即开始，否则等待当前命令完成后再提交，届时buf可能会和其他请求合并
  */
-void sync_ide(buf_t * buf)
+static void ide_submit(blk_dev_t * bd, buf_t * buf)
 {
-	buf_t ** bpp;
+	ide_drive_t * drive = bd->priv;
 
-	if( ! (buf->flags & BUF_BUSY))
-		PANIC("sync_ide: no process has owned this buf");
-	if((buf->flags & (BUF_VALID | BUF_DIRTY)) == BUF_VALID)
-		PANIC("sync_ide: nothing to do");
-	
-	pushcli(); //保证同时只有一个进程能够访问ide_queue
+	io_sched_add(&bd->queue, buf);
+	if(drive->chan->cur_count == 0)
+		start_ide_request(drive->chan);
+}
 
-	/* 将buf添加到ide_queue的尾部 */
-	for(bpp = &ide_queue; *bpp != NULL; bpp = &((*bpp)->qnext))
+
+/*
+ * 对于读请求，如果队列较短且buf包含在通道当前提交给硬件的命令中，在ide_poll_cycles个时钟周期内
+ * 轮询该命令是否完成，以避免休眠、中断和进程切换的开销；完成则直接处理并返回1，
+ * 否则返回0，由调用者等待中断。
+ */
+static uint32_t ide_poll(blk_dev_t * bd, buf_t * buf, uint64_t start)
+{
+	ide_channel_t * chan = ((ide_drive_t *)bd->priv)->chan;
+	uint32_t i;
+
+	if(ide_poll_cycles == 0 || (buf->flags & BUF_DIRTY) || bd->queue.count > IDE_POLL_QUEUE_MAX)
+		return 0;
+	for(i = 0; i < chan->cur_count && chan->cur[i] != buf; i++)
 		;
-	*bpp = buf;
-	buf->qnext = NULL;
+	if(i == chan->cur_count)
+		return 0;
 
-	/* 如果队列中仅当前一个请求 */
-	if(ide_queue == buf)
-		start_ide_request(buf);
-	
-	/* 轮询buf是否VALID且UN-DIRTY */
-	while((buf->flags & (BUF_VALID | BUF_DIRTY)) != BUF_VALID)
-		sleep(buf);
+	while(rdtsc() - start < ide_poll_cycles)
+	{
+		if(ide_cmd_done(chan))
+		{
+			finish_ide_request(chan);
+			return 1;
+		}
+	}
+	ide_stats.poll_timeouts++;
+	return 0;
+}
 
-	popcli(); //恢复原来的中断状态
+
+/*
+ * 记录一次同步请求的完成延迟
+ */
+static void ide_account(blk_dev_t * bd, uint32_t polled, uint64_t cycles)
+{
+	ide_lat_t * lat = polled ? &ide_stats.lat_poll : &ide_stats.lat_intr;
+
+	(void)bd;
+	lat->count++;
+	lat->total += cycles;
+	if(cycles > lat->max)
+		lat->max = cycles;
 }
 
+
+/* DEBUG */
+void dump_ide_stats(void)
+{
+	printk("ide: cmds %u dma %u sectors %u merged %u irqs %u\n", ide_stats.cmds, ide_stats.dma,
+			ide_stats.sectors, ide_stats.merged, ide_stats.irqs);
+	printk("ide: stale irqs %u poll %u cycles, timeouts %u\n", ide_stats.stale_irqs, ide_poll_cycles,
+			ide_stats.poll_timeouts);
+	printk("ide: poll %u avg %u max %u, intr %u avg %u max %u (cycles)\n",
+			ide_stats.lat_poll.count,
+			ide_stats.lat_poll.count ? (uint32_t)(ide_stats.lat_poll.total / ide_stats.lat_poll.count) : 0,
+			(uint32_t)ide_stats.lat_poll.max,
+			ide_stats.lat_intr.count,
+			ide_stats.lat_intr.count ? (uint32_t)(ide_stats.lat_intr.total / ide_stats.lat_intr.count) : 0,
+			(uint32_t)ide_stats.lat_intr.max);
+	for(uint32_t i = 0; i < IDE_DRIVE_COUNT; i++)
+	{
+		ide_drive_t * drive = &ide_channels[i / 2].drives[i % 2];
+
+		if( ! drive->present)
+			continue;
+		printk("%s: %s multiple %u, %s dispatched %u expired %u sweeps %u\n", ide_names[i],
+				drive->dma ? "dma" : "pio", drive->multiple, io_sched_policy_name(drive->dev.queue.policy),
+				drive->dev.queue.stats.dispatched, drive->dev.queue.stats.expired, drive->dev.queue.stats.sweeps);
+	}
+}
@@ -0,0 +1,238 @@
+/*
+ * 本文件提供设备请求队列的调度实现，供磁盘驱动程序使用。
+ * 所有函数都要求调用者关闭中断。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "io_sched.h"
+#include "buf_cache.h"
+#include "8253pit.h"
+#include "string.h"
+#include "parameters.h"
+
+/* 请求的方向：0为读，1为写 */
+#define DIR_OF(buf) (((buf)->flags & BUF_DIRTY) ? 1 : 0)
+
+/* 堆h中第i个位置 */
+#define SLOT(q, h, i) ((q)->slots[(h) == 0 ? (i) : (q)->capacity - 1 - (i)])
+
+
+/*
+ * 初始化请求队列，slots为能容纳capacity个请求的存储空间（FIFO策略下不使用）
+ */
+void io_sched_init(io_sched_t * q, uint32_t policy, buf_t ** slots, uint32_t capacity)
+{
+	memset(q, 0, sizeof(*q));
+	q->policy = policy;
+	q->slots = slots;
+	q->capacity = capacity;
+}
+
+
+/*
+ * 根据名字获取调度策略，不认识的名字返回-1
+ */
+int32_t io_sched_policy(const char * name)
+{
+	if(strncmp(name, "fifo", 5) == 0)
+		return IO_SCHED_FIFO;
+	if(strncmp(name, "clook", 6) == 0)
+		return IO_SCHED_CLOOK;
+	return -1;
+}
+
+
+const char * io_sched_policy_name(uint32_t policy)
+{
+	return policy == IO_SCHED_CLOOK ? "clook" : "fifo";
+}
+
+
+/*
+ * 设置堆h中第i个位置为buf
+ */
+static inline void heap_set(io_sched_t * q, uint32_t h, uint32_t i, buf_t * buf)
+{
+	SLOT(q, h, i) = buf;
+	buf->qidx = (h ? IO_SCHED_HEAP_BIT : 0) | i;
+}
+
+
+/*
+ * 将堆h中第i个位置的请求向上/向下调整到合适的位置
+ */
+static void heap_sift(io_sched_t * q, uint32_t h, uint32_t i)
+{
+	buf_t * buf = SLOT(q, h, i);
+	uint32_t parent, child;
+
+	/* 向上 */
+	while(i > 0 && SLOT(q, h, (parent = (i - 1) / 2))->io_sector > buf->io_sector)
+	{
+		heap_set(q, h, i, SLOT(q, h, parent));
+		i = parent;
+	}
+
+	/* 向下 */
+	while((child = 2 * i + 1) < q->heap_count[h])
+	{
+		if(child + 1 < q->heap_count[h] && SLOT(q, h, child + 1)->io_sector < SLOT(q, h, child)->io_sector)
+			child++;
+		if(SLOT(q, h, child)->io_sector >= buf->io_sector)
+			break;
+		heap_set(q, h, i, SLOT(q, h, child));
+		i = child;
+	}
+	heap_set(q, h, i, buf);
+}
+
+
+/*
+ * 将buf从其所在的堆中移除
+ */
+static void heap_remove(io_sched_t * q, buf_t * buf)
+{
+	uint32_t h = (buf->qidx & IO_SCHED_HEAP_BIT) ? 1 : 0;
+	uint32_t i = buf->qidx & ~IO_SCHED_HEAP_BIT;
+	buf_t * last;
+
+	if(i >= q->heap_count[h] || SLOT(q, h, i) != buf)
+		PANIC("heap_remove: buf is not in heap");
+
+	last = SLOT(q, h, --q->heap_count[h]);
+	if(last != buf)
+	{
+		heap_set(q, h, i, last);
+		heap_sift(q, h, i);
+	}
+}
+
+
+/*
+ * 将buf从FIFO链表中移除
+ */
+static void fifo_remove(io_sched_t * q, buf_t * buf)
+{
+	uint32_t d = q->policy == IO_SCHED_FIFO ? 0 : DIR_OF(buf);
+
+	if(buf->qprev)
+		buf->qprev->qnext = buf->qnext;
+	else
+		q->fifo_head[d] = buf->qnext;
+	if(buf->qnext)
+		buf->qnext->qprev = buf->qprev;
+	else
+		q->fifo_tail[d] = buf->qprev;
+	buf->qnext = NULL;
+	buf->qprev = NULL;
+}
+
+
+/*
+ * 从队列中移除buf
+ */
+static buf_t * dispatch(io_sched_t * q, buf_t * buf)
+{
+	fifo_remove(q, buf);
+	if(q->policy == IO_SCHED_CLOOK)
+		heap_remove(q, buf);
+	q->count--;
+	q->stats.dispatched++;
+	return buf;
+}
+
+
+/*
+ * 将请求buf加入队列
+ */
+void io_sched_add(io_sched_t * q, buf_t * buf)
+{
+	uint32_t d = q->policy == IO_SCHED_FIFO ? 0 : DIR_OF(buf);
+	uint32_t h;
+
+	/* 加入FIFO链表尾部 */
+	buf->qnext = NULL;
+	buf->qprev = q->fifo_tail[d];
+	if(q->fifo_tail[d])
+		q->fifo_tail[d]->qnext = buf;
+	else
+		q->fifo_head[d] = buf;
+	q->fifo_tail[d] = buf;
+	buf->deadline = ticks + (d ? IO_SCHED_WRITE_EXPIRE : IO_SCHED_READ_EXPIRE);
+	q->count++;
+
+	if(q->policy != IO_SCHED_CLOOK)
+		return;
+
+	/* 扇区号不小于当前位置的，在本次扫描中处理，否则在下一次扫描中处理 */
+	if(q->heap_count[0] + q->heap_count[1] >= q->capacity)
+		PANIC("io_sched_add: too many requests");
+	h = buf->io_sector >= q->pos ? q->cur : !q->cur;
+	heap_set(q, h, q->heap_count[h]++, buf);
+	heap_sift(q, h, q->heap_count[h] - 1);
+}
+
+
+/*
+ * 取出下一个要处理的请求，队列为空时返回NULL
+ */
+buf_t * io_sched_next(io_sched_t * q)
+{
+	buf_t * buf;
+
+	if(q->count == 0)
+		return NULL;
+
+	if(q->policy == IO_SCHED_FIFO)
+		return dispatch(q, q->fifo_head[0]);
+
+	/* 先处理已经超时的请求，读请求优先；这不改变扫描的位置 */
+	for(uint32_t d = 0; d < 2; d++)
+	{
+		if((buf = q->fifo_head[d]) != NULL && (int32_t)(ticks - buf->deadline) >= 0)
+		{
+			q->stats.expired++;
+			return dispatch(q, buf);
+		}
+	}
+
+	/* 本次扫描已经完成，从最小的扇区号开始下一次扫描 */
+	if(q->heap_count[q->cur] == 0)
+	{
+		q->cur = !q->cur;
+		q->stats.sweeps++;
+	}
+	buf = SLOT(q, q->cur, 0);
+	q->pos = buf->io_sector;
+	return dispatch(q, buf);
+}
+
+
+/*
+ * 如果下一个要处理的请求与prev属于同一设备、方向相同且扇区号紧接着prev，则将其取出，
+ * 以便与prev合并为一个命令；否则返回NULL。
+ */
+buf_t * io_sched_next_contig(io_sched_t * q, buf_t * prev)
+{
+	buf_t * buf;
+
+	if(q->count == 0)
+		return NULL;
+
+	if(q->policy == IO_SCHED_FIFO)
+		buf = q->fifo_head[0];
+	else if(q->heap_count[q->cur] > 0)
+		buf = SLOT(q, q->cur, 0);
+	else
+		return NULL;
+
+	if(buf->io_dev != prev->io_dev || buf->io_sector != prev->io_sector + 1 || DIR_OF(buf) != DIR_OF(prev))
+		return NULL;
+
+	if(q->policy == IO_SCHED_CLOOK)
+		q->pos = buf->io_sector;
+	q->stats.merged++;
+	return dispatch(q, buf);
+}
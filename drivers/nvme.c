@@ -0,0 +1,451 @@
+/*
+ * 本文件提供一个NVMe硬盘驱动程序实现，使用一个admin队列和一个I/O队列对，只访问namespace 1。
+ * 多个读写命令填入submission queue后只写一次doorbell；完成队列按phase位判断新的完成项，
+ * 可以在中断中处理，也可以在同步读写时轮询。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "nvme.h"
+#include "blk_dev.h"
+#include "buf_cache.h"
+#include "io_sched.h"
+#include "pci.h"
+#include "x86.h"
+#include "idt.h"
+#include "vmm.h"
+#include "vm_tools.h"
+#include "process.h"
+#include "multiboot.h"
+#include "string.h"
+#include "parameters.h"
+
+#include "terminal_io.h"
+
+
+/* 控制器寄存器，相对于BAR0给出的基址 */
+#define NVME_REG_CAP		0x00	//64位，控制器能力
+#define NVME_REG_CC		0x14	//控制器配置
+#define NVME_REG_CSTS		0x1C	//控制器状态
+#define NVME_REG_AQA		0x24	//admin队列大小
+#define NVME_REG_ASQ		0x28	//64位，admin submission queue物理地址
+#define NVME_REG_ACQ		0x30	//64位，admin completion queue物理地址
+#define NVME_REG_DBS		0x1000	//doorbell起始位置
+#define NVME_MEM_SIZE		0x2000
+
+/* CAP中的一些域 */
+#define NVME_CAP_MQES(cap)	(((cap) & 0xFFFF) + 1)	//队列最多的项数
+#define NVME_CAP_DSTRD(cap)	(((cap) >> 32) & 0xF)	//doorbell间隔为(4 << DSTRD)字节
+
+/* some flags in CC/CSTS */
+#define NVME_CC_EN		(1 << 0)
+#define NVME_CC_IOSQES		(6 << 16)	//submission queue项为64字节
+#define NVME_CC_IOCQES		(4 << 20)	//completion queue项为16字节
+#define NVME_CSTS_RDY		(1 << 0)
+#define NVME_CSTS_CFS		(1 << 1)	//控制器出现致命错误
+
+/* admin命令 */
+#define NVME_ADMIN_CREATE_SQ	0x01
+#define NVME_ADMIN_CREATE_CQ	0x05
+#define NVME_ADMIN_IDENTIFY	0x06
+/* I/O命令 */
+#define NVME_CMD_WRITE		0x01
+#define NVME_CMD_READ		0x02
+
+/* admin队列的大小，以及轮询等待控制器时的最多次数 */
+#define NVME_ADMIN_QUEUE_SIZE	16
+#define NVME_SPIN_COUNT		10000000
+
+/* submission queue项 */
+typedef struct {
+	uint32_t cdw0; //低8位为opcode，高16位为command id
+	uint32_t nsid;
+	uint32_t reserved[2];
+	uint64_t mptr;
+	uint64_t prp1; //数据的物理地址
+	uint64_t prp2;
+	uint32_t cdw10;
+	uint32_t cdw11;
+	uint32_t cdw12;
+	uint32_t cdw13;
+	uint32_t cdw14;
+	uint32_t cdw15;
+} __attribute__((packed)) nvme_sqe_t;
+
+/* completion queue项 */
+typedef struct {
+	uint32_t result;
+	uint32_t reserved;
+	uint16_t sq_head;
+	uint16_t sq_id;
+	uint16_t cid;
+	uint16_t status; //bit 0为phase位，其余为状态
+} __attribute__((packed)) nvme_cqe_t;
+
+/* 一个队列对 */
+typedef struct {
+	nvme_sqe_t * sq;
+	volatile nvme_cqe_t * cq;
+	uint32_t size;
+	uint32_t sq_tail;
+	uint32_t cq_head;
+	uint32_t phase; //当前期望的phase位
+	uint32_t qid;
+} nvme_queue_t;
+
+static struct {
+	volatile uint8_t * regs; //寄存器的虚拟地址，为NULL时表示没有找到设备
+	uint32_t irq;
+	uint32_t dstrd;
+	uint64_t capacity; //namespace 1的扇区数
+	nvme_queue_t admin;
+	nvme_queue_t io;
+	buf_t * bufs[NVME_QUEUE_SIZE]; //以command id为下标，得到该命令对应的buf
+	uint16_t free_cids[NVME_QUEUE_SIZE]; //空闲command id构成的栈
+	uint32_t nfree_cids;
+	uint32_t inflight;
+	uint32_t poll_cycles;
+	nvme_stats_t stats;
+} nvme;
+
+/* 对应的块设备，以及其请求队列使用的存储空间 */
+static blk_dev_t nvme_dev;
+static buf_t * nvme_sched_slots[BUF_MAX_COUNT];
+
+
+static inline uint32_t nvme_read(uint32_t reg)
+{
+	return *(volatile uint32_t *)(nvme.regs + reg);
+}
+
+static inline void nvme_write(uint32_t reg, uint32_t val)
+{
+	*(volatile uint32_t *)(nvme.regs + reg) = val;
+}
+
+
+/*
+ * 写队列q的submission queue tail doorbell
+ */
+static inline void ring_sq(nvme_queue_t * q)
+{
+	nvme_write(NVME_REG_DBS + (2 * q->qid) * (4 << nvme.dstrd), q->sq_tail);
+}
+
+
+/*
+ * 写队列q的completion queue head doorbell
+ */
+static inline void ring_cq(nvme_queue_t * q)
+{
+	nvme_write(NVME_REG_DBS + (2 * q->qid + 1) * (4 << nvme.dstrd), q->cq_head);
+}
+
+
+/*
+ * 在队列q的submission queue尾部取得一项并清零，不写doorbell
+ */
+static nvme_sqe_t * next_sqe(nvme_queue_t * q)
+{
+	nvme_sqe_t * sqe = &q->sq[q->sq_tail];
+
+	memset(sqe, 0, sizeof(*sqe));
+	q->sq_tail = (q->sq_tail + 1) % q->size;
+	return sqe;
+}
+
+
+/*
+ * 如果队列q的completion queue头部有新的完成项，将其复制到cqe中并前进，返回1；否则返回0
+ */
+static uint32_t pop_cqe(nvme_queue_t * q, nvme_cqe_t * cqe)
+{
+	if((q->cq[q->cq_head].status & 1) != q->phase)
+		return 0;
+	*cqe = *(nvme_cqe_t *)&q->cq[q->cq_head];
+	if(++q->cq_head == q->size)
+	{
+		q->cq_head = 0;
+		q->phase = ! q->phase;
+	}
+	return 1;
+}
+
+
+/*
+ * 提交一个admin命令并轮询其完成，返回完成项中的状态（0表示成功），超时返回0xFFFF
+ */
+static uint32_t admin_cmd(uint32_t opcode, uint32_t nsid, void * data, uint32_t cdw10, uint32_t cdw11)
+{
+	nvme_sqe_t * sqe = next_sqe(&nvme.admin);
+	nvme_cqe_t cqe;
+
+	sqe->cdw0 = opcode;
+	sqe->nsid = nsid;
+	sqe->prp1 = K_V2P(data);
+	sqe->cdw10 = cdw10;
+	sqe->cdw11 = cdw11;
+	ring_sq(&nvme.admin);
+
+	for(uint32_t i = 0; i < NVME_SPIN_COUNT; i++)
+	{
+		if(pop_cqe(&nvme.admin, &cqe))
+		{
+			ring_cq(&nvme.admin);
+			return cqe.status >> 1;
+		}
+	}
+	return 0xFFFF;
+}
+
+
+/*
+ * 将请求队列中的请求尽可能多地填入I/O submission queue，最后写一次doorbell。调用者需关闭中断。
+ * buf->data位于一个页面之内，所以每个命令只传输一个buf，只使用prp1。
+ */
+static void start_nvme_requests(void)
+{
+	nvme_sqe_t * sqe;
+	buf_t * buf;
+	uint32_t cid, added = 0;
+
+	while(nvme.nfree_cids > 0 && (buf = io_sched_next(&nvme_dev.queue)) != NULL)
+	{
+		if(buf->io_dev != NVME_DEV_NO)
+			PANIC("start_nvme_requests: illegal request");
+
+		cid = nvme.free_cids[--nvme.nfree_cids];
+		nvme.bufs[cid] = buf;
+		sqe = next_sqe(&nvme.io);
+		sqe->cdw0 = ((buf->flags & BUF_DIRTY) ? NVME_CMD_WRITE : NVME_CMD_READ) | (cid << 16);
+		sqe->nsid = 1;
+		sqe->prp1 = K_V2P(buf->data);
+		sqe->cdw10 = buf->io_sector; //起始LBA
+		sqe->cdw11 = 0;
+		sqe->cdw12 = 0; //扇区数减1
+		added++;
+	}
+
+	if(added == 0)
+		return;
+	ring_sq(&nvme.io);
+	nvme.inflight += added;
+	nvme.stats.cmds += added;
+	nvme.stats.doorbells++;
+	if(nvme.inflight > nvme.stats.max_inflight)
+		nvme.stats.max_inflight = nvme.inflight;
+}
+
+
+/*
+ * 处理I/O completion queue中所有新的完成项，并继续提交请求，返回处理的项数。调用者需关闭中断。
+ */
+static uint32_t reap_nvme(void)
+{
+	nvme_cqe_t cqe;
+	buf_t * buf;
+	uint32_t n = 0;
+
+	while(pop_cqe(&nvme.io, &cqe))
+	{
+		buf = cqe.cid < NVME_QUEUE_SIZE ? nvme.bufs[cqe.cid] : NULL;
+		if(buf == NULL)
+			PANIC("reap_nvme: bad command id");
+		if(cqe.status >> 1)
+			PANIC("reap_nvme: maybe a disk error ?");
+
+		nvme.bufs[cqe.cid] = NULL;
+		nvme.free_cids[nvme.nfree_cids++] = cqe.cid;
+		nvme.inflight--;
+		n++;
+
+		/* 此时buf变为VALID且UN-DIRTY的 */
+		complete_blk(buf);
+	}
+
+	if(n == 0)
+		return 0;
+	ring_cq(&nvme.io);
+	if(n > nvme.stats.max_batch)
+		nvme.stats.max_batch = n;
+
+	start_nvme_requests();
+	return n;
+}
+
+
+/*
+ * nvme中断处理
+ */
+static void nvme_handler(trapframe_t * tf)
+{
+	(void)tf;
+	/* 由于CPU处理该中断时自动关闭了中断，所以不再调用pushcli/popcli */
+	/* 中断线可能是共享的，或者完成项已经被轮询处理 */
+	if(reap_nvme() > 0)
+		nvme.stats.irqs++;
+}
+
+
+/*
+ * 将buf加入请求队列并尽可能提交给设备
+ */
+static void nvme_submit(blk_dev_t * bd, buf_t * buf)
+{
+	io_sched_add(&bd->queue, buf);
+	start_nvme_requests();
+}
+
+
+/*
+ * 在nvme.poll_cycles个时钟周期内轮询completion queue，直到buf完成；完成返回1，否则返回0，由调用者等待中断
+ */
+static uint32_t nvme_poll(blk_dev_t * bd, buf_t * buf, uint64_t start)
+{
+	(void)bd;
+	while(rdtsc() - start < nvme.poll_cycles)
+	{
+		if(reap_nvme() > 0 && (buf->flags & (BUF_VALID | BUF_DIRTY)) == BUF_VALID)
+		{
+			nvme.stats.polled++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static const blk_dev_ops_t nvme_ops = {
+	.submit = nvme_submit,
+	.poll = nvme_poll,
+};
+
+
+/*
+ * 初始化队列对q，为sq/cq各分配一个清零的页面，cq中所有项的phase位为0
+ */
+static void init_nvme_queue(nvme_queue_t * q, uint32_t qid, uint32_t size)
+{
+	void * sq, * cq;
+
+	if((sq = alloc_page_noint()) == NULL || (cq = alloc_page_noint()) == NULL)
+		PANIC("init_nvme_queue: alloc page failed");
+	q->sq = sq;
+	q->cq = cq;
+	q->size = size;
+	q->sq_tail = 0;
+	q->cq_head = 0;
+	q->phase = 1;
+	q->qid = qid;
+}
+
+
+/*
+ * 查找NVMe控制器并初始化，成功时将namespace 1注册为NVME_DEV_NO，否则什么也不做
+ */
+void init_nvme(void)
+{
+	pci_addr_t addr;
+	uint32_t bar0, cap_lo, cap_hi, size, i;
+	uint64_t cap;
+	uint8_t * id;
+
+	/* class 0x01 subclass 0x08为非易失性存储控制器，prog if 0x02为NVMe */
+	if(pci_find_class(0x01, 0x08, 0, &addr) < 0 || pci_read_config8(addr, PCI_PROG_IF) != 0x02)
+		return;
+	bar0 = pci_read_config32(addr, PCI_BAR0);
+	/* 只支持4GB以下的寄存器地址 */
+	if((bar0 & PCI_BAR_IO) || (((bar0 >> 1) & 0x3) == 0x2 && pci_read_config32(addr, PCI_BAR0 + 4) != 0))
+		return;
+	nvme.irq = pci_read_config8(addr, PCI_INTERRUPT_LINE);
+	pci_enable(addr, PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+	nvme.regs = map_mmio_noint(bar0 & 0xFFFFFFF0, NVME_MEM_SIZE);
+
+	cap_lo = nvme_read(NVME_REG_CAP);
+	cap_hi = nvme_read(NVME_REG_CAP + 4);
+	cap = cap_lo | ((uint64_t)cap_hi << 32);
+	nvme.dstrd = NVME_CAP_DSTRD(cap);
+	size = NVME_CAP_MQES(cap) < NVME_QUEUE_SIZE ? NVME_CAP_MQES(cap) : NVME_QUEUE_SIZE;
+
+	/* 关闭控制器后设置admin队列，再打开控制器 */
+	nvme_write(NVME_REG_CC, 0);
+	for(i = 0; i < NVME_SPIN_COUNT && (nvme_read(NVME_REG_CSTS) & NVME_CSTS_RDY); i++)
+		;
+	init_nvme_queue(&nvme.admin, 0, NVME_ADMIN_QUEUE_SIZE);
+	nvme_write(NVME_REG_AQA, ((NVME_ADMIN_QUEUE_SIZE - 1) << 16) | (NVME_ADMIN_QUEUE_SIZE - 1));
+	nvme_write(NVME_REG_ASQ, K_V2P(nvme.admin.sq));
+	nvme_write(NVME_REG_ASQ + 4, 0);
+	nvme_write(NVME_REG_ACQ, K_V2P(nvme.admin.cq));
+	nvme_write(NVME_REG_ACQ + 4, 0);
+	nvme_write(NVME_REG_CC, NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES);
+	for(i = 0; i < NVME_SPIN_COUNT && ! (nvme_read(NVME_REG_CSTS) & (NVME_CSTS_RDY | NVME_CSTS_CFS)); i++)
+		;
+	if((nvme_read(NVME_REG_CSTS) & (NVME_CSTS_RDY | NVME_CSTS_CFS)) != NVME_CSTS_RDY)
+		goto fail;
+
+	/* identify namespace 1：NSZE在偏移0处，FLBAS在偏移26处，LBA格式表从偏移128处开始，每项4字节，LBADS在其第2字节 */
+	if((id = alloc_page_noint()) == NULL)
+		PANIC("init_nvme: alloc page failed");
+	if(admin_cmd(NVME_ADMIN_IDENTIFY, 1, id, 0, 0) != 0 || id[128 + (id[26] & 0xF) * 4 + 2] != 9)
+	{
+		free_page_noint(id);
+		goto fail;
+	}
+	nvme.capacity = *(uint64_t *)id;
+	free_page_noint(id);
+
+	/* 创建I/O completion queue（允许中断）和submission queue，qid都为1 */
+	init_nvme_queue(&nvme.io, 1, size);
+	if(admin_cmd(NVME_ADMIN_CREATE_CQ, 0, (void *)nvme.io.cq, ((size - 1) << 16) | 1, 0x3) != 0 ||
+			admin_cmd(NVME_ADMIN_CREATE_SQ, 0, nvme.io.sq, ((size - 1) << 16) | 1, (1 << 16) | 0x1) != 0)
+		goto fail;
+
+	/* submission queue满时tail + 1 == head，所以最多同时提交size - 1个命令 */
+	for(i = 0; i < size - 1; i++)
+		nvme.free_cids[i] = size - 2 - i;
+	nvme.nfree_cids = size - 1;
+	nvme.inflight = 0;
+	nvme.poll_cycles = get_boot_arg_uint("nvme_poll", NVME_POLL_CYCLES);
+
+	init_blk_dev(&nvme_dev, "nvme", &nvme_ops, blk_sched_policy("nvme_sched", IO_SCHED_FIFO),
+			nvme_sched_slots, BUF_MAX_COUNT);
+	nvme_dev.max_sectors = 1;
+	nvme_dev.sectors = nvme.capacity;
+	nvme_dev.queue_depth = size - 1;
+	register_blk_dev(NVME_DEV_NO, &nvme_dev);
+	register_shared_irq_handler(nvme.irq, nvme_handler);
+
+	printk("init_nvme: irq %u, %u sectors, queue %u, poll %u cycles, %s scheduler\n", nvme.irq,
+			(uint32_t)nvme.capacity, size, nvme.poll_cycles, io_sched_policy_name(nvme_dev.queue.policy));
+	return;
+
+fail:
+	printk("init_nvme: controller not responding\n");
+	nvme_write(NVME_REG_CC, 0);
+	nvme.regs = NULL;
+}
+
+
+/*
+ * 获取nvme驱动的统计数据
+ */
+void get_nvme_stats(nvme_stats_t * st)
+{
+	pushcli();
+	*st = nvme.stats;
+	popcli();
+}
+
+
+/* DEBUG */
+void dump_nvme_stats(void)
+{
+	if(nvme.regs == NULL)
+	{
+		printk("nvme: not present\n");
+		return;
+	}
+	printk("nvme: cmds %u doorbells %u irqs %u polled %u max batch %u max inflight %u\n",
+			nvme.stats.cmds, nvme.stats.doorbells, nvme.stats.irqs, nvme.stats.polled,
+			nvme.stats.max_batch, nvme.stats.max_inflight);
+}
@@ -0,0 +1,132 @@
+/*
+ * 本文件提供PCI配置空间的访问函数，使用配置机制#1（0xCF8/0xCFC端口）
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pci.h"
+#include "x86.h"
+
+#define PCI_CONFIG_ADDRESS	0xCF8
+#define PCI_CONFIG_DATA		0xCFC
+
+/* 遍历的总线个数，模拟器中的设备都在前几个总线上 */
+#define PCI_BUS_COUNT		8
+#define PCI_DEV_COUNT		32
+#define PCI_FUNC_COUNT		8
+
+
+/*
+ * 读取配置空间中off处（4字节对齐）的32位值
+ */
+uint32_t pci_read_config32(pci_addr_t addr, uint32_t off)
+{
+	outl(PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)addr.bus << 16) |
+			((uint32_t)addr.dev << 11) | ((uint32_t)addr.func << 8) | (off & 0xFC));
+	return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_read_config16(pci_addr_t addr, uint32_t off)
+{
+	return (uint16_t)(pci_read_config32(addr, off) >> ((off & 2) * 8));
+}
+
+uint8_t pci_read_config8(pci_addr_t addr, uint32_t off)
+{
+	return (uint8_t)(pci_read_config32(addr, off) >> ((off & 3) * 8));
+}
+
+
+/*
+ * 写入配置空间中off处（4字节对齐）的32位值
+ */
+void pci_write_config32(pci_addr_t addr, uint32_t off, uint32_t val)
+{
+	outl(PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)addr.bus << 16) |
+			((uint32_t)addr.dev << 11) | ((uint32_t)addr.func << 8) | (off & 0xFC));
+	outl(PCI_CONFIG_DATA, val);
+}
+
+void pci_write_config16(pci_addr_t addr, uint32_t off, uint16_t val)
+{
+	uint32_t shift = (off & 2) * 8;
+	uint32_t v = pci_read_config32(addr, off);
+
+	v = (v & ~(0xFFFF << shift)) | ((uint32_t)val << shift);
+	pci_write_config32(addr, off, v);
+}
+
+
+/*
+ * 依次遍历所有存在的PCI功能，对每个功能调用match，返回第index个匹配的功能；
+ * 找到返回0且设置*addr，否则返回-1。
+ */
+static int32_t pci_scan(int32_t (* match)(pci_addr_t, uint32_t, uint32_t), uint32_t a, uint32_t b,
+		uint32_t index, pci_addr_t * addr)
+{
+	pci_addr_t pa;
+	uint32_t funcs;
+
+	for(uint32_t bus = 0; bus < PCI_BUS_COUNT; bus++)
+	{
+		for(uint32_t dev = 0; dev < PCI_DEV_COUNT; dev++)
+		{
+			pa.bus = bus;
+			pa.dev = dev;
+			pa.func = 0;
+			if(pci_read_config16(pa, PCI_VENDOR_ID) == 0xFFFF)
+				continue;
+			/* 多功能设备 */
+			funcs = (pci_read_config8(pa, PCI_HEADER_TYPE) & 0x80) ? PCI_FUNC_COUNT : 1;
+			for(uint32_t func = 0; func < funcs; func++)
+			{
+				pa.func = func;
+				if(pci_read_config16(pa, PCI_VENDOR_ID) == 0xFFFF)
+					continue;
+				if(match(pa, a, b) && index-- == 0)
+				{
+					*addr = pa;
+					return 0;
+				}
+			}
+		}
+	}
+	return -1;
+}
+
+static int32_t match_class(pci_addr_t pa, uint32_t class, uint32_t subclass)
+{
+	return pci_read_config8(pa, PCI_CLASS) == class && pci_read_config8(pa, PCI_SUBCLASS) == subclass;
+}
+
+static int32_t match_device(pci_addr_t pa, uint32_t vendor, uint32_t device)
+{
+	return pci_read_config16(pa, PCI_VENDOR_ID) == vendor && pci_read_config16(pa, PCI_DEVICE_ID) == device;
+}
+
+
+/*
+ * 查找第index个类别为class/subclass的设备，找到返回0，否则返回-1
+ */
+int32_t pci_find_class(uint8_t class, uint8_t subclass, uint32_t index, pci_addr_t * addr)
+{
+	return pci_scan(match_class, class, subclass, index, addr);
+}
+
+
+/*
+ * 查找第index个vendor/device的设备，找到返回0，否则返回-1
+ */
+int32_t pci_find_device(uint16_t vendor, uint16_t device, uint32_t index, pci_addr_t * addr)
+{
+	return pci_scan(match_device, vendor, device, index, addr);
+}
+
+
+/*
+ * 在设备的PCI_COMMAND寄存器中设置flags
+ */
+void pci_enable(pci_addr_t addr, uint16_t flags)
+{
+	pci_write_config16(addr, PCI_COMMAND, pci_read_config16(addr, PCI_COMMAND) | flags);
+}
@@ -0,0 +1,152 @@
+/*
+ * 本文件提供一个由两个硬盘组成的RAID-0（条带化）块设备：
+ * 设备上每RAID0_CHUNK_SECTORS个扇区为一个条带，条带依次交替位于两个成员硬盘上，
+ * 因此顺序读写时两个硬盘可以同时工作。它本身没有请求队列，请求被改写为成员硬盘上的扇区后
+ * 直接加入成员硬盘的请求队列，由成员硬盘的驱动完成。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "raid0.h"
+#include "buf_cache.h"
+#include "blk_dev.h"
+#include "io_sched.h"
+#include "multiboot.h"
+#include "process.h"
+#include "parameters.h"
+
+#include "terminal_io.h"
+
+static blk_dev_t raid0_dev;
+/* 两个成员硬盘的设备号 */
+static int32_t raid0_members[2];
+/* 上一个请求所在的条带，用于统计 */
+static uint32_t raid0_last_chunk;
+/* 统计数据 */
+static raid0_stats_t raid0_stats;
+
+
+/*
+ * 将buf对应的扇区映射到成员硬盘上，并提交给该成员的驱动
+ */
+static void raid0_submit(blk_dev_t * bd, buf_t * buf)
+{
+	uint32_t chunk = buf->io_sector / RAID0_CHUNK_SECTORS;
+	uint32_t m = chunk % 2;
+	blk_dev_t * member = get_blk_dev(raid0_members[m]);
+
+	if(buf->io_dev != RAID0_DEV_NO || buf->io_sector >= bd->sectors)
+		PANIC("raid0_submit: illegal request");
+
+	if(chunk != raid0_last_chunk)
+		raid0_stats.chunks++;
+	raid0_last_chunk = chunk;
+	raid0_stats.reqs[m]++;
+
+	/* 成员硬盘上第chunk / 2个条带 */
+	buf->io_dev = raid0_members[m];
+	buf->io_sector = (chunk / 2) * RAID0_CHUNK_SECTORS + buf->io_sector % RAID0_CHUNK_SECTORS;
+	member->ops->submit(member, buf);
+}
+
+
+/*
+ * 同步请求由成员硬盘的驱动轮询
+ */
+static uint32_t raid0_poll(blk_dev_t * bd, buf_t * buf, uint64_t start)
+{
+	blk_dev_t * member = get_blk_dev(buf->io_dev);
+
+	if(member == bd || member->ops->poll == NULL)
+		return 0;
+	return member->ops->poll(member, buf, start);
+}
+
+
+static const blk_dev_ops_t raid0_ops = {
+	.submit = raid0_submit,
+	.poll = raid0_poll,
+};
+
+
+/*
+ * 解析"<dev>,<dev>"形式的成员设备号，成功时返回0，否则返回-1
+ */
+static int32_t parse_raid0_members(const char * s)
+{
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		if(*s < '0' || *s > '9')
+			return -1;
+		raid0_members[i] = 0;
+		while(*s >= '0' && *s <= '9')
+			raid0_members[i] = raid0_members[i] * 10 + (*s++ - '0');
+		if(*s != (i == 0 ? ',' : '\0'))
+			return -1;
+		s++;
+	}
+	return 0;
+}
+
+
+/*
+ * 根据内核命令行参数raid0=<dev>,<dev>将两个已注册的硬盘组成RAID-0设备，注册为RAID0_DEV_NO；
+ * 没有该参数时什么也不做。需在各硬盘驱动初始化之后调用。
+ */
+void init_raid0(void)
+{
+	char arg[16];
+	blk_dev_t * m[2];
+	uint32_t sectors;
+
+	if(get_boot_arg("raid0", arg, sizeof(arg)) <= 0)
+		return;
+	if(parse_raid0_members(arg) < 0 || raid0_members[0] == raid0_members[1])
+	{
+		printk("init_raid0: illegal raid0 `%s'\n", arg);
+		return;
+	}
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		if((m[i] = get_blk_dev(raid0_members[i])) == NULL || raid0_members[i] == RAID0_DEV_NO)
+		{
+			printk("init_raid0: no block device %d\n", raid0_members[i]);
+			return;
+		}
+	}
+
+	/* 每个成员只使用完整的条带，容量以较小的成员为准 */
+	sectors = m[0]->sectors < m[1]->sectors ? m[0]->sectors : m[1]->sectors;
+	sectors -= sectors % RAID0_CHUNK_SECTORS;
+
+	/* 不使用自己的请求队列，slots为空 */
+	init_blk_dev(&raid0_dev, "raid0", &raid0_ops, IO_SCHED_FIFO, NULL, 0);
+	raid0_dev.sectors = sectors * 2;
+	raid0_dev.max_sectors = RAID0_CHUNK_SECTORS;
+	raid0_dev.queue_depth = m[0]->queue_depth + m[1]->queue_depth;
+	register_blk_dev(RAID0_DEV_NO, &raid0_dev);
+	raid0_last_chunk = 0;
+
+	printk("init_raid0: %s + %s, %u sectors, chunk %u sectors\n", m[0]->name, m[1]->name,
+			raid0_dev.sectors, RAID0_CHUNK_SECTORS);
+}
+
+
+/*
+ * 获取RAID-0的统计数据
+ */
+void get_raid0_stats(raid0_stats_t * st)
+{
+	pushcli();
+	*st = raid0_stats;
+	popcli();
+}
+
+
+/* DEBUG */
+void dump_raid0_stats(void)
+{
+	printk("raid0: members %d %d reqs %u %u chunk switches %u\n", raid0_members[0], raid0_members[1],
+			raid0_stats.reqs[0], raid0_stats.reqs[1], raid0_stats.chunks);
+}
@@ -0,0 +1,144 @@
+/*
+ * 本文件提供一个以内存为存储介质的块设备（内存盘），请求在提交时直接用memcpy完成，
+ * 不使用请求队列和中断，可以在不受磁盘速度影响的情况下运行整个文件系统。
+ * 内存盘的内容可以由GRUB加载的第一个模块（如mkfs生成的硬盘映像）提供，此时直接使用模块所在的页面。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "ramdisk.h"
+#include "blk_dev.h"
+#include "buf_cache.h"
+#include "io_sched.h"
+#include "multiboot.h"
+#include "process.h"
+#include "vmm.h"
+#include "string.h"
+#include "parameters.h"
+
+#include "terminal_io.h"
+
+/* 每个页面包含的扇区数 */
+#define RAMDISK_PAGE_SECTORS	(PAGE_SIZE / BUF_SIZE)
+
+static blk_dev_t ramdisk_dev;
+/* 内存盘的各个页面，页面之间不一定连续 */
+static uint8_t * ramdisk_pages[RAMDISK_MAX_PAGES];
+static uint32_t ramdisk_page_count;
+/* 统计数据 */
+static ramdisk_stats_t ramdisk_stats;
+
+
+/*
+ * 在buf->data和内存盘之间复制数据并立即完成请求
+ */
+static void ramdisk_submit(blk_dev_t * bd, buf_t * buf)
+{
+	uint8_t * p;
+
+	if(buf->io_dev != RAMDISK_DEV_NO || buf->io_sector >= bd->sectors)
+		PANIC("ramdisk_submit: illegal request");
+	p = ramdisk_pages[buf->io_sector / RAMDISK_PAGE_SECTORS] + (buf->io_sector % RAMDISK_PAGE_SECTORS) * BUF_SIZE;
+
+	if(buf->flags & BUF_DIRTY)
+	{
+		memcpy(p, buf->data, BUF_SIZE);
+		ramdisk_stats.writes++;
+	}
+	else
+	{
+		memcpy(buf->data, p, BUF_SIZE);
+		ramdisk_stats.reads++;
+	}
+
+	complete_blk(buf);
+}
+
+
+static const blk_dev_ops_t ramdisk_ops = {
+	.submit = ramdisk_submit,
+};
+
+
+/*
+ * 初始化内存盘：大小由内核命令行参数ramdisk=<KB>指定，没有指定时与第一个GRUB模块一样大，ramdisk=0时不使用；
+ * 第一个模块的内容作为内存盘开头的数据，模块按页对齐时直接使用其页面，否则复制。
+ * 其余模块及不使用的模块所占的页面被回收。
+ */
+void init_ramdisk(void)
+{
+	char arg[12];
+	uint32_t start, end, size, npages, mod_pages = 0, has_mod;
+
+	has_mod = get_boot_module(0, &start, &end);
+	for(uint32_t i = 1, s, e; get_boot_module(i, &s, &e); i++)
+		reclaim_module_pages_noint(s, e);
+
+	if(get_boot_arg("ramdisk", arg, sizeof(arg)) > 0)
+		size = get_boot_arg_uint("ramdisk", 0) * 1024;
+	else
+		size = has_mod ? end - start : 0;
+	if(size == 0)
+	{
+		if(has_mod)
+			reclaim_module_pages_noint(start, end);
+		return;
+	}
+
+	if(has_mod && size < end - start)
+		size = end - start;
+	npages = PAGE_UPPER_ALIGN(size) / PAGE_SIZE;
+	if(npages > RAMDISK_MAX_PAGES)
+		PANIC("init_ramdisk: ramdisk too large");
+
+	/* 按页对齐的模块直接作为内存盘开头的页面，最后一页中模块之后的部分清零 */
+	if(has_mod && start == PAGE_DOWN_ALIGN(start))
+	{
+		mod_pages = PAGE_UPPER_ALIGN(end - start) / PAGE_SIZE;
+		for(uint32_t i = 0; i < mod_pages; i++)
+			ramdisk_pages[i] = (uint8_t *)K_P2V(start + i * PAGE_SIZE);
+		memset((void *)K_P2V(end), 0, PAGE_UPPER_ALIGN(end) - end);
+	}
+
+	for(uint32_t i = mod_pages; i < npages; i++)
+	{
+		if((ramdisk_pages[i] = alloc_page_noint()) == NULL)
+			PANIC("init_ramdisk: alloc page failed");
+	}
+	ramdisk_page_count = npages;
+
+	/* 模块没有按页对齐，复制其内容后回收 */
+	if(has_mod && mod_pages == 0)
+	{
+		for(uint32_t off = 0; off < end - start; off += PAGE_SIZE)
+			memcpy(ramdisk_pages[off / PAGE_SIZE], (void *)K_P2V(start + off),
+					end - start - off < PAGE_SIZE ? end - start - off : PAGE_SIZE);
+		reclaim_module_pages_noint(start, end);
+	}
+
+	init_blk_dev(&ramdisk_dev, "ramdisk", &ramdisk_ops, IO_SCHED_FIFO, NULL, 0);
+	ramdisk_dev.sectors = npages * RAMDISK_PAGE_SECTORS;
+	ramdisk_dev.max_sectors = RAMDISK_PAGE_SECTORS;
+	register_blk_dev(RAMDISK_DEV_NO, &ramdisk_dev);
+
+	printk("init_ramdisk: %u KB, %u KB from module\n", npages * PAGE_SIZE / 1024, has_mod ? (end - start) / 1024 : 0);
+}
+
+
+/*
+ * 获取内存盘的统计数据
+ */
+void get_ramdisk_stats(ramdisk_stats_t * st)
+{
+	pushcli();
+	*st = ramdisk_stats;
+	popcli();
+}
+
+
+/* DEBUG */
+void dump_ramdisk_stats(void)
+{
+	printk("ramdisk: %u pages reads %u writes %u\n", ramdisk_page_count, ramdisk_stats.reads, ramdisk_stats.writes);
+}
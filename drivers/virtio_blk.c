@@ -0,0 +1,398 @@
+/*
+ * 本文件提供一个virtio-blk（legacy PCI接口）磁盘驱动程序实现。
+ * 只使用一个virtqueue，多个请求可以同时在设备中处理，一次中断中完成所有已完成的请求。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "virtio_blk.h"
+#include "blk_dev.h"
+#include "buf_cache.h"
+#include "io_sched.h"
+#include "pci.h"
+#include "x86.h"
+#include "idt.h"
+#include "vmm.h"
+#include "process.h"
+#include "string.h"
+#include "parameters.h"
+
+#include "terminal_io.h"
+
+
+/* virtio设备的PCI vendor id，以及legacy virtio-blk的device id */
+#define VIRTIO_PCI_VENDOR	0x1AF4
+#define VIRTIO_PCI_BLK_DEVICE	0x1001
+
+/* legacy virtio PCI寄存器，相对于BAR0给出的I/O基址 */
+#define VIRTIO_PCI_HOST_FEATURES	0x00	//32位，设备支持的特性
+#define VIRTIO_PCI_GUEST_FEATURES	0x04	//32位，驱动使用的特性
+#define VIRTIO_PCI_QUEUE_PFN		0x08	//32位，virtqueue所在的物理页框号
+#define VIRTIO_PCI_QUEUE_NUM		0x0C	//16位，virtqueue的大小
+#define VIRTIO_PCI_QUEUE_SEL		0x0E	//16位，选择virtqueue
+#define VIRTIO_PCI_QUEUE_NOTIFY		0x10	//16位，通知设备virtqueue中有新的请求
+#define VIRTIO_PCI_STATUS		0x12	//8位，设备状态
+#define VIRTIO_PCI_ISR			0x13	//8位，中断状态，读取时清除
+#define VIRTIO_PCI_CONFIG		0x14	//设备相关的配置空间（不使用MSI-X时）
+
+/* some flags in device status register */
+#define VIRTIO_STATUS_ACK		0x01
+#define VIRTIO_STATUS_DRIVER		0x02
+#define VIRTIO_STATUS_DRIVER_OK		0x04
+#define VIRTIO_STATUS_FAILED		0x80
+
+/* virtio-blk的特性位，以及配置空间中的成员偏移 */
+#define VIRTIO_BLK_F_SEG_MAX		(1 << 2)	//配置空间中的seg_max有效
+#define VIRTIO_BLK_CFG_CAPACITY		0x00	//64位，扇区数
+#define VIRTIO_BLK_CFG_SEG_MAX		0x0C	//32位，每个请求最多的数据段数
+
+/* 请求类型及完成状态 */
+#define VIRTIO_BLK_T_IN			0
+#define VIRTIO_BLK_T_OUT		1
+#define VIRTIO_BLK_S_OK			0
+
+/* some flags in virtqueue descriptor */
+#define VRING_DESC_F_NEXT		1
+#define VRING_DESC_F_WRITE		2	//设备写入该段内存
+
+/* 驱动支持的最大virtqueue大小，及其所占用的内存 */
+#define VRING_MAX_SIZE		256
+#define VRING_ALIGN(x)		(((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define VRING_MEM_SIZE		(VRING_ALIGN(16 * VRING_MAX_SIZE + 6 + 2 * VRING_MAX_SIZE) + \
+				VRING_ALIGN(6 + 8 * VRING_MAX_SIZE))
+
+/* 阻止编译器重排对共享内存的访问；x86不会重排写操作之间的顺序 */
+#define vring_barrier()		asm volatile ( "" : : : "memory" )
+
+typedef struct {
+	uint64_t addr; //物理地址
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct {
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[];
+} __attribute__((packed)) vring_avail_t;
+
+typedef struct {
+	uint32_t id; //完成的请求的第一个描述符
+	uint32_t len;
+} __attribute__((packed)) vring_used_elem_t;
+
+typedef struct {
+	uint16_t flags;
+	uint16_t idx;
+	vring_used_elem_t ring[];
+} __attribute__((packed)) vring_used_t;
+
+/* 请求头部，由设备读取 */
+typedef struct {
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t sector;
+} __attribute__((packed)) virtio_blk_hdr_t;
+
+/* 提交给设备的一个请求，包含扇区连续的若干buf */
+typedef struct {
+	virtio_blk_hdr_t hdr;
+	uint8_t status; //由设备写入完成状态
+	uint16_t head; //请求的第一个描述符
+	uint32_t count;
+	buf_t * bufs[VIRTIO_BLK_MAX_SEGS];
+} virtio_blk_req_t;
+
+/* virtqueue所占用的内存，virtqueue要求物理地址连续且按页对齐，所以静态分配 */
+static uint8_t vring_mem[VRING_MEM_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+static struct {
+	uint16_t iobase; //寄存器的I/O基址，为0时表示没有找到设备
+	uint32_t irq;
+	uint32_t size; //virtqueue大小
+	vring_desc_t * desc;
+	volatile vring_avail_t * avail;
+	volatile vring_used_t * used;
+	uint16_t free_head; //空闲描述符链表
+	uint32_t num_free;
+	uint16_t last_used; //下一个要处理的used ring项
+	uint32_t max_segs; //每个请求最多包含的buf数
+	uint64_t capacity;
+	virtio_blk_req_t reqs[VIRTIO_BLK_REQS];
+	uint8_t free_reqs[VIRTIO_BLK_REQS]; //空闲请求的下标构成的栈
+	uint32_t nfree_reqs;
+	uint8_t req_of[VRING_MAX_SIZE]; //以请求的第一个描述符为下标，得到请求的下标
+	virtio_blk_stats_t stats;
+} vblk;
+
+/* 对应的块设备，以及其请求队列使用的存储空间 */
+static blk_dev_t vblk_dev;
+static buf_t * vblk_sched_slots[BUF_MAX_COUNT];
+
+
+/*
+ * 从空闲描述符链表中取出一个描述符，调用者需保证有空闲描述符
+ */
+static uint16_t alloc_desc(void)
+{
+	uint16_t d = vblk.free_head;
+
+	vblk.free_head = vblk.desc[d].next;
+	vblk.num_free--;
+	return d;
+}
+
+
+/*
+ * 释放从head开始的描述符链
+ */
+static void free_desc_chain(uint16_t head)
+{
+	uint16_t d = head;
+
+	while(1)
+	{
+		vblk.num_free++;
+		if( ! (vblk.desc[d].flags & VRING_DESC_F_NEXT))
+			break;
+		d = vblk.desc[d].next;
+	}
+	vblk.desc[d].next = vblk.free_head;
+	vblk.free_head = head;
+}
+
+
+/*
+ * 设置描述符d，并返回d
+ */
+static uint16_t set_desc(uint16_t d, void * addr, uint32_t len, uint16_t flags)
+{
+	vblk.desc[d].addr = K_V2P(addr);
+	vblk.desc[d].len = len;
+	vblk.desc[d].flags = flags;
+	return d;
+}
+
+
+/*
+ * 将请求队列中的请求尽可能多地放入virtqueue，扇区连续的请求合并为一个virtio-blk请求，然后通知设备。
+ * 调用者需关闭中断。
+ */
+static void start_vblk_requests(void)
+{
+	virtio_blk_req_t * req;
+	buf_t * buf;
+	buf_t * b;
+	uint16_t d, prev;
+	uint32_t added = 0;
+	uint32_t inflight;
+
+	/* 每个请求至少需要头部、数据和状态三个描述符 */
+	while(vblk.nfree_reqs > 0 && vblk.num_free >= 3 && (buf = io_sched_next(&vblk_dev.queue)) != NULL)
+	{
+		if(buf->io_dev != VIRTIO_BLK_DEV_NO)
+			PANIC("start_vblk_requests: illegal request");
+
+		req = &vblk.reqs[vblk.free_reqs[--vblk.nfree_reqs]];
+		req->bufs[0] = buf;
+		req->count = 1;
+		while(req->count < vblk.max_segs && vblk.num_free >= req->count + 3 &&
+				(b = io_sched_next_contig(&vblk_dev.queue, req->bufs[req->count - 1])) != NULL)
+			req->bufs[req->count++] = b;
+
+		req->hdr.type = (buf->flags & BUF_DIRTY) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+		req->hdr.reserved = 0;
+		req->hdr.sector = buf->io_sector;
+		req->status = 0xFF;
+
+		/* 头部 -> 各个buf的数据 -> 状态 */
+		req->head = prev = set_desc(alloc_desc(), &req->hdr, sizeof(req->hdr), VRING_DESC_F_NEXT);
+		for(uint32_t i = 0; i < req->count; i++)
+		{
+			d = set_desc(alloc_desc(), req->bufs[i]->data, BUF_SIZE, VRING_DESC_F_NEXT |
+					(req->hdr.type == VIRTIO_BLK_T_IN ? VRING_DESC_F_WRITE : 0));
+			vblk.desc[prev].next = d;
+			prev = d;
+		}
+		d = set_desc(alloc_desc(), &req->status, 1, VRING_DESC_F_WRITE);
+		vblk.desc[prev].next = d;
+		vblk.req_of[req->head] = req - vblk.reqs;
+
+		/* 先填写ring，再更新idx */
+		vblk.avail->ring[(vblk.avail->idx + added) % vblk.size] = req->head;
+		added++;
+		vblk.stats.reqs++;
+		vblk.stats.sectors += req->count;
+	}
+
+	if(added == 0)
+		return;
+	vring_barrier();
+	vblk.avail->idx += added;
+	vring_barrier();
+	outw(vblk.iobase + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+	vblk.stats.kicks++;
+
+	inflight = VIRTIO_BLK_REQS - vblk.nfree_reqs;
+	if(inflight > vblk.stats.max_inflight)
+		vblk.stats.max_inflight = inflight;
+}
+
+
+/*
+ * virtio-blk中断处理，完成used ring中所有已完成的请求
+ */
+static void vblk_handler(trapframe_t * tf)
+{
+	/* 由于CPU处理该中断时自动关闭了中断，所以不再调用pushcli/popcli */
+	virtio_blk_req_t * req;
+	buf_t * buf;
+	uint32_t batch = 0;
+
+	(void)tf;
+	/* 读取ISR同时清除了设备的中断；bit 0表示virtqueue有更新 */
+	if( ! (inb(vblk.iobase + VIRTIO_PCI_ISR) & 0x1))
+		return;
+	vblk.stats.irqs++;
+
+	while(vblk.last_used != vblk.used->idx)
+	{
+		vring_barrier();
+		req = &vblk.reqs[vblk.req_of[vblk.used->ring[vblk.last_used % vblk.size].id]];
+		if(req->status != VIRTIO_BLK_S_OK)
+			PANIC("vblk_handler: maybe a disk error ?");
+
+		for(uint32_t i = 0; i < req->count; i++)
+		{
+			buf = req->bufs[i];
+			/* 此时buf变为VALID且UN-DIRTY的 */
+			complete_blk(buf);
+		}
+
+		free_desc_chain(req->head);
+		vblk.free_reqs[vblk.nfree_reqs++] = req - vblk.reqs;
+		vblk.last_used++;
+		batch++;
+	}
+	if(batch > vblk.stats.max_batch)
+		vblk.stats.max_batch = batch;
+
+	/* 继续提交队列中的请求 */
+	start_vblk_requests();
+}
+
+
+/*
+ * 将buf加入请求队列并尽可能提交给设备
+ */
+static void vblk_submit(blk_dev_t * bd, buf_t * buf)
+{
+	io_sched_add(&bd->queue, buf);
+	start_vblk_requests();
+}
+
+static const blk_dev_ops_t vblk_ops = {
+	.submit = vblk_submit,
+};
+
+
+/*
+ * 查找virtio-blk设备并初始化，找到时注册为VIRTIO_BLK_DEV_NO，否则什么也不做
+ */
+void init_virtio_blk(void)
+{
+	pci_addr_t addr;
+	uint32_t bar0, features;
+	uint8_t * mem = vring_mem;
+
+	if(pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_PCI_BLK_DEVICE, 0, &addr) < 0)
+		return;
+	bar0 = pci_read_config32(addr, PCI_BAR0);
+	if( ! (bar0 & PCI_BAR_IO))
+		return;
+	vblk.iobase = bar0 & 0xFFFC;
+	vblk.irq = pci_read_config8(addr, PCI_INTERRUPT_LINE);
+	pci_enable(addr, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+	/* 复位设备，然后依次设置ACK、DRIVER状态，协商特性 */
+	outb(vblk.iobase + VIRTIO_PCI_STATUS, 0);
+	outb(vblk.iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK);
+	outb(vblk.iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+	features = inl(vblk.iobase + VIRTIO_PCI_HOST_FEATURES) & VIRTIO_BLK_F_SEG_MAX;
+	outl(vblk.iobase + VIRTIO_PCI_GUEST_FEATURES, features);
+
+	vblk.capacity = inl(vblk.iobase + VIRTIO_PCI_CONFIG + VIRTIO_BLK_CFG_CAPACITY) |
+		((uint64_t)inl(vblk.iobase + VIRTIO_PCI_CONFIG + VIRTIO_BLK_CFG_CAPACITY + 4) << 32);
+	vblk.max_segs = VIRTIO_BLK_MAX_SEGS;
+	if(features & VIRTIO_BLK_F_SEG_MAX)
+	{
+		uint32_t seg_max = inl(vblk.iobase + VIRTIO_PCI_CONFIG + VIRTIO_BLK_CFG_SEG_MAX);
+		if(seg_max > 0 && seg_max < vblk.max_segs)
+			vblk.max_segs = seg_max;
+	}
+
+	/* 设置virtqueue 0：描述符表、avail ring、按页对齐的used ring */
+	outw(vblk.iobase + VIRTIO_PCI_QUEUE_SEL, 0);
+	vblk.size = inw(vblk.iobase + VIRTIO_PCI_QUEUE_NUM);
+	if(vblk.size == 0 || vblk.size > VRING_MAX_SIZE)
+	{
+		printk("init_virtio_blk: unsupported queue size %u\n", vblk.size);
+		outb(vblk.iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+		vblk.iobase = 0;
+		return;
+	}
+	memset(mem, 0, VRING_MEM_SIZE);
+	vblk.desc = (vring_desc_t *)mem;
+	vblk.avail = (vring_avail_t *)(mem + 16 * vblk.size);
+	vblk.used = (vring_used_t *)(mem + VRING_ALIGN(16 * vblk.size + 6 + 2 * vblk.size));
+	for(uint32_t i = 0; i < vblk.size; i++)
+		vblk.desc[i].next = i + 1;
+	vblk.free_head = 0;
+	vblk.num_free = vblk.size;
+	vblk.last_used = 0;
+	for(uint32_t i = 0; i < VIRTIO_BLK_REQS; i++)
+		vblk.free_reqs[i] = VIRTIO_BLK_REQS - 1 - i;
+	vblk.nfree_reqs = VIRTIO_BLK_REQS;
+	outl(vblk.iobase + VIRTIO_PCI_QUEUE_PFN, K_V2P(mem) / PAGE_SIZE);
+
+	init_blk_dev(&vblk_dev, "virtio-blk", &vblk_ops, blk_sched_policy("vblk_sched", IO_SCHED_CLOOK),
+			vblk_sched_slots, BUF_MAX_COUNT);
+	vblk_dev.max_sectors = vblk.max_segs;
+	vblk_dev.sectors = vblk.capacity;
+	vblk_dev.queue_depth = VIRTIO_BLK_REQS;
+	register_blk_dev(VIRTIO_BLK_DEV_NO, &vblk_dev);
+
+	register_shared_irq_handler(vblk.irq, vblk_handler);
+	outb(vblk.iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+	printk("init_virtio_blk: io 0x%x irq %u, %u sectors, queue %u, %u segs, %s scheduler\n",
+			vblk.iobase, vblk.irq, (uint32_t)vblk.capacity, vblk.size, vblk.max_segs,
+			io_sched_policy_name(vblk_dev.queue.policy));
+}
+
+
+/*
+ * 获取virtio-blk驱动的统计数据
+ */
+void get_virtio_blk_stats(virtio_blk_stats_t * st)
+{
+	pushcli();
+	*st = vblk.stats;
+	popcli();
+}
+
+
+/* DEBUG */
+void dump_virtio_blk_stats(void)
+{
+	if(vblk.iobase == 0)
+	{
+		printk("virtio-blk: not present\n");
+		return;
+	}
+	printk("virtio-blk: reqs %u sectors %u kicks %u irqs %u max batch %u max inflight %u\n",
+			vblk.stats.reqs, vblk.stats.sectors, vblk.stats.kicks, vblk.stats.irqs,
+			vblk.stats.max_batch, vblk.stats.max_inflight);
+}
@@ -7,64 +7,434 @@
 #include "string.h"
 #include "debug.h"
 #include "buf_cache.h"
+#include "mount.h"
+#include "bitmap.h"
+#include "process.h"
 
 /*
- * 在指定设备上读取super block
+ * 从指定设备上读取super block，挂载时使用；其他情况下应通过get_sb获取内存中的副本
  */
 void read_sb(int32_t dev, super_block_t * sb)
 {
 	buf_t * buf;
 	
-	buf = acquire_buf(dev, 1);
+	/* 超级块被频繁读取，以共享方式持有，多个进程可以同时读取 */
+	buf = acquire_buf_shared(dev, 1);
+	mark_buf_meta(buf);
 	memcpy(sb, buf->data, sizeof(super_block_t));
-	release_buf(buf);
+	release_buf_shared(buf);
+
+	/* 旧格式的文件系统视为只有一个块组 */
+	if(sb->groups == 0)
+	{
+		sb->groups = 1;
+		sb->inodes_per_group = sb->inode_number;
+		sb->blocks_per_group = sb->block_number;
+	}
 }
 
 /*
  * 清空指定设备上文件系统中某个block中的内容
  */
-static void blk_zero(int32_t dev, super_block_t * sbp, uint32_t bnum)
+void blk_zero(int32_t dev, super_block_t * sbp, uint32_t bnum)
 {
 	buf_t * buf;
 	
 	buf = acquire_buf(dev, SNUM_OF_BLOCK(bnum, *sbp));
-	memset(buf->data, 0, sizeof(buf->data));
+	memset(buf->data, 0, BUF_SIZE);
 	write_buf(buf);
 	release_buf(buf);
 }
 
+/* alloc_bit读写位图时使用的块缓冲 */
+typedef struct {
+	int32_t dev;
+	uint32_t start_sector;
+	buf_t * buf;
+} bitmap_io_t;
+
+static uint32_t * get_bitmap_buf(void * ctx, uint32_t k)
+{
+	bitmap_io_t * io = ctx;
+
+	io->buf = acquire_buf(io->dev, io->start_sector + k);
+	mark_buf_meta(io->buf);
+	return (uint32_t *)io->buf->data;
+}
+
+static int32_t put_bitmap_buf(void * ctx, uint32_t k, int32_t dirty)
+{
+	bitmap_io_t * io = ctx;
+
+	(void)k;
+	if(dirty)
+		write_buf(io->buf);
+	release_buf(io->buf);
+	return 0;
+}
+
+/*
+ * 在设备dev上从start_sector开始、共nbits个bit的位图中分配一个为0的bit：
+ * 从第*cursor个bit开始向后查找，到达末尾后回到开头，找到时将其置1并返回其位置，同时将*cursor设为下一个bit；
+ * 没有为0的bit时返回-1。
+ */
+int32_t alloc_bit(int32_t dev, uint32_t start_sector, uint32_t nbits, uint32_t * cursor)
+{
+	bitmap_io_t io = {dev, start_sector, NULL};
+
+	return bitmap_alloc(nbits, cursor, get_bitmap_buf, put_bitmap_buf, &io);
+}
+
 /*
- * 在指定块设备上的文件系统中分配空闲块，清空内容，返回其编号
- * 失败则PANIC
+ * 将设备dev上从start_sector开始的位图中的第bit个bit清0，该bit原本为0时返回-1，否则返回0
  */
-uint32_t alloc_block(int32_t dev)
+int32_t free_bit(int32_t dev, uint32_t start_sector, uint32_t bit)
 {
 	buf_t * buf;
-	super_block_t sb;
-	uint8_t mask;
+	uint32_t * map;
+
+	buf = acquire_buf(dev, start_sector + bit / BITS_PER_BLOCK);
+	mark_buf_meta(buf);
+	map = (uint32_t *)buf->data;
+	bit %= BITS_PER_BLOCK;
+	if( ! bitmap_test(map, bit))
+	{
+		release_buf(buf);
+		return -1;
+	}
+	bitmap_clear(map, bit);
+	write_buf(buf);
+	release_buf(buf);
+	return 0;
+}
 
-	read_sb(dev, &sb);
+/*
+ * 将连续空闲的block[*s, *e)缩小为其中第一段不属于任何预分配窗口的部分，全部属于窗口时*s不小于*e
+ */
+static void skip_reserved(mount_t * mp, uint32_t * s, uint32_t * e)
+{
+	resv_t * r;
+	uint32_t moved;
 
-	for(uint32_t b = 0; b < sb.block_number; b += BITS_PER_BLOCK)
+	pushcli();
+	do
 	{
-		buf = acquire_buf(dev, SNUM_OF_BLK_BITMAP(b, sb));
-		for(uint32_t bi = 0; bi < BITS_PER_BLOCK && b+bi < sb.block_number; bi++)
+		moved = 0;
+		for(uint32_t i = 0; i < FS_PREALLOC_COUNT; i++)
 		{
-			mask = 1 << (bi % 8);
-			if((buf->data[bi / 8] & mask) == 0)
+			r = &mp->resv[i];
+			if(r->len > 0 && r->start <= *s && *s < r->start + r->len)
 			{
-				/* 此时找到了一个空闲bit */
-				buf->data[bi / 8] |= mask;
-				write_buf(buf);
-				release_buf(buf);
-				blk_zero(dev, &sb, b+bi);
-				return (b + bi);
+				*s = r->start + r->len;
+				moved = 1;
 			}
 		}
-		release_buf(buf);
+	} while(moved && *s < *e);
+	for(uint32_t i = 0; i < FS_PREALLOC_COUNT; i++)
+	{
+		r = &mp->resv[i];
+		if(r->len > 0 && *s < r->start && r->start < *e)
+			*e = r->start;
+	}
+	popcli();
+}
+
+/*
+ * 丢弃文件系统中所有的预分配窗口，返回丢弃的窗口数
+ */
+static uint32_t drop_all_reserved(mount_t * mp)
+{
+	uint32_t count = 0;
+
+	pushcli();
+	for(uint32_t i = 0; i < FS_PREALLOC_COUNT; i++)
+	{
+		if(mp->resv[i].len > 0)
+		{
+			mp->resv[i].len = 0;
+			count++;
+		}
+	}
+	popcli();
+	return count;
+}
+
+/*
+ * 在第g个块组中从第from个block（块组内编号）开始查找连续的、不属于预分配窗口的空闲block：
+ * 找到从from开始的（紧接着goal，at_from不为0时）或长度不小于want的一段时返回1；
+ * 否则返回0，此时*start、*len为块组中比调用时的*len更长的最长一段（没有时不变）。
+ * 连续的一段不跨越位图块。
+ */
+static int32_t find_free_run(int32_t dev, mount_t * mp, uint32_t g, uint32_t from, int32_t at_from,
+		uint32_t want, uint32_t * start, uint32_t * len)
+{
+	super_block_t * sb = &mp->sb;
+	uint32_t nbits = GROUP_BLOCKS(g, *sb);
+	uint32_t base = SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb);
+	uint32_t lo, hi, s, e, off;
+	int32_t z;
+	buf_t * buf;
+
+	for(uint32_t k = from / BITS_PER_BLOCK; k * BITS_PER_BLOCK < nbits; k++)
+	{
+		lo = from > k * BITS_PER_BLOCK ? from - k * BITS_PER_BLOCK : 0;
+		hi = nbits - k * BITS_PER_BLOCK < BITS_PER_BLOCK ? nbits - k * BITS_PER_BLOCK : BITS_PER_BLOCK;
+		off = g * sb->blocks_per_group + k * BITS_PER_BLOCK; //该位图块中第0个bit对应的block
+		buf = acquire_buf_shared(dev, base + k);
+		mark_buf_meta(buf);
+		while((z = bitmap_find_zero((uint32_t *)buf->data, lo, hi)) >= 0)
+		{
+			s = (uint32_t)z;
+			if((z = bitmap_find_one((uint32_t *)buf->data, s, hi)) < 0)
+				z = (int32_t)hi;
+			e = (uint32_t)z;
+			/* 跳过预分配窗口，只使用其前面的部分，剩余部分下次循环处理 */
+			s += off;
+			e += off;
+			skip_reserved(mp, &s, &e);
+			if(s >= e)
+			{
+				lo = (uint32_t)z;
+				continue;
+			}
+			s -= off;
+			e -= off;
+			lo = e;
+			if(e - s > *len || (at_from && k * BITS_PER_BLOCK + s == from))
+			{
+				*start = k * BITS_PER_BLOCK + s;
+				*len = e - s;
+			}
+			if(*len >= want || (at_from && *start == from))
+			{
+				release_buf_shared(buf);
+				return 1;
+			}
+		}
+		release_buf_shared(buf);
 	}
+	return 0;
+}
+
+/*
+ * 分配第g个块组中从第start个block（块组内编号）开始的连续空闲block，最多len个；
+ * 返回实际分配的个数，start已经被其他进程分配时返回0。
+ */
+static uint32_t claim_free_run(int32_t dev, mount_t * mp, uint32_t g, uint32_t start, uint32_t len)
+{
+	super_block_t * sb = &mp->sb;
+	uint32_t bit = start % BITS_PER_BLOCK;
+	uint32_t * map;
+	uint32_t n;
+	int32_t e;
+	buf_t * buf;
 
-	PANIC("alloc_block: no free blocks");
+	buf = acquire_buf(dev, SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group + start, *sb));
+	mark_buf_meta(buf);
+	map = (uint32_t *)buf->data;
+	/* 查找之后位图可能已被修改，重新确定连续空闲的长度 */
+	if((e = bitmap_find_one(map, bit, bit + len)) >= 0)
+		len = (uint32_t)e - bit;
+	for(n = 0; n < len; n++)
+		bitmap_set(map, bit + n);
+	if(len > 0)
+		write_buf(buf);
+	release_buf(buf);
+	if(len > 0)
+		adjust_mount_free(mp, g, -(int32_t)len, 0);
+	return len;
+}
+
+/*
+ * 查找并分配连续的空闲块，返回第一块的编号，*got为分配的块数（1到want之间）；失败则PANIC
+ * 优先分配紧接着goal的空闲块；否则从goal所在的块组开始依次查找长度不小于want+extra的一段，
+ * 都没有时分配找到的最长的一段；*found为找到的一段的长度，其中分配的块之后的部分仍然空闲。
+ * 除了预分配窗口之外没有空闲块时丢弃所有预分配窗口。
+ */
+static uint32_t alloc_run(int32_t dev, uint32_t goal, uint32_t want, uint32_t extra, uint32_t * got, uint32_t * found)
+{
+	mount_t * mp = get_mount(dev);
+	super_block_t * sb = &mp->sb;
+	uint32_t first, g, start, len, best_g = 0, best_start = 0, best_len;
+	uint32_t target = want + extra;
+
+	if(want == 0)
+		PANIC("alloc_run: bad block count");
+	if(goal >= sb->block_number)
+		goal = 0;
+	first = GROUP_OF_BLOCK(goal, *sb);
+
+	for(;;)
+	{
+		/* 没有空闲块时不必扫描位图 */
+		if(sb->free_blocks == 0)
+			PANIC("alloc_run: no free blocks");
+
+		best_len = 0;
+		for(uint32_t i = 0; i < sb->groups; i++)
+		{
+			g = (first + i) % sb->groups;
+			if(mp->groups[g].free_blocks == 0)
+				continue;
+			len = 0;
+			if(find_free_run(dev, mp, g, i == 0 ? goal % sb->blocks_per_group : 0, i == 0, target, &start, &len))
+			{
+				best_g = g;
+				best_start = start;
+				best_len = len;
+				break;
+			}
+			if(len > best_len)
+			{
+				best_g = g;
+				best_start = start;
+				best_len = len;
+			}
+		}
+		/* goal所在块组中goal之前的部分最后检查 */
+		if(best_len < target && goal % sb->blocks_per_group != 0 && mp->groups[first].free_blocks > 0)
+		{
+			len = best_len;
+			start = best_start;
+			if(find_free_run(dev, mp, first, 0, 0, target, &start, &len) || len > best_len)
+			{
+				best_g = first;
+				best_start = start;
+				best_len = len;
+			}
+		}
+		if(best_len == 0)
+		{
+			/* 剩余的空闲块都在预分配窗口中 */
+			if(drop_all_reserved(mp) == 0)
+				PANIC("alloc_run: no free blocks");
+			continue;
+		}
+
+		if((*got = claim_free_run(dev, mp, best_g, best_start, best_len < want ? best_len : want)) > 0)
+		{
+			*found = best_len;
+			return best_g * sb->blocks_per_group + best_start;
+		}
+		/* 被其他进程抢先分配，重新查找 */
+	}
+}
+
+/*
+ * 在指定块设备上的文件系统中分配连续的空闲块，不清空内容，返回第一块的编号，*got为分配的块数（1到want之间）；失败则PANIC
+ */
+uint32_t alloc_blocks(int32_t dev, uint32_t goal, uint32_t want, uint32_t * got)
+{
+	uint32_t found;
+
+	return alloc_run(dev, goal, want, 0, got, &found);
+}
+
+/*
+ * 同alloc_blocks，同时尽量在分配的块之后再找extra个空闲块作为i节点inum的预分配窗口，
+ * 对应于分配的块之后的逻辑块；i节点原有的窗口被丢弃。
+ * n为分配的块对应的起始逻辑块号。
+ */
+uint32_t alloc_blocks_prealloc(int32_t dev, uint32_t inum, uint32_t n, uint32_t goal, uint32_t want, uint32_t extra, uint32_t * got)
+{
+	mount_t * mp = get_mount(dev);
+	uint32_t bnum, found;
+	resv_t * r = NULL;
+
+	drop_reserved(dev, inum);
+	bnum = alloc_run(dev, goal, want, extra, got, &found);
+	if(*got < want || found <= *got)
+		return bnum;
+
+	pushcli();
+	for(uint32_t i = 0; i < FS_PREALLOC_COUNT; i++)
+	{
+		if(mp->resv[i].len == 0)
+		{
+			r = &mp->resv[i];
+			break;
+		}
+	}
+	/* 窗口都在使用中时不预分配 */
+	if(r != NULL)
+	{
+		r->inum = inum;
+		r->block = n + *got;
+		r->start = bnum + *got;
+		r->len = found - *got < extra ? found - *got : extra;
+	}
+	popcli();
+	return bnum;
+}
+
+/*
+ * 从i节点inum的预分配窗口中分配对应于第n个逻辑块开始的最多want个块，返回第一块的编号，*got为分配的块数；
+ * 没有对应的窗口或窗口中的块已被占用时返回0。
+ */
+uint32_t take_reserved(int32_t dev, uint32_t inum, uint32_t n, uint32_t want, uint32_t * got)
+{
+	mount_t * mp = get_mount(dev);
+	super_block_t * sb = &mp->sb;
+	uint32_t start = 0, len = 0;
+	resv_t * r;
+
+	/* 先从窗口中取出，再在位图中分配 */
+	pushcli();
+	for(uint32_t i = 0; i < FS_PREALLOC_COUNT; i++)
+	{
+		r = &mp->resv[i];
+		if(r->len > 0 && r->inum == inum && r->block == n)
+		{
+			start = r->start;
+			len = r->len < want ? r->len : want;
+			r->block += len;
+			r->start += len;
+			r->len -= len;
+			break;
+		}
+	}
+	popcli();
+	if(len == 0)
+		return 0;
+
+	*got = claim_free_run(dev, mp, GROUP_OF_BLOCK(start, *sb), start % sb->blocks_per_group, len);
+	if(*got < len)
+	{
+		/* 窗口中的块被其他进程分配了，之后的部分也不再使用 */
+		drop_reserved(dev, inum);
+		if(*got == 0)
+			return 0;
+	}
+	return start;
+}
+
+/*
+ * 丢弃i节点inum的预分配窗口
+ */
+void drop_reserved(int32_t dev, uint32_t inum)
+{
+	mount_t * mp = get_mount(dev);
+
+	pushcli();
+	for(uint32_t i = 0; i < FS_PREALLOC_COUNT; i++)
+	{
+		if(mp->resv[i].len > 0 && mp->resv[i].inum == inum)
+			mp->resv[i].len = 0;
+	}
+	popcli();
+}
+
+/*
+ * 在指定块设备上的文件系统中分配空闲块，清空内容，返回其编号；失败则PANIC
+ * 尽量分配goal或其后最近的空闲块。
+ */
+uint32_t alloc_block(int32_t dev, uint32_t goal)
+{
+	uint32_t b, got;
+
+	b = alloc_blocks(dev, goal, 1, &got);
+	blk_zero(dev, get_sb(dev), b);
+	return b;
 }
 
 /*
@@ -72,23 +442,15 @@ uint32_t alloc_block(int32_t dev)
  */
 void free_block(int32_t dev, uint32_t bnum)
 {
-	buf_t * buf;
-	super_block_t sb;
-	uint8_t mask;
+	mount_t * mp = get_mount(dev);
+	super_block_t * sb = &mp->sb;
+	uint32_t g = GROUP_OF_BLOCK(bnum, *sb);
 
 	/* DEBUG */
 	iprint_log("free_block: start to free dev %d bnum %u\n", dev, bnum);
 
-	read_sb(dev, &sb);
-
-	buf = acquire_buf(dev, SNUM_OF_BLK_BITMAP(bnum, sb));
-
-	bnum = bnum % BITS_PER_BLOCK;
-	mask = 1 << (bnum % 8);
-	if((buf->data[bnum / 8] & mask) == 0)
+	if(bnum >= sb->block_number
+			|| free_bit(dev, SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb), bnum % sb->blocks_per_group) == -1)
 		PANIC("free_block: block bitmap maybe in uncoincident state");
-	buf->data[bnum / 8] &= ~mask;
-
-	write_buf(buf);
-	release_buf(buf);
+	adjust_mount_free(mp, g, 1, 0);
 }
@@ -13,6 +13,7 @@
 #include "parameters.h"
 #include "process.h"
 #include "fcntl.h"
+#include "string.h"
 
 /* 内核维护的打开文件表 */
 file_t open_file_table[OPEN_FILE_NUM];
@@ -33,6 +34,7 @@ file_t * alloc_file(void)
 			open_file_table[i].ip = NULL;
 			open_file_table[i].pipe = NULL;
 			open_file_table[i].type = 0;
+			memset(&open_file_table[i].ra, 0, sizeof(readahead_t));
 			popcli();
 			return &open_file_table[i];
 		}
@@ -99,6 +101,44 @@ file_t * dup_file(file_t * fp)
 	return fp;
 }
 
+/*
+ * 在从off处读取了n个字节之后更新打开文件的预读状态，顺序读取时预读之后的block；
+ * 预读窗口从FS_RA_MIN开始，每次顺序读取加倍，直到FS_RA_MAX；非顺序读取时关闭预读。
+ * 注意：要求调用者提前锁住fp->ip；
+ */
+static void readahead_file(file_t * fp, uint32_t off, uint32_t n)
+{
+	readahead_t * ra = &fp->ra;
+	uint32_t cur; //读取位置所在的block
+	uint32_t first;
+
+	if(off != ra->next_off)
+	{
+		/* 随机读取，重置预读状态 */
+		ra->window = 0;
+		ra->end = 0;
+		ra->next_off = off + n;
+		return;
+	}
+
+	ra->next_off = off + n;
+	ra->seq_reads++;
+	if(ra->window == 0)
+		ra->window = FS_RA_MIN;
+	else if(ra->window < FS_RA_MAX)
+		ra->window = ra->window * 2 > FS_RA_MAX ? FS_RA_MAX : ra->window * 2;
+
+	/* 保持已提交的预读超前读取位置window个block，只提交尚未预读的部分 */
+	cur = (off + n) / BLOCK_SIZE;
+	first = ra->end > cur ? ra->end : cur;
+	if(first < cur + ra->window)
+	{
+		n = prefetch_inode(fp->ip, first, cur + ra->window - first);
+		ra->end = first + n;
+		ra->issued += n;
+	}
+}
+
 /*
  * 在一个打开文件结构上从当前文件偏移处开始读取最多n个字节到buf中，
  * 成功则文件偏移量增加实际读取字节数，并返回实际读取字节数，
@@ -129,7 +169,10 @@ int32_t read_file(file_t * fp, void * buf, uint32_t n)
 	
 			lock_inode(fp->ip);
 			if((ret = read_inode(fp->ip, buf, fp->off, n)) > 0)
+			{
+				readahead_file(fp, fp->off, ret);
 				fp->off += ret;
+			}
 			unlock_inode(fp->ip);
 			return ret;
 		default:
@@ -230,6 +273,8 @@ void dump_file(file_t * fp)
 			print_log(" UNKNOWN, ");
 	}
 	print_log("off: %u\n", fp->off);
+	print_log("  readahead: window %u end %u seq_reads %u issued %u\n",
+			fp->ra.window, fp->ra.end, fp->ra.seq_reads, fp->ra.issued);
 	print_log("  releated inode: ");
 	dump_inode(fp->ip);
 
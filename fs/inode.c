@@ -12,6 +12,8 @@
 #include "stat.h"
 #include "process.h"
 #include "inode.h"
+#include "extent.h"
+#include "mount.h"
 
 /* 字符设备表 */
 chr_dev_opts_t chr_dev_opts_table[CHR_DEV_COUNT];
@@ -19,6 +21,9 @@ chr_dev_opts_t chr_dev_opts_table[CHR_DEV_COUNT];
 /* inode cache */
 static mem_inode_t inode_cache[CACHE_INODE_NUM];
 
+/* 返回a,b中数值最小的那个，用于连续的读取/写入i节点函数 */
+#define MIN(a, b) ((a) > (b) ? (b) : (a))
+
 /*
  * 在inode cache中查找或者新分配一个对应于指定设备上某个i结点的inode结构。
  * 注意：
@@ -62,35 +67,63 @@ mem_inode_t * acquire_inode(int32_t dev, uint32_t inum)
 }
 
 /*
- * 在指定设备的文件系统上分配磁盘i结点，并返回其对应的内存inode的引用，未上锁。
+ * 为父目录parent下新建的类型为type的i节点选择块组：
+ * 目录分散到空闲i节点不少于平均值的块组中空闲block最多的一个，以便为其中的文件留出空间；
+ * 其他i节点放在父目录所在的块组中，该块组没有空闲i节点或block时依次向后查找。
  */
-mem_inode_t * alloc_inode(int32_t dev)
+static uint32_t find_inode_group(mount_t * mp, uint32_t parent, uint16_t type)
 {
-	super_block_t sb;
-	buf_t * buf;
-	uint8_t mask;
-	
-	read_sb(dev, &sb);
-	
-	for(uint32_t b = 0; b < sb.inode_number; b += BITS_PER_BLOCK)
+	super_block_t * sb = &mp->sb;
+	group_info_t * gi = mp->groups;
+	uint32_t first = GROUP_OF_INODE(parent, *sb) % sb->groups;
+	uint32_t g, best = sb->groups, avg;
+
+	if(type == DIR_INODE)
 	{
-		buf = acquire_buf(dev, SNUM_OF_INODE_BITMAP(b, sb));
-		for(uint32_t bi = 0; bi < BITS_PER_BLOCK && b+bi < sb.inode_number; bi++)
+		avg = sb->free_inodes / sb->groups;
+		for(uint32_t i = 0; i < sb->groups; i++)
 		{
-			mask = 1 << (bi % 8);
-			if((buf->data[bi / 8] & mask) == 0)
-			{
-				/* 找到一个空闲bit */
-				buf->data[bi / 8] |= mask;
-				write_buf(buf);
-				release_buf(buf);
-				return acquire_inode(dev, b + bi);
-			}
+			g = (first + i) % sb->groups;
+			if(gi[g].free_inodes == 0 || gi[g].free_inodes < avg)
+				continue;
+			if(best == sb->groups || gi[g].free_blocks > gi[best].free_blocks)
+				best = g;
 		}
-		release_buf(buf);
+		if(best < sb->groups)
+			return best;
+	}
+
+	for(uint32_t i = 0; i < sb->groups; i++)
+	{
+		g = (first + i) % sb->groups;
+		if(gi[g].free_inodes > 0 && gi[g].free_blocks > 0)
+			return g;
+		if(gi[g].free_inodes > 0 && best == sb->groups)
+			best = g;
 	}
+	return best;
+}
+
+/*
+ * 在指定设备的文件系统上为目录parent下新建的类型为type的文件分配磁盘i结点，并返回其对应的内存inode的引用，未上锁。
+ */
+mem_inode_t * alloc_inode(int32_t dev, uint32_t parent, uint16_t type)
+{
+	mount_t * mp = get_mount(dev);
+	super_block_t * sb = &mp->sb;
+	uint32_t g;
+	int32_t inum;
+	
+	/* 没有空闲i节点时不必扫描位图 */
+	if(sb->free_inodes == 0)
+		PANIC("alloc_inode: no free inodes");
 	
-	PANIC("alloc_inode: no free inodes");
+	if((g = find_inode_group(mp, parent, type)) >= sb->groups)
+		PANIC("alloc_inode: no free inodes");
+	if((inum = alloc_bit(dev, SNUM_OF_INODE_BITMAP(g * sb->inodes_per_group, *sb), sb->inodes_per_group, &mp->inode_cursors[g])) < 0)
+		PANIC("alloc_inode: inode bitmap maybe in uncoincident state");
+	adjust_mount_free(mp, g, 0, -1);
+	return acquire_inode(dev, g * sb->inodes_per_group + (uint32_t)inum);
 }
 
 /*
@@ -98,21 +131,22 @@ mem_inode_t * alloc_inode(int32_t dev)
  */
 static void free_inode(int32_t dev, uint32_t inum)
 {
-	buf_t * buf;
-	super_block_t sb;
-	uint8_t mask;
+	mount_t * mp = get_mount(dev);
+	super_block_t * sb = &mp->sb;
+	uint32_t g = GROUP_OF_INODE(inum, *sb);
 	
-	read_sb(dev, &sb);
-	
-	buf = acquire_buf(dev, SNUM_OF_INODE_BITMAP(inum, sb));
-	inum = inum % BITS_PER_BLOCK;
-	mask = 1 << (inum % 8);
-	if((buf->data[inum / 8] & mask) == 0)
+	if(inum >= sb->inode_number
+			|| free_bit(dev, SNUM_OF_INODE_BITMAP(g * sb->inodes_per_group, *sb), inum % sb->inodes_per_group) == -1)
 		PANIC("free_inode: inode bitmap maybe in uncoincident state");
-	buf->data[inum / 8] &= ~mask;
+	adjust_mount_free(mp, g, 0, 1);
+}
 
-	write_buf(buf);
-	release_buf(buf);
+/*
+ * i节点所在块组中的第一个block，作为该i节点还没有数据块时的分配目标
+ */
+static inline uint32_t inode_goal(mem_inode_t * ip, super_block_t * sb)
+{
+	return GROUP_OF_INODE(ip->inum, *sb) * sb->blocks_per_group;
 }
 
 /*
@@ -121,7 +155,7 @@ static void free_inode(int32_t dev, uint32_t inum)
 void lock_inode(mem_inode_t * ip)
 {
 	buf_t * buf;
-	super_block_t sb;
+	super_block_t * sb;
 	disk_inode_t * dip;
 	
 	pushcli();
@@ -139,19 +173,24 @@ void lock_inode(mem_inode_t * ip)
 	if( ! (ip->flags & INODE_VALID))
 	{
 		/* 如果数据和磁盘不一致 */
-		read_sb(ip->dev, &sb);
-		/* 锁上i节点所在的block */
-		buf = acquire_buf(ip->dev, SNUM_OF_INODE(ip->inum, sb));
+		sb = get_sb(ip->dev);
+		/* 以共享方式持有i节点所在的block，同一block中的其他i节点可以同时被读取 */
+		buf = acquire_buf_shared(ip->dev, SNUM_OF_INODE(ip->inum, *sb));
+		mark_buf_meta(buf);
 		/* 复制数据到inode中 */
 		dip = (disk_inode_t *)(buf->data) + ip->inum % INODES_PER_BLOCK;
-		ip->type = dip->type;
+		ip->type = dip->type & INODE_TYPE_MASK;
+		ip->iflags = dip->type & ~INODE_TYPE_MASK;
 		ip->major = dip->major;
 		ip->minor = dip->minor;
 		ip->link_number = dip->link_number;
 		ip->size = dip->size;
 		memmove(ip->addrs, dip->addrs, sizeof(dip->addrs));
 		/* 复制完毕，释放buf */
-		release_buf(buf);
+		release_buf_shared(buf);
+		ip->ecache.len = 0;
+		if((ip->iflags & INODE_EXTENT_FL) && ! ext_check_node(ip->addrs, EXTENT_ROOT_NUMBER))
+			PANIC("lock_inode: bad extent tree root");
 		ip->flags |= INODE_VALID;
 	}
 }
@@ -162,7 +201,7 @@ void lock_inode(mem_inode_t * ip)
  */
 void update_inode(mem_inode_t * ip)
 {
-	super_block_t sb;
+	super_block_t * sb;
 	buf_t * buf;
 	disk_inode_t * dip;
 
@@ -172,11 +211,12 @@ void update_inode(mem_inode_t * ip)
 		PANIC("update_inode: no reference to inode or it's unlocked");
 	
 	/* 定位到要写入的位置 */
-	read_sb(ip->dev, &sb);
-	buf = acquire_buf(ip->dev, SNUM_OF_INODE(ip->inum, sb));
+	sb = get_sb(ip->dev);
+	buf = acquire_buf(ip->dev, SNUM_OF_INODE(ip->inum, *sb));
+	mark_buf_meta(buf);
 	dip = (disk_inode_t *)(buf->data) + ip->inum % INODES_PER_BLOCK;
 	/* 写入 */
-	dip->type = ip->type;
+	dip->type = ip->type | ip->iflags;
 	dip->major = ip->major;
 	dip->minor = ip->minor;
 	dip->link_number = ip->link_number;
@@ -201,12 +241,235 @@ void unlock_inode(mem_inode_t * ip)
 	wakeup(ip); //唤醒在该inode上睡眠的进程
 }
 
+/*
+ * 在extent映射的inode中查找第n个逻辑块对应的数据块号，尚未映射时返回0
+ */
+static uint32_t extent_lookup(mem_inode_t * ip, super_block_t * sb, uint32_t n)
+{
+	void * node = ip->addrs;
+	buf_t * buf = NULL;
+	buf_t * child;
+	extent_t * e;
+	int32_t i;
+	uint32_t bnum = 0;
+
+	/* 先检查最近一次查找到的extent，顺序访问时通常能够命中 */
+	if(ip->ecache.len > 0 && n - ip->ecache.block < ip->ecache.len)
+		return ip->ecache.start + (n - ip->ecache.block);
+
+	/* 从树根向下查找，同时只以共享方式持有一个节点 */
+	while((i = ext_search(node, n)) >= 0 && ext_header(node)->depth > 0)
+	{
+		child = acquire_buf_shared(ip->dev, SNUM_OF_BLOCK(ext_entries(node)[i].start, *sb));
+		mark_buf_meta(child);
+		if(buf != NULL)
+			release_buf_shared(buf);
+		buf = child;
+		node = buf->data;
+		if( ! ext_check_node(node, EXTENT_NODE_NUMBER))
+			PANIC("extent_lookup: bad extent node");
+	}
+
+	if(i >= 0 && ext_header(node)->depth == 0)
+	{
+		e = &ext_entries(node)[i];
+		if(n - e->block < e->len)
+		{
+			ip->ecache = *e;
+			bnum = e->start + (n - e->block);
+		}
+	}
+	if(buf != NULL)
+		release_buf_shared(buf);
+	return bnum;
+}
+
+/*
+ * 为inode中从第n个逻辑块开始的count个尚未映射的逻辑块分配连续的数据块，不清空内容，
+ * 返回第一块的块号，*got为分配的块数（1到count之间）；goal为希望分配的位置。
+ * 从文件末尾追加时先使用预分配窗口；窗口不在n处时丢弃窗口，按文件大小在分配的块之后预留一些空闲块作为新的窗口，
+ * 使追加写入的进程各自得到连续的数据块，不会在磁盘上相互交错。
+ * 窗口只保存在内存中，其中的块在位图中仍为空闲，直到被映射，因此崩溃时不会丢失空闲块。
+ */
+static uint32_t alloc_data_blocks(mem_inode_t * ip, uint32_t n, uint32_t count, uint32_t goal, uint32_t * got)
+{
+	uint32_t bnum, window;
+
+	/* 继续使用预分配窗口 */
+	if((bnum = take_reserved(ip->dev, ip->inum, n, count, got)) != 0)
+		return bnum;
+
+	/* 不是追加写入：只分配需要的块数 */
+	if(n < (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE)
+		return alloc_blocks(ip->dev, goal, count, got);
+
+	window = n < FS_PREALLOC_MIN ? FS_PREALLOC_MIN : MIN(n, FS_PREALLOC_MAX);
+	return alloc_blocks_prealloc(ip->dev, ip->inum, n, goal, count, window, got);
+}
+
+/*
+ * 为extent映射的inode中从第n个逻辑块开始的count个逻辑块（都尚未映射）分配连续的数据块，不清空内容，
+ * 返回第一块的块号，*got为实际映射的块数（1到count之间）。
+ * 新分配的块紧接着前一个或后一个extent时直接延长该extent；否则插入新的extent，
+ * 节点已满时分裂，树根已满时将其中的项移到新节点中并增加树的深度。
+ */
+static uint32_t extent_insert(mem_inode_t * ip, super_block_t * sb, uint32_t n, uint32_t count, uint32_t * got)
+{
+	buf_t * bufs[EXTENT_MAX_DEPTH + 1]; //路径上各节点所在的buf，树根在i节点中，对应NULL
+	void * nodes[EXTENT_MAX_DEPTH + 1];
+	int32_t idx[EXTENT_MAX_DEPTH + 1]; //路径在各索引节点中经过的项
+	uint32_t dirty = 0; //被修改的节点，第d位对应第d层
+	uint32_t depth = ext_header(ip->addrs)->depth;
+	uint32_t d, bnum, nb, block, start, goal, len;
+	uint16_t keep;
+	int32_t i, pos;
+	extent_t * e;
+	buf_t * buf;
+
+	/* 从树根向下找到n所在的叶子节点，途中的节点都BUSY地持有 */
+	nodes[0] = ip->addrs;
+	bufs[0] = NULL;
+	for(d = 0; d < depth; d++)
+	{
+		e = ext_entries(nodes[d]);
+		if((i = ext_search(nodes[d], n)) < 0)
+		{
+			/* n小于所有子树中的逻辑块号，将其放入最左边的子树 */
+			i = 0;
+			e[0].block = n;
+			dirty |= 1 << d;
+		}
+		idx[d] = i;
+		bufs[d + 1] = acquire_buf(ip->dev, SNUM_OF_BLOCK(e[i].start, *sb));
+		mark_buf_meta(bufs[d + 1]);
+		nodes[d + 1] = bufs[d + 1]->data;
+		if( ! ext_check_node(nodes[d + 1], EXTENT_NODE_NUMBER))
+			PANIC("extent_insert: bad extent node");
+	}
+
+	e = ext_entries(nodes[depth]);
+	i = ext_search(nodes[depth], n);
+	/* 尽量使逻辑上相邻的块在磁盘上也相邻 */
+	if(i >= 0)
+		goal = e[i].start + (n - e[i].block);
+	else if(ext_header(nodes[depth])->entries > 0 && e[0].start > e[0].block - n)
+		goal = e[0].start - (e[0].block - n);
+	else
+		goal = inode_goal(ip, sb);
+	bnum = alloc_data_blocks(ip, n, count, goal, got);
+	len = *got;
+	ip->ecache.len = 0;
+
+	if(i >= 0 && e[i].block + e[i].len == n && e[i].start + e[i].len == bnum)
+	{
+		/* 紧接在前一个extent之后 */
+		e[i].len += len;
+		dirty |= 1 << depth;
+		goto out;
+	}
+	if(i + 1 < ext_header(nodes[depth])->entries && e[i + 1].block == n + len && e[i + 1].start == bnum + len)
+	{
+		/* 紧接在后一个extent之前 */
+		e[i + 1].block -= len;
+		e[i + 1].start -= len;
+		e[i + 1].len += len;
+		dirty |= 1 << depth;
+		goto out;
+	}
+
+	/* 插入新的extent，必要时逐层向上分裂 */
+	block = n;
+	start = bnum;
+	pos = i + 1;
+	for(d = depth; ; d--)
+	{
+		if(ext_header(nodes[d])->entries < (d == 0 ? EXTENT_ROOT_NUMBER : EXTENT_NODE_NUMBER))
+		{
+			ext_insert_at(nodes[d], pos, block, start, d == depth ? len : 0);
+			dirty |= 1 << d;
+			break;
+		}
+
+		nb = alloc_block(ip->dev, inode_goal(ip, sb));
+		buf = acquire_buf(ip->dev, SNUM_OF_BLOCK(nb, *sb));
+		mark_buf_meta(buf);
+		ext_init_node(buf->data, EXTENT_NODE_NUMBER, ext_header(nodes[d])->depth);
+
+		if(d == 0)
+		{
+			/* 树根已满：将其中的项移到新节点中，树根只保留指向新节点的一项 */
+			if(depth == EXTENT_MAX_DEPTH)
+				PANIC("extent_insert: extent tree is too deep");
+			ext_copy(nodes[0], buf->data);
+			ext_insert_at(buf->data, pos, block, start, d == depth ? len : 0);
+			ext_header(nodes[0])->entries = 0;
+			ext_header(nodes[0])->depth++;
+			ext_insert_at(nodes[0], 0, ext_entries(buf->data)[0].block, nb, 0);
+			write_buf(buf);
+			release_buf(buf);
+			dirty |= 1;
+			break;
+		}
+
+		/* 节点已满：将后一半的项移到新节点中，再把新节点插入父节点 */
+		ext_split(nodes[d], buf->data);
+		keep = ext_header(nodes[d])->entries;
+		if(pos > keep)
+			ext_insert_at(buf->data, pos - keep, block, start, d == depth ? len : 0);
+		else
+			ext_insert_at(nodes[d], pos, block, start, d == depth ? len : 0);
+		dirty |= 1 << d;
+		block = ext_entries(buf->data)[0].block;
+		start = nb;
+		pos = idx[d - 1] + 1;
+		write_buf(buf);
+		release_buf(buf);
+	}
+
+out:
+	for(d = 1; d <= depth; d++)
+	{
+		if(dirty & (1 << d))
+			write_buf(bufs[d]);
+		release_buf(bufs[d]);
+	}
+	if(dirty & 1)
+		update_inode(ip);
+	return bnum;
+}
+
+/*
+ * 释放extent树节点node中各项映射的数据块；对于索引节点，递归释放其子树以及子节点所在的block
+ */
+static void extent_free(int32_t dev, super_block_t * sb, void * node)
+{
+	extent_t * e = ext_entries(node);
+	buf_t * buf;
+
+	for(uint32_t i = 0; i < ext_header(node)->entries; i++)
+	{
+		if(ext_header(node)->depth == 0)
+		{
+			for(uint32_t b = 0; b < e[i].len; b++)
+				free_block(dev, e[i].start + b);
+			continue;
+		}
+		buf = acquire_buf(dev, SNUM_OF_BLOCK(e[i].start, *sb));
+		mark_buf_meta(buf);
+		if( ! ext_check_node(buf->data, EXTENT_NODE_NUMBER))
+			PANIC("extent_free: bad extent node");
+		extent_free(dev, sb, buf->data);
+		release_buf(buf);
+		free_block(dev, e[i].start);
+	}
+}
+
 /*
  * 释放与inode相关联的所有数据块，包括间接索引块(如果存在)
  */
 void trunc_inode(mem_inode_t * ip)
 {
-	super_block_t sb;
+	super_block_t * sb;
 	buf_t * buf;
 	uint32_t * index;
 
@@ -215,32 +478,53 @@ void trunc_inode(mem_inode_t * ip)
 	if(ip->ref < 1 || !(ip->flags & INODE_BUSY))
 		PANIC("trunc_inode: no reference to inode or it's already unlocked");
 
-	read_sb(ip->dev, &sb);
+	sb = get_sb(ip->dev);
+
+	if(ip->iflags & INODE_EXTENT_FL)
+	{
+		/* 丢弃预分配窗口，释放整棵extent树，然后清空树根 */
+		drop_reserved(ip->dev, ip->inum);
+		extent_free(ip->dev, sb, ip->addrs);
+		ext_init_node(ip->addrs, EXTENT_ROOT_NUMBER, 0);
+		ip->ecache.len = 0;
+		ip->size = 0;
+		update_inode(ip);
+		return;
+	}
+
+	/* 如果存在间接索引块，先提交读请求，在释放直接索引的数据块时同时进行读取 */
+	buf = NULL;
+	if(0 < ip->addrs[DIRECT_BLOCK_NUMBER] && ip->addrs[DIRECT_BLOCK_NUMBER] < sb->block_number)
+		buf = acquire_buf_async(ip->dev, SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], *sb));
+
 	/* 清除有关连的直接索引的数据块 */
 	for(int32_t i = 0; i < DIRECT_BLOCK_NUMBER; i++)
 	{
-		if(0 < ip->addrs[i] && ip->addrs[i] < sb.block_number)
+		if(0 < ip->addrs[i] && ip->addrs[i] < sb->block_number)
 		{
 			free_block(ip->dev, ip->addrs[i]);
 			ip->addrs[i] = NAVL_BLK_NUM;
 		}
 	}
 
-	if(0 < ip->addrs[DIRECT_BLOCK_NUMBER] && ip->addrs[DIRECT_BLOCK_NUMBER] < sb.block_number)
+	if(0 < ip->addrs[DIRECT_BLOCK_NUMBER] && ip->addrs[DIRECT_BLOCK_NUMBER] < sb->block_number)
 	{
 		/* DEBUG */
 		iprint_log("turnc_inode: indirect index block num: %u\n", ip->addrs[DIRECT_BLOCK_NUMBER]);
 
 		/* 存在间接索引块 */
 		
-		/* 读取并锁住间接索引块 */
-		buf = acquire_buf(ip->dev, SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], sb));
+		/* 等待间接索引块读取完成，之前没能提交时则同步读取 */
+		if(buf != NULL)
+			wait_buf(buf);
+		else
+			buf = acquire_buf(ip->dev, SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], *sb));
 		
 		
 
 		/*DEBUG */
 		iprint_log("trunc_inode: has read and lock indirect index block\n");
-		iprint_log("trunc_inode: snum of indirect index block: %u\n", SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], sb));
+		iprint_log("trunc_inode: snum of indirect index block: %u\n", SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], *sb));
 		iprint_log("trunc_inode: dump buf of indirect index block:\n");
 		dump_buf(buf);
 		
@@ -253,7 +537,7 @@ void trunc_inode(mem_inode_t * ip)
 		/* 遍历间接索引块，释放关联的所有数据块 */
 		for(; index < (uint32_t *)(buf->data + BLOCK_SIZE); index++)
 		{
-			if(0 < *index && *index < sb.block_number)
+			if(0 < *index && *index < sb->block_number)
 			{
 				/* DEBUG */
 				iprint_log("trunc_inode: start to free block: %u\n", *index);
@@ -302,6 +586,11 @@ void release_inode(mem_inode_t * ip)
 		/* 保险起见，清空标志 */
 		ip->flags = 0;
 	}
+	else if(ip->ref == 1 && (ip->flags & INODE_VALID) && (ip->iflags & INODE_EXTENT_FL))
+	{
+		/* 最后一个引用，丢弃预分配窗口 */
+		drop_reserved(ip->dev, ip->inum);
+	}
 	ip->ref--;
 
 	popcli();
@@ -321,29 +610,69 @@ mem_inode_t * dup_inode(mem_inode_t * ip)
 	return ip;
 }
 
+/*
+ * 为extent映射的inode中字节范围[off, off+n)涉及的所有尚未映射的block分配数据块，n不为0：
+ * 相邻的未映射block一起分配，尽量为连续的一段，而不是在逐块写入时分别分配；
+ * 新分配的block中只有不会被完全覆盖的才需要清零。
+ */
+static void extent_map_range(mem_inode_t * ip, super_block_t * sb, uint32_t off, uint32_t n)
+{
+	uint32_t end = (off + n - 1) / BLOCK_SIZE + 1;
+	uint32_t eof = (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE; //从此开始的逻辑块都没有映射
+	uint32_t b, k, bnum, got;
+
+	for(b = off / BLOCK_SIZE; b < end; b += got)
+	{
+		got = 1;
+		if(b < eof && extent_lookup(ip, sb, b) != 0)
+			continue;
+		/* 从b开始连续的未映射的逻辑块数 */
+		for(k = 1; b + k < end && (b + k >= eof || extent_lookup(ip, sb, b + k) == 0); k++)
+			;
+		bnum = extent_insert(ip, sb, b, k, &got);
+		for(uint32_t i = 0; i < got; i++)
+		{
+			if((b + i) * BLOCK_SIZE < off || (b + i + 1) * BLOCK_SIZE > off + n)
+				blk_zero(ip->dev, sb, bnum + i);
+		}
+	}
+}
+
 /*
  * 获取inode映射的第n个block对应的扇区编号，如果该位置尚未映射block则新分配一个清零过的block并建立映射关系
  * n从0计算。
+ * extent映射的inode通过extent树查找，否则通过直接索引和间接索引块查找。
  */
 static uint32_t get_inode_map(mem_inode_t * ip, uint32_t n)
 {
-	super_block_t sb;
+	super_block_t * sb;
 	buf_t * buf;
-	uint32_t bnum;
+	uint32_t bnum, got;
 	uint32_t * dp;
 
-	read_sb(ip->dev, &sb);
+	sb = get_sb(ip->dev);
+
+	if(ip->iflags & INODE_EXTENT_FL)
+	{
+		if((bnum = extent_lookup(ip, sb, n)) == 0)
+		{
+			bnum = extent_insert(ip, sb, n, 1, &got);
+			blk_zero(ip->dev, sb, bnum);
+		}
+		return SNUM_OF_BLOCK(bnum, *sb);
+	}
 	
 	if(n < DIRECT_BLOCK_NUMBER)
 	{
 		/* 在直接索引范围内 */
-		if((bnum = ip->addrs[n]) >= sb.block_number || bnum == 0)
+		if((bnum = ip->addrs[n]) >= sb->block_number || bnum == 0)
 		{
-			/* 但是n指定的索引无效 */
-			bnum = ip->addrs[n] = alloc_block(ip->dev);
+			/* 但是n指定的索引无效，尽量紧接着前一个数据块分配 */
+			bnum = n > 0 ? ip->addrs[n - 1] : 0;
+			bnum = ip->addrs[n] = alloc_block(ip->dev, bnum != 0 ? bnum + 1 : inode_goal(ip, sb));
 			update_inode(ip);
 		}
-		return SNUM_OF_BLOCK(bnum, sb);
+		return SNUM_OF_BLOCK(bnum, *sb);
 	}
 
 	n -= DIRECT_BLOCK_NUMBER;
@@ -351,30 +680,101 @@ static uint32_t get_inode_map(mem_inode_t * ip, uint32_t n)
 	if(n < INDIRECT_BLOCK_NUMBER)
 	{
 		/* 在间接索引范围内 */
-		if(ip->addrs[DIRECT_BLOCK_NUMBER] >= sb.block_number || ip->addrs[DIRECT_BLOCK_NUMBER] == 0)
+		if(ip->addrs[DIRECT_BLOCK_NUMBER] >= sb->block_number || ip->addrs[DIRECT_BLOCK_NUMBER] == 0)
 		{
 			/* 但是不存在间接索引块 */
-			ip->addrs[DIRECT_BLOCK_NUMBER] = alloc_block(ip->dev);
+			bnum = ip->addrs[DIRECT_BLOCK_NUMBER - 1];
+			ip->addrs[DIRECT_BLOCK_NUMBER] = alloc_block(ip->dev, bnum != 0 ? bnum + 1 : inode_goal(ip, sb));
 			update_inode(ip);
 		}
 		/* 读取并锁住间接索引块 */
-		buf = acquire_buf(ip->dev, SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], sb));
+		buf = acquire_buf(ip->dev, SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], *sb));
+		mark_buf_meta(buf);
 		dp = (uint32_t *)(buf->data);
-		if((bnum = dp[n]) >= sb.block_number || bnum == 0)
+		if((bnum = dp[n]) >= sb->block_number || bnum == 0)
 		{
-			/* 但n指定的索引无效 */
-			bnum = dp[n] = alloc_block(ip->dev);
+			/* 但n指定的索引无效，尽量紧接着前一个数据块分配 */
+			bnum = n > 0 ? dp[n - 1] : ip->addrs[DIRECT_BLOCK_NUMBER];
+			bnum = dp[n] = alloc_block(ip->dev, bnum + 1);
 			write_buf(buf);
 		}
 		release_buf(buf);
-		return SNUM_OF_BLOCK(bnum, sb);
+		return SNUM_OF_BLOCK(bnum, *sb);
 	}
 
 	PANIC("get_inode_map: n out of range");
 }
 
-/* 返回a,b中数值最小的那个，用于连续的读取/写入i节点函数 */
-#define MIN(a, b) ((a) > (b) ? (b) : (a))
+/*
+ * 获取inode映射的第n个block对应的扇区编号，不分配block；如果该位置尚未映射block或n超出范围则返回0。
+ * n从0计算。
+ */
+static uint32_t lookup_inode_map(mem_inode_t * ip, uint32_t n)
+{
+	super_block_t * sb;
+	buf_t * buf;
+	uint32_t bnum;
+
+	sb = get_sb(ip->dev);
+
+	if(ip->iflags & INODE_EXTENT_FL)
+	{
+		if((bnum = extent_lookup(ip, sb, n)) == 0)
+			return 0;
+		return SNUM_OF_BLOCK(bnum, *sb);
+	}
+
+	if(n < DIRECT_BLOCK_NUMBER)
+	{
+		if((bnum = ip->addrs[n]) >= sb->block_number || bnum == 0)
+			return 0;
+		return SNUM_OF_BLOCK(bnum, *sb);
+	}
+
+	n -= DIRECT_BLOCK_NUMBER;
+
+	if(n < INDIRECT_BLOCK_NUMBER)
+	{
+		if(ip->addrs[DIRECT_BLOCK_NUMBER] >= sb->block_number || ip->addrs[DIRECT_BLOCK_NUMBER] == 0)
+			return 0;
+		buf = acquire_buf_shared(ip->dev, SNUM_OF_BLOCK(ip->addrs[DIRECT_BLOCK_NUMBER], *sb));
+		mark_buf_meta(buf);
+		bnum = ((uint32_t *)(buf->data))[n];
+		release_buf_shared(buf);
+		if(bnum >= sb->block_number || bnum == 0)
+			return 0;
+		return SNUM_OF_BLOCK(bnum, *sb);
+	}
+
+	return 0;
+}
+
+/*
+ * 预读inode中从第first个block开始的最多count个block，不等待读取完成，不超出文件大小。
+ * 返回实际处理的block数，遇到未映射的block或没有可用的buf时提前停止。
+ * 注意：要求调用者提前锁住ip；
+ */
+uint32_t prefetch_inode(mem_inode_t * ip, uint32_t first, uint32_t count)
+{
+	uint32_t i;
+	uint32_t snum;
+
+	if(ip->ref < 1 || !(ip->flags & INODE_BUSY))
+		PANIC("prefetch_inode: not an effective refrence or the inode is unlocked");
+	if(ip->type != FILE_INODE && ip->type != DIR_INODE)
+		return 0;
+
+	for(i = 0; i < count; i++)
+	{
+		if((first + i) * BLOCK_SIZE >= ip->size)
+			break;
+		if((snum = lookup_inode_map(ip, first + i)) == 0)
+			break;
+		if(prefetch_buf(ip->dev, snum) == -1)
+			break;
+	}
+	return i;
+}
 
 /*
  * 从inode的特定偏移处读取指定数量字节到缓存区中，返回实际读取字节数。
@@ -384,7 +784,7 @@ static uint32_t get_inode_map(mem_inode_t * ip, uint32_t n)
  * off: 偏移量
  * n: 读取的字节数
  * 注意：
- * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，最大文件仅为70KB，这里返回值使用有符号类型(为了能返回合适的错误值)，但仍能满足使用，使用时需要注意。
+ * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，间接索引的文件最大仅为70KB，extent映射的文件最大为MAX_EXTENT_FILE_SIZE，这里返回值使用有符号类型(为了能返回合适的错误值)，但仍能满足使用，使用时需要注意。
  * 对于设备的读操作，参照相关设备的说明。
  */
 int32_t read_inode(mem_inode_t * ip, void * dst, uint32_t off, uint32_t n)
@@ -408,13 +808,46 @@ int32_t read_inode(mem_inode_t * ip, void * dst, uint32_t off, uint32_t n)
 	
 	int32_t actual_read_bytes = (int32_t)n; //实际读取的字节数
 	uint32_t m; //本次读取的字节数
-	buf_t * buf;
-	for(; n > 0; n -= m, off += m, dst += m)
+	buf_t * bufs[FS_READ_BATCH];
+	uint32_t snums[FS_READ_BATCH]; //本批各block对应的扇区号，为0表示未映射
+	uint32_t count; //本批处理的block数
+	uint32_t o;
+	while(n > 0)
 	{
-		buf = acquire_buf(ip->dev, get_inode_map(ip, off/BLOCK_SIZE));
-		m = MIN(n, BLOCK_SIZE - off % BLOCK_SIZE);
-		memmove(dst, &buf->data[off % BLOCK_SIZE], m);
-		release_buf(buf);
+		/*
+		 * 先查找本批所有block的映射，查找索引块时可能睡眠，此时还不能持有任何buf，
+		 * 否则多个读进程持有的buf可能占满块缓冲而相互等待；未映射的block（文件空洞）读出为0，不分配block
+		 */
+		for(count = 0, o = off; count < FS_READ_BATCH && o < off + n; count++, o += BLOCK_SIZE - o % BLOCK_SIZE)
+			snums[count] = lookup_inode_map(ip, o/BLOCK_SIZE);
+
+		/* 再按顺序提交读请求，不等待 */
+		for(uint32_t i = 0; i < count; i++)
+		{
+			bufs[i] = NULL;
+			if(snums[i] != 0 && (bufs[i] = acquire_buf_async(ip->dev, snums[i])) == NULL)
+			{
+				/* 没有可用的buf，本批到此为止；一个buf都没有获得时同步等待第一个 */
+				if(i == 0)
+					bufs[i++] = acquire_buf(ip->dev, snums[0]);
+				count = i;
+				break;
+			}
+		}
+
+		/* 再依次等待并复制数据 */
+		for(uint32_t i = 0; i < count; i++, n -= m, off += m, dst += m)
+		{
+			m = MIN(n, BLOCK_SIZE - off % BLOCK_SIZE);
+			if(bufs[i] == NULL)
+			{
+				memset(dst, 0, m);
+				continue;
+			}
+			wait_buf(bufs[i]);
+			memmove(dst, &bufs[i]->data[off % BLOCK_SIZE], m);
+			release_buf(bufs[i]);
+		}
 	}
 	
 	return actual_read_bytes;
@@ -429,7 +862,7 @@ int32_t read_inode(mem_inode_t * ip, void * dst, uint32_t off, uint32_t n)
  * n: 待写入的字节数
  *
  * 注意：
- * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，最大文件仅为70KB，这里返回值使用有符号类型（为能区别错误值），但仍能满足使用，使用时需要注意。
+ * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，间接索引的文件最大仅为70KB，extent映射的文件最大为MAX_EXTENT_FILE_SIZE，这里返回值使用有符号类型（为能区别错误值），但仍能满足使用，使用时需要注意。
  * 对于设备的写操作，参照相关设备的说明。
  */
 int32_t write_inode(mem_inode_t * ip, void * src, uint32_t off, uint32_t n)
@@ -437,6 +870,7 @@ int32_t write_inode(mem_inode_t * ip, void * src, uint32_t off, uint32_t n)
 	buf_t * buf;
 	uint32_t m;
 	int32_t actual_write_bytes;
+	uint32_t max_size;
 
 	if(ip->ref < 1 || !(ip->flags & INODE_BUSY))
 		PANIC("write_inode: not an effective reference or the inode is unlocked");
@@ -450,11 +884,16 @@ int32_t write_inode(mem_inode_t * ip, void * src, uint32_t off, uint32_t n)
 		PANIC("write_inode: write to block device file is not supported");
 	
 	/* 实现写入目录/普通文件 */
-	if(off > MAX_FILE_SIZE || off + n < off)
+	max_size = (ip->iflags & INODE_EXTENT_FL) ? MAX_EXTENT_FILE_SIZE : MAX_FILE_SIZE;
+	if(off > max_size || off + n < off)
 		return -1;
-	if(off + n > MAX_FILE_SIZE)
+	if(off + n > max_size)
 		return -1;
 	
+	/* extent映射的文件先为本次写入涉及的block一起分配数据块，再逐块写入 */
+	if((ip->iflags & INODE_EXTENT_FL) && n > 0)
+		extent_map_range(ip, get_sb(ip->dev), off, n);
+
 	actual_write_bytes = (int32_t)n;
 	for(; n > 0; n -= m, off += m, src += m)
 	{
@@ -536,8 +975,16 @@ void dump_inode(mem_inode_t * ip)
 			ip->minor,
 			ip->link_number,
 			ip->size);
-	for(int32_t i = 0; i < DIRECT_BLOCK_NUMBER + 1; i++)
-		print_log("%u ", ip->addrs[i]);
+	if(ip->iflags & INODE_EXTENT_FL)
+	{
+		extent_t * e = ext_entries(ip->addrs);
+		print_log("EXTENT depth %hu: ", ext_header(ip->addrs)->depth);
+		for(uint32_t i = 0; i < ext_header(ip->addrs)->entries; i++)
+			print_log("[%u %u %u] ", e[i].block, e[i].start, e[i].len);
+	}
+	else
+		for(int32_t i = 0; i < DIRECT_BLOCK_NUMBER + 1; i++)
+			print_log("%u ", ip->addrs[i]);
 
 	print_log("\n");
 
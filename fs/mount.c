@@ -0,0 +1,168 @@
+/*
+ * 挂载层：在内存中保存各设备上文件系统的超级块和空闲计数
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+#include "fs.h"
+#include "mount.h"
+#include "block.h"
+#include "buf_cache.h"
+#include "process.h"
+#include "string.h"
+#include "parameters.h"
+#include "bitmap.h"
+#include "vmm.h"
+
+#include "terminal_io.h"
+
+static mount_t mount_table[BLK_DEV_COUNT];
+
+
+/*
+ * 统计从start_sector开始的位图中前nbits个bit中为0的个数
+ */
+static uint32_t count_free_bits(int32_t dev, uint32_t start_sector, uint32_t nbits)
+{
+	buf_t * buf;
+	uint32_t count = 0;
+
+	for(uint32_t b = 0; b < nbits; b += BITS_PER_BLOCK)
+	{
+		buf = acquire_buf_shared(dev, start_sector + b / BITS_PER_BLOCK);
+		mark_buf_meta(buf);
+		count += bitmap_count_zero((uint32_t *)buf->data, nbits - b < BITS_PER_BLOCK ? nbits - b : BITS_PER_BLOCK);
+		release_buf_shared(buf);
+	}
+	return count;
+}
+
+
+/*
+ * 读入设备dev上的超级块并统计各块组及总的空闲计数；
+ * 磁盘上的空闲计数可能没有写回，这里总是根据位图重新统计。
+ */
+static void mount_fs(int32_t dev, mount_t * mp)
+{
+	super_block_t * sb = &mp->sb;
+	group_info_t * gi;
+
+	read_sb(dev, sb);
+	if(sb->block_number == 0 || sb->inode_number == 0 || sb->groups > MAX_BLOCK_GROUPS
+			|| sb->inodes_per_group * sb->groups != sb->inode_number
+			|| sb->blocks_per_group * (sb->groups - 1) >= sb->block_number)
+		PANIC("mount_fs: bad super block");
+
+	if(mp->groups == NULL && (mp->groups = alloc_page()) == NULL)
+		PANIC("mount_fs: no free page for block groups");
+	if(mp->inode_cursors == NULL && (mp->inode_cursors = alloc_page()) == NULL)
+		PANIC("mount_fs: no free page for block groups");
+
+	sb->free_inodes = sb->free_blocks = 0;
+	for(uint32_t g = 0; g < sb->groups; g++)
+	{
+		gi = &mp->groups[g];
+		mp->inode_cursors[g] = 0;
+		gi->free_inodes = count_free_bits(dev, SNUM_OF_INODE_BITMAP(g * sb->inodes_per_group, *sb), sb->inodes_per_group);
+		gi->free_blocks = count_free_bits(dev, SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb), GROUP_BLOCKS(g, *sb));
+		sb->free_inodes += gi->free_inodes;
+		sb->free_blocks += gi->free_blocks;
+	}
+
+	printk("mount_fs: dev %d, %u groups, %u/%u blocks free, %u/%u inodes free\n",
+			dev, sb->groups, sb->free_blocks, sb->block_number, sb->free_inodes, sb->inode_number);
+}
+
+
+/*
+ * 获取设备dev上文件系统的挂载信息，第一次访问时读入超级块
+ */
+mount_t * get_mount(int32_t dev)
+{
+	mount_t * mp;
+
+	if(dev < 0 || dev >= BLK_DEV_COUNT)
+		PANIC("get_mount: bad device number");
+	mp = &mount_table[dev];
+	if(mp->flags & MOUNT_VALID)
+		return mp;
+
+	pushcli();
+	while(mp->flags & MOUNT_BUSY)
+		sleep(mp);
+	if( ! (mp->flags & MOUNT_VALID))
+	{
+		mp->flags |= MOUNT_BUSY;
+		popcli();
+		mount_fs(dev, mp);
+		pushcli();
+		mp->flags = (mp->flags & ~MOUNT_BUSY) | MOUNT_VALID;
+		wakeup(mp);
+	}
+	popcli();
+	return mp;
+}
+
+
+/*
+ * 在第group个块组中分配/释放block或i节点之后调整空闲计数，blocks/inodes为空闲数的变化量
+ */
+void adjust_mount_free(mount_t * mp, uint32_t group, int32_t blocks, int32_t inodes)
+{
+	pushcli();
+	mp->groups[group].free_blocks += (uint32_t)blocks;
+	mp->groups[group].free_inodes += (uint32_t)inodes;
+	mp->sb.free_blocks += (uint32_t)blocks;
+	mp->sb.free_inodes += (uint32_t)inodes;
+	mp->flags |= MOUNT_DIRTY;
+	popcli();
+}
+
+
+/*
+ * 将设备dev（为-1时表示所有设备）上已改变的空闲计数写入超级块所在的buf，之后随块缓冲一起写回
+ */
+void sync_mount(int32_t dev)
+{
+	mount_t * mp;
+	buf_t * buf;
+	super_block_t * dsb;
+
+	for(int32_t d = 0; d < BLK_DEV_COUNT; d++)
+	{
+		if(dev >= 0 && d != dev)
+			continue;
+		mp = &mount_table[d];
+		if( ! (mp->flags & MOUNT_DIRTY))
+			continue;
+
+		buf = acquire_buf(d, 1);
+		mark_buf_meta(buf);
+		pushcli();
+		mp->flags &= ~MOUNT_DIRTY;
+		dsb = (super_block_t *)(buf->data);
+		dsb->free_inodes = mp->sb.free_inodes;
+		dsb->free_blocks = mp->sb.free_blocks;
+		popcli();
+		write_buf(buf);
+		release_buf(buf);
+	}
+}
+
+
+/*
+ * 获取设备dev上文件系统的信息
+ */
+void statfs_mount(int32_t dev, statfs_t * st)
+{
+	mount_t * mp = get_mount(dev);
+
+	pushcli();
+	st->dev = dev;
+	st->block_size = BLOCK_SIZE;
+	st->blocks = mp->sb.block_number;
+	st->free_blocks = mp->sb.free_blocks;
+	st->inodes = mp->sb.inode_number;
+	st->free_inodes = mp->sb.free_inodes;
+	popcli();
+}
@@ -9,6 +9,7 @@
 #include "path.h"
 #include "string.h"
 #include "inode.h"
+#include "extent.h"
 #include "file.h"
 #include "fcntl.h"
 
@@ -48,7 +49,7 @@ mem_inode_t * create(const char * path, uint16_t type, uint16_t major, uint16_t
 	}
 	
 	/* 需要新分配i节点 */
-	if((ip = alloc_inode(dp->dev)) == NULL)
+	if((ip = alloc_inode(dp->dev, dp->inum, type)) == NULL)
 		PANIC("create: alloc inode failed");
 	lock_inode(ip); //由于该i节点是新分配的，所以同时锁住dp和ip应该不会造成死锁
 	ip->type = type;
@@ -56,7 +57,14 @@ mem_inode_t * create(const char * path, uint16_t type, uint16_t major, uint16_t
 	ip->minor = minor;
 	ip->link_number = 1;
 	ip->size = 0;
+	ip->iflags = 0;
 	memset(ip->addrs, 0, sizeof(ip->addrs));
+	/* 普通文件和目录使用extent映射 */
+	if(type == FILE_INODE || type == DIR_INODE)
+	{
+		ip->iflags = INODE_EXTENT_FL;
+		ext_init_node(ip->addrs, EXTENT_ROOT_NUMBER, 0);
+	}
 	
 	/* 在父目录中添加目录项，必要时增加其引用计数 */
 	add_link(dp, name, ip->inum);
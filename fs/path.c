@@ -10,6 +10,29 @@
 #include "inode.h"
 #include "string.h"
 #include "process.h"
+#include "blk_dev.h"
+#include "multiboot.h"
+
+#include "terminal_io.h"
+
+/* 根文件系统所在设备的设备号 */
+static int32_t root_dev = ROOT_DEV_NO;
+
+
+/*
+ * 根据内核命令行参数root=<设备号>确定根文件系统所在的设备，需在块设备驱动初始化之后调用
+ */
+void init_root_dev(void)
+{
+	int32_t dev = get_boot_arg_uint("root", ROOT_DEV_NO);
+
+	if(get_blk_dev(dev) == NULL)
+	{
+		printk("init_root_dev: no block device %d, use %d\n", dev, ROOT_DEV_NO);
+		dev = ROOT_DEV_NO;
+	}
+	root_dev = dev;
+}
 
 /*
  * 在指定目录文件中查找具有特定名字的目录项，并返回其对应i结点的inode结构指针，该inode结构未被上锁；
@@ -177,7 +200,7 @@ mem_inode_t * resolve_path(const char * path, int32_t stop_at_parent, char * nam
 
 
 	if(path[0] == '/') //如果是绝对路径从/开始解析
-		ip = acquire_inode(ROOT_DEV_NO, ROOT_INUM);
+		ip = acquire_inode(root_dev, ROOT_INUM);
 	else //否则从进程当前工作目录开始解析
 		ip = dup_inode(cpu.cur_proc->cwd);
 	
@@ -13,6 +13,13 @@
 #include "path.h"
 #include "process.h"
 #include "pipe.h"
+#include "buf_cache.h"
+#include "blk_dev.h"
+#include "io_stats.h"
+#include "blk_trace.h"
+#include "mount.h"
+#include "string.h"
+#include "parameters.h"
 
 extern int32_t do_open(const char * path, uint32_t mode);
 extern int32_t do_link(const char * oldpath, const char * newpath);
@@ -356,3 +363,109 @@ bad:
 	return -1;
 }
 
+
+/*
+ * 将块缓冲中所有被修改过的数据写回磁盘
+ * 用户模式返回值：
+ * 	总是返回0；
+ */
+int32_t sys_sync(void)
+{
+	sync_mount(-1);
+	sync_buf_cache(-1);
+	return 0;
+}
+
+/*
+ * 将文件描述符对应文件所在设备上被修改过的数据写回磁盘
+ * 目前以设备为单位写回，包括该文件的数据、i节点以及相关的位图；
+ * 用户模式参数：
+ * 	fd: 目标文件描述符；
+ * 用户模式返回值：
+ * 	成功返回0，失败（如fd对应管道）返回-1；
+ */
+int32_t sys_fsync(void)
+{
+	file_t * fp;
+
+	if(get_fd_arg(0, NULL, &fp) == -1)
+		return -1;
+	if(fp->type != FD_TYPE_INODE)
+		return -1;
+	sync_mount(fp->ip->dev);
+	sync_buf_cache(fp->ip->dev);
+	return 0;
+}
+
+/*
+ * 获取块I/O统计数据：块缓冲的命中情况和acquire_buf的延迟，以及指定块设备的请求数、队列深度和请求延迟
+ * 用户模式参数：
+ * 	dev: 块设备号，为负数时只获取块缓冲的统计，st->dev清零；
+ * 	st: io_stats_t结构指针；
+ * 用户模式返回值：
+ * 	成功返回0，失败（如dev对应的块设备不存在）返回-1；
+ */
+int32_t sys_iostat(void)
+{
+	int32_t dev;
+	io_stats_t * st;
+
+	if(get_int_arg(0, (uint32_t *)&dev) == -1)
+		return -1;
+	if(get_ptr_arg(1, (uint32_t *)&st, sizeof(*st)) == -1)
+		return -1;
+	get_buf_cache_stats(&st->cache);
+	if(dev < 0)
+	{
+		memset(&st->dev, 0, sizeof(st->dev));
+		return 0;
+	}
+	return get_blk_stats(dev, &st->dev);
+}
+
+
+/*
+ * int32_t blktrace(blk_trace_t * recs, uint32_t n, uint32_t * lost);
+ * 从块I/O跟踪缓冲区中取出最多n条记录，*lost为被覆盖而丢失的记录数；
+ * 成功返回取出的记录数，失败返回-1。
+ */
+int32_t sys_blktrace(void)
+{
+	blk_trace_t * recs;
+	uint32_t n;
+	uint32_t * lost;
+
+	if(get_int_arg(1, &n) == -1 || n > BLK_TRACE_COUNT)
+		return -1;
+	if(get_ptr_arg(0, (uint32_t *)&recs, n * sizeof(*recs)) == -1)
+		return -1;
+	if(get_ptr_arg(2, (uint32_t *)&lost, sizeof(*lost)) == -1)
+		return -1;
+	return (int32_t)read_blk_trace(recs, n, lost);
+}
+
+
+/*
+ * 获取文件所在文件系统的信息
+ * 用户模式参数：
+ * 	path: 文件系统中的任意文件；
+ * 	st: 用于保存信息的statfs_t结构；
+ * 用户模式返回值：
+ * 	成功返回0，失败返回-1；
+ */
+int32_t sys_statfs(void)
+{
+	char * path;
+	statfs_t * st;
+	mem_inode_t * ip;
+
+	if(get_str_arg(0, (uint32_t *)&path) <= 0)
+		return -1;
+	if(get_ptr_arg(1, (uint32_t *)&st, sizeof(*st)) == -1)
+		return -1;
+	if((ip = resolve_path(path, 0, NULL)) == NULL)
+		return -1;
+	statfs_mount(ip->dev, st);
+	release_inode(ip);
+	return 0;
+}
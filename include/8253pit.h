@@ -4,4 +4,7 @@
 #include <stdint.h>
 void init_8253pit(uint32_t );
 
+/* 自启动以来的时钟滴答数，在timer_callback中递增，每次递增都会唤醒在&ticks上休眠的进程 */
+extern volatile uint32_t ticks;
+
 #endif
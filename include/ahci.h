@@ -0,0 +1,21 @@
+#ifndef _INCLUDE_AHCI_H_
+#define _INCLUDE_AHCI_H_
+
+#include <stdint.h>
+
+/* ahci驱动统计数据 */
+typedef struct {
+	uint32_t cmds; //提交给硬件的命令数
+	uint32_t sectors; //传输的扇区数
+	uint32_t irqs; //处理的中断数
+	uint32_t max_batch; //一次中断中完成的最多命令数
+	uint32_t max_inflight; //同时在硬件中的最多命令数
+} ahci_stats_t;
+
+void init_ahci(void);
+void get_ahci_stats(ahci_stats_t * st);
+
+/* DEBUG */
+void dump_ahci_stats(void);
+
+#endif //_INCLUDE_AHCI_H_
@@ -0,0 +1,143 @@
+#ifndef _INCLUDE_BITMAP_H_
+#define _INCLUDE_BITMAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fs.h"
+
+/*
+ * 磁盘位图的操作，内核和mkfs_tools共用；
+ * 位图中第i个bit位于第i/8个字节的第i%8位，在小端的x86上也就是第i/32个32位字的第i%32位。
+ * 这里只处理内存中的位图，读写磁盘由调用者通过回调函数完成。
+ */
+
+static inline int32_t bitmap_test(const uint32_t * map, uint32_t i)
+{
+	return (map[i / 32] >> (i % 32)) & 1;
+}
+
+static inline void bitmap_set(uint32_t * map, uint32_t i)
+{
+	map[i / 32] |= (uint32_t)1 << (i % 32);
+}
+
+static inline void bitmap_clear(uint32_t * map, uint32_t i)
+{
+	map[i / 32] &= ~((uint32_t)1 << (i % 32));
+}
+
+
+/*
+ * 在位图的第from到第end-1个bit中查找第一个为0的bit，返回其位置，没有时返回-1；
+ * 每次检查一个32位字，跳过全为1的字，用bsf找出字中第一个为0的bit。
+ */
+static inline int32_t bitmap_find_zero(const uint32_t * map, uint32_t from, uint32_t end)
+{
+	uint32_t w, i;
+
+	for(i = from; i < end; i = (i & ~31u) + 32)
+	{
+		/* 忽略字中位于from之前的bit */
+		w = ~map[i / 32] & (~0u << (i % 32));
+		if(w != 0)
+		{
+			i = (i & ~31u) + (uint32_t)__builtin_ctz(w);
+			return i < end ? (int32_t)i : -1;
+		}
+	}
+	return -1;
+}
+
+/*
+ * 在位图的第from到第end-1个bit中查找第一个为1的bit，返回其位置，没有时返回-1；用于确定连续的0的长度
+ */
+static inline int32_t bitmap_find_one(const uint32_t * map, uint32_t from, uint32_t end)
+{
+	uint32_t w, i;
+
+	for(i = from; i < end; i = (i & ~31u) + 32)
+	{
+		w = map[i / 32] & (~0u << (i % 32));
+		if(w != 0)
+		{
+			i = (i & ~31u) + (uint32_t)__builtin_ctz(w);
+			return i < end ? (int32_t)i : -1;
+		}
+	}
+	return -1;
+}
+
+
+/*
+ * 统计位图前nbits个bit中为0的个数
+ */
+static inline uint32_t bitmap_count_zero(const uint32_t * map, uint32_t nbits)
+{
+	uint32_t count = 0, w;
+
+	for(uint32_t i = 0; i < nbits; i += 32)
+	{
+		w = ~map[i / 32];
+		if(nbits - i < 32)
+			w &= ((uint32_t)1 << (nbits - i)) - 1;
+		/* 并行统计各位中1的个数 */
+		w = w - ((w >> 1) & 0x55555555);
+		w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+		count += (((w + (w >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+	}
+	return count;
+}
+
+
+/*
+ * 读入位图的第k块（每块BITS_PER_BLOCK个bit），返回其在内存中的内容，失败返回NULL；ctx由调用者传入
+ */
+typedef uint32_t * (*bitmap_get_t)(void * ctx, uint32_t k);
+/*
+ * 用完bitmap_get_t读入的第k块，dirty不为0时将其写回，失败返回-1
+ */
+typedef int32_t (*bitmap_put_t)(void * ctx, uint32_t k, int32_t dirty);
+
+/*
+ * 在共nbits个bit、占用若干块的位图中分配一个为0的bit：
+ * 从第*cursor个bit开始向后查找，到达末尾后回到开头，找到时将其置1并返回其位置，同时将*cursor设为下一个bit；
+ * 没有为0的bit或读写出错时返回-1。
+ */
+static inline int32_t bitmap_alloc(uint32_t nbits, uint32_t * cursor, bitmap_get_t get, bitmap_put_t put, void * ctx)
+{
+	uint32_t nblocks = (nbits + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK;
+	uint32_t pos = *cursor < nbits ? *cursor : 0;
+	uint32_t first = pos / BITS_PER_BLOCK;
+	uint32_t k, from, end;
+	uint32_t * map;
+	int32_t bi;
+
+	/* 依次检查从cursor所在的位图块开始的各块，最后回到该块检查cursor之前的部分 */
+	for(uint32_t i = 0; i <= nblocks; i++)
+	{
+		k = (first + i) % nblocks;
+		from = i == 0 ? pos % BITS_PER_BLOCK : 0;
+		if(i == nblocks)
+			end = pos % BITS_PER_BLOCK;
+		else
+			end = nbits - k * BITS_PER_BLOCK < BITS_PER_BLOCK ? nbits - k * BITS_PER_BLOCK : BITS_PER_BLOCK;
+		if(from >= end)
+			continue;
+
+		if((map = get(ctx, k)) == NULL)
+			return -1;
+		if((bi = bitmap_find_zero(map, from, end)) >= 0)
+		{
+			bitmap_set(map, (uint32_t)bi);
+			if(put(ctx, k, 1) == -1)
+				return -1;
+			*cursor = k * BITS_PER_BLOCK + (uint32_t)bi + 1;
+			return (int32_t)(k * BITS_PER_BLOCK + (uint32_t)bi);
+		}
+		if(put(ctx, k, 0) == -1)
+			return -1;
+	}
+	return -1;
+}
+
+#endif //_INCLUDE_BITMAP_H_
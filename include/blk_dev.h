@@ -0,0 +1,49 @@
+#ifndef _INCLUDE_BLK_DEV_H_
+#define _INCLUDE_BLK_DEV_H_
+
+#include <stdint.h>
+#include "buf_cache.h"
+#include "io_sched.h"
+#include "io_stats.h"
+
+struct _blk_dev_t;
+
+/*
+ * 块设备驱动提供的操作，调用时中断已关闭。
+ * 请求完成时驱动调用complete_blk(buf)。
+ */
+typedef struct {
+	/* 请求已加入bd->queue，如果设备空闲则开始处理；不等待请求完成 */
+	void ( * submit)(struct _blk_dev_t * bd, buf_t * buf);
+	/* 可选，请求已提交，在休眠等待buf完成之前调用，可以轮询设备；返回1表示buf已完成 */
+	uint32_t ( * poll)(struct _blk_dev_t * bd, buf_t * buf, uint64_t start);
+	/* 可选，记录一次同步请求的完成延迟（CPU时钟周期数），polled表示是否由poll完成 */
+	void ( * account)(struct _blk_dev_t * bd, uint32_t polled, uint64_t cycles);
+} blk_dev_ops_t;
+
+/* 块设备 */
+typedef struct _blk_dev_t {
+	const char * name;
+	const blk_dev_ops_t * ops;
+	uint32_t max_sectors; //每个命令最多传输的扇区数
+	uint32_t queue_depth; //设备能同时处理的命令数
+	uint32_t sectors; //设备容量（扇区数）
+	io_sched_t queue; //请求队列
+	blk_stats_t stats; //统计数据，由块设备层在提交和完成请求时记录
+	void * priv; //驱动私有数据
+} blk_dev_t;
+
+void init_blk_dev(blk_dev_t * bd, const char * name, const blk_dev_ops_t * ops, uint32_t policy,
+		buf_t ** slots, uint32_t capacity);
+uint32_t blk_sched_policy(const char * arg, uint32_t def);
+void register_blk_dev(int32_t dev, blk_dev_t * bd);
+blk_dev_t * get_blk_dev(int32_t dev);
+void submit_blk(buf_t * buf);
+void sync_blk(buf_t * buf);
+void complete_blk(buf_t * buf);
+int32_t get_blk_stats(int32_t dev, blk_stats_t * st);
+
+/* DEBUG */
+void dump_blk_devs(void);
+
+#endif //_INCLUDE_BLK_DEV_H_
@@ -0,0 +1,34 @@
+#ifndef _INCLUDE_BLK_TRACE_H_
+#define _INCLUDE_BLK_TRACE_H_
+
+#include <stdint.h>
+
+/* 块I/O跟踪记录，内核、用户程序以及主机上的回放工具共用该定义 */
+
+/* 用于blk_trace_t.flags中的标志 */
+#define BLK_TRACE_WRITE		0x1	//写请求
+#define BLK_TRACE_ASYNC		0x2	//没有进程等待的请求，如预读
+#define BLK_TRACE_ACCESS	0x4	//对块缓冲的一次访问（acquire_buf等），而不是提交给设备的请求
+#define BLK_TRACE_HIT		0x8	//访问时数据已经在块缓冲中，无需读取设备
+
+/*
+ * 一条跟踪记录；设备请求在完成时记录，submit/complete为提交/完成时的CPU时钟周期数；
+ * 块缓冲访问在获得buf时记录，submit/complete为开始请求/获得buf的时间。
+ */
+typedef struct {
+	uint32_t sector; //扇区号
+	uint8_t dev; //设备号
+	uint8_t flags;
+	uint16_t pid; //发起请求的进程
+	uint64_t submit;
+	uint64_t complete;
+} blk_trace_t;
+
+struct _buf_t;
+
+void init_blk_trace(void);
+void blk_trace_access(struct _buf_t * buf, uint32_t hit, uint64_t start);
+void blk_trace_complete(struct _buf_t * buf, uint64_t now);
+uint32_t read_blk_trace(blk_trace_t * recs, uint32_t n, uint32_t * lost);
+
+#endif //_INCLUDE_BLK_TRACE_H_
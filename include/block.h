@@ -4,7 +4,14 @@
 #include "fs.h"
 
 void read_sb(int32_t dev, super_block_t * sb);
-uint32_t alloc_block(int32_t dev);
+int32_t alloc_bit(int32_t dev, uint32_t start_sector, uint32_t nbits, uint32_t * cursor);
+int32_t free_bit(int32_t dev, uint32_t start_sector, uint32_t bit);
+uint32_t alloc_block(int32_t dev, uint32_t goal);
+uint32_t alloc_blocks(int32_t dev, uint32_t goal, uint32_t want, uint32_t * got);
+uint32_t alloc_blocks_prealloc(int32_t dev, uint32_t inum, uint32_t n, uint32_t goal, uint32_t want, uint32_t extra, uint32_t * got);
+uint32_t take_reserved(int32_t dev, uint32_t inum, uint32_t n, uint32_t want, uint32_t * got);
+void drop_reserved(int32_t dev, uint32_t inum);
+void blk_zero(int32_t dev, super_block_t * sbp, uint32_t bnum);
 void free_block(int32_t dev, uint32_t bnum);
 
 #endif //_INCLUDE_BLOCK_H_
@@ -2,6 +2,7 @@
 #define _INCLUDE_BUF_CACHE_H_
 
 #include <stdint.h>
+#include "io_stats.h"
 
 /* 为避免buf_cache.h和ide.h交叉引用，将该常量放在该文件中定义 */
 #define IDE_SECTOR_SIZE		512 //ide磁盘上一个扇区字节数
@@ -12,24 +13,61 @@
 #define BUF_BUSY	0x1	//该buf当前被某个进程占用
 #define BUF_VALID	0x2	//该buf中存在有效数据
 #define BUF_DIRTY	0x4	//该buf中的数据被修改过
+#define BUF_META	0x8	//该buf中是元数据，替换时优先保留
+#define BUF_ASYNC	0x10	//该buf的I/O完成后由中断处理程序释放，没有进程等待它
+#define BUF_PREFETCHED	0x20	//该buf由预读读入，尚未被使用
 
+/*
+ * buf头部；数据位于单独的按页分配的数据区中，查找和替换时只访问头部。
+ * 查找和替换用到的成员放在前32字节，提交I/O时才用到的成员放在后面，整个头部占一个cache行。
+ */
 typedef struct _buf_t {
 	int32_t		dev; //设备号，为负数时表示非可用设备，其余表示可用设备
 	uint32_t	sector; //扇区号
 	uint32_t	flags; //buf标志，参考demand_skeleton_analysis.txt
-	uint8_t		data[BUF_SIZE]; //存储对应扇区中的数据
-	struct _buf_t * qnext;	//用于设备请求队列
-	struct _buf_t * prev;	//prev/next用于buf_cache中构建双向链表
+	struct _buf_t * hnext;	//用于buf_cache中按dev/sector构建的散列链表
+	struct _buf_t * prev;	//prev/next用于buf_cache中构建A1in/Am双向链表
 	struct _buf_t * next;
-} buf_t;
+	uint16_t	queue; //buf所在的2Q队列
+	uint16_t	refs; //以共享方式持有该buf的进程数，不为0时buf不能被BUSY地获得或被替换
+	uint32_t	dirty_tick; //buf由干净变为DIRTY时的时钟滴答数，用于判断是否需要写回
+	uint8_t *	data; //存储对应扇区中的数据，BUF_SIZE字节，不跨越页面
+	struct _buf_t * qnext;	//qnext/qprev用于设备请求队列中按到达顺序构建的双向链表
+	struct _buf_t * qprev;
+	uint32_t	qidx;	//在设备请求队列的最小堆中的位置
+	uint32_t	deadline; //请求的最晚处理时间（时钟滴答数）
+	int16_t		io_dev; //请求实际访问的设备号和扇区号，由块设备层设置，经过条带等映射后可能与dev/sector不同
+	uint16_t	io_pid; //提交请求的进程，用于跟踪
+	uint32_t	io_sector;
+	uint32_t	io_start; //提交请求时CPU时钟周期数的低32位，用于统计延迟
+} __attribute__((aligned(64))) buf_t;
+
+/* dev/sector在散列表中对应的桶编号，相邻扇区落在相邻的桶中；bucket_count必须为2的次幂 */
+#define BUF_HASH(dev, sector, bucket_count) \
+	(((uint32_t)(sector) ^ ((uint32_t)(dev) << 7)) & ((bucket_count) - 1))
+
+/* 块缓冲统计buf_cache_stats_t定义在io_stats.h中 */
 
 void init_buf_cache(void);
 buf_t * acquire_buf(int32_t dst_dev, uint32_t dst_sector);
+buf_t * acquire_buf_async(int32_t dst_dev, uint32_t dst_sector);
+void wait_buf(buf_t * buf);
 void write_buf(buf_t * buf);
 void release_buf(buf_t * buf);
+void release_buf_noint(buf_t * buf);
+buf_t * acquire_buf_shared(int32_t dst_dev, uint32_t dst_sector);
+void release_buf_shared(buf_t * buf);
+int32_t prefetch_buf(int32_t dst_dev, uint32_t dst_sector);
+void mark_buf_meta(buf_t * buf);
+void get_buf_cache_stats(buf_cache_stats_t * st);
+uint32_t shrink_buf_cache(uint32_t npages);
+void sync_buf_cache(int32_t dev);
+void start_buf_flusher(void);
 
 /* DEBUG */
 void dump_buf(buf_t * buf);
 void dump_buf_cache(void);
+void dump_buf_cache_stats(void);
+void test_buf_cache_lookup(void);
 
 #endif //_INCLUDE_BUF_CACHE_H_
@@ -0,0 +1,114 @@
+#ifndef _INCLUDE_EXTENT_H_
+#define _INCLUDE_EXTENT_H_
+
+#include <stdint.h>
+#include "fs.h"
+
+/*
+ * extent树节点的操作，内核和mkfs_tools共用；
+ * 这里只处理内存中的一个节点，节点的读写和block的分配由调用者完成。
+ */
+
+static inline extent_header_t * ext_header(void * node)
+{
+	return (extent_header_t *)node;
+}
+
+static inline extent_t * ext_entries(void * node)
+{
+	return (extent_t *)((extent_header_t *)node + 1);
+}
+
+
+/*
+ * 初始化一个空节点，max为能容纳的项数
+ */
+static inline void ext_init_node(void * node, uint16_t max, uint16_t depth)
+{
+	extent_header_t * eh = ext_header(node);
+
+	eh->magic = EXTENT_MAGIC;
+	eh->entries = 0;
+	eh->max = max;
+	eh->depth = depth;
+}
+
+
+/*
+ * 检查节点头部是否有效
+ */
+static inline int32_t ext_check_node(void * node, uint32_t max)
+{
+	extent_header_t * eh = ext_header(node);
+
+	return eh->magic == EXTENT_MAGIC && eh->max <= max && eh->entries <= eh->max && eh->depth <= EXTENT_MAX_DEPTH;
+}
+
+
+/*
+ * 返回节点中最后一个起始逻辑块号不大于block的项的位置，没有这样的项时返回-1
+ */
+static inline int32_t ext_search(void * node, uint32_t block)
+{
+	extent_t * e = ext_entries(node);
+	int32_t lo = 0, hi = (int32_t)ext_header(node)->entries - 1, mid;
+
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if(e[mid].block <= block)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return hi;
+}
+
+
+/*
+ * 在节点的第i个位置插入一项，调用者需保证节点未满
+ */
+static inline void ext_insert_at(void * node, int32_t i, uint32_t block, uint32_t start, uint32_t len)
+{
+	extent_header_t * eh = ext_header(node);
+	extent_t * e = ext_entries(node);
+
+	for(int32_t j = eh->entries; j > i; j--)
+		e[j] = e[j - 1];
+	e[i].block = block;
+	e[i].start = start;
+	e[i].len = len;
+	eh->entries++;
+}
+
+
+/*
+ * 将节点src中后一半的项移动到空节点dst中
+ */
+static inline void ext_split(void * src, void * dst)
+{
+	extent_header_t * sh = ext_header(src);
+	extent_header_t * dh = ext_header(dst);
+	uint16_t keep = sh->entries / 2;
+
+	for(uint16_t i = keep; i < sh->entries; i++)
+		ext_entries(dst)[dh->entries++] = ext_entries(src)[i];
+	sh->entries = keep;
+}
+
+
+/*
+ * 将节点src的所有项复制到空节点dst中，用于树根已满时增加树的深度
+ */
+static inline void ext_copy(void * src, void * dst)
+{
+	extent_header_t * sh = ext_header(src);
+	extent_header_t * dh = ext_header(dst);
+
+	for(uint16_t i = 0; i < sh->entries; i++)
+		ext_entries(dst)[i] = ext_entries(src)[i];
+	dh->entries = sh->entries;
+	dh->depth = sh->depth;
+}
+
+#endif //_INCLUDE_EXTENT_H_
@@ -10,6 +10,15 @@
 #define FD_TYPE_INODE 1
 #define FD_TYPE_PIPE 2
 
+/* 打开文件结构中的顺序预读状态 */
+typedef struct {
+	uint32_t next_off; //上一次读取结束的偏移量，下一次从这里读取时认为是顺序读取
+	uint32_t window; //预读窗口的块数，为0时表示当前不预读
+	uint32_t end; //已提交预读的最后一个block之后的block编号
+	uint32_t seq_reads; //顺序读取的次数
+	uint32_t issued; //累计预读的block数
+} readahead_t;
+
 /* 打开文件结构定义 */
 typedef struct {
 	int32_t type; //所表示资源类型
@@ -18,6 +27,7 @@ typedef struct {
 	uint32_t off; //文件偏移量，针对目录和普通文件
 	mem_inode_t * ip; //所关联的inode
 	pipe_t * pipe; //所关联的pipe对象
+	readahead_t ra; //顺序预读状态，只用于普通文件和目录
 } file_t;
 
 file_t * alloc_file(void);
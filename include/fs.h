@@ -7,13 +7,25 @@
 
 #include <stdint.h>
 
-/* 文件系统超级块结构 */
+/*
+ * 文件系统超级块结构
+ *
+ * 超级块之后是若干个块组，每个块组依次由inode bitmap、block bitmap、磁盘i节点和数据块组成，
+ * 除最后一个块组外大小都相同；最后一个块组的数据块可以少于blocks_per_group。
+ * i节点号和block号都是全局编号，第g个块组包含第g*inodes_per_group个起的i节点和第g*blocks_per_group个起的block。
+ * 旧格式的文件系统没有块组（groups为0），读入超级块时将其视为只有一个块组。
+ */
 typedef struct {
-	uint32_t blks_ibitmap; //disk inode bitmap占用的block数
-	uint32_t blks_bbitmap; //block bitmap占用的block数
-	uint32_t inode_number;	//可用于分配的inode总数，即disk inode bitmap中有效位的个数
-	uint32_t block_number;	//可用于分配的block总数，即block bitmap中有效位的个数
-	uint32_t blks_inode;	//磁盘i节点占用的块数
+	uint32_t blks_ibitmap; //每个块组中disk inode bitmap占用的block数
+	uint32_t blks_bbitmap; //每个块组中block bitmap占用的block数
+	uint32_t inode_number;	//可用于分配的inode总数，即各块组disk inode bitmap中有效位的个数之和
+	uint32_t block_number;	//可用于分配的block总数，即各块组block bitmap中有效位的个数之和
+	uint32_t blks_inode;	//每个块组中磁盘i节点占用的块数
+	uint32_t free_inodes;	//空闲的inode数，挂载时重新统计，sync时写回
+	uint32_t free_blocks;	//空闲的block数，挂载时重新统计，sync时写回
+	uint32_t groups;	//块组数
+	uint32_t inodes_per_group; //每个块组中的inode数，为INODES_PER_BLOCK的倍数
+	uint32_t blocks_per_group; //每个块组中的block数（最后一个块组可能更少）
 } __attribute__((packed)) super_block_t;
 
 /* 磁盘inode类型 */
@@ -22,6 +34,10 @@ typedef struct {
 #define DIR_INODE	3
 #define BLK_DEV_INODE	4
 
+/* 磁盘i节点type成员的低8位为类型，高8位为标志；内存中两者分别保存在type和iflags中 */
+#define INODE_TYPE_MASK		0x00FF
+#define INODE_EXTENT_FL		0x0100	//数据块通过extent树映射，addrs中保存树根
+
 /* block大小，字节单位 */
 #define BLOCK_SIZE	512
 /* inode直接数据块个数 */
@@ -37,33 +53,84 @@ typedef struct {
 	uint16_t minor;
 	uint16_t link_number;	//多少个目录项指向了该inode
 	uint32_t size;		//文件大小，字节单位
-	uint32_t addrs[DIRECT_BLOCK_NUMBER + 1]; //与该inode相关的数据块索引，最后一个作为间接索引
+	uint32_t addrs[DIRECT_BLOCK_NUMBER + 1]; //与该inode相关的数据块索引，最后一个作为间接索引；INODE_EXTENT_FL时为extent树根
 } __attribute__((packed)) disk_inode_t;
 
 /* 每个block(sector)能容纳的磁盘i节点个数 */
 #define INODES_PER_BLOCK	(BLOCK_SIZE/sizeof(disk_inode_t))
 
 
+/* 块组的最大个数，内核在一页中保存各块组的空闲计数 */
+#define MAX_BLOCK_GROUPS	512
+
+/* 一个完整块组占用的sector数 */
+#define GROUP_SECTORS(sb) ((sb).blks_ibitmap + (sb).blks_bbitmap + (sb).blks_inode + (sb).blocks_per_group)
+
+/* 第g个块组的起始sector */
+#define SNUM_OF_GROUP(g, sb) (2 + (g) * GROUP_SECTORS(sb))
+
+/* 第n个block/disk inode所在的块组 */
+#define GROUP_OF_BLOCK(n, sb) ((n) / (sb).blocks_per_group)
+#define GROUP_OF_INODE(n, sb) ((n) / (sb).inodes_per_group)
+
+/* 第g个块组中的block数 */
+#define GROUP_BLOCKS(g, sb) ((g) + 1 < (sb).groups ? (sb).blocks_per_group : (sb).block_number - (g) * (sb).blocks_per_group)
+
 /* 第n个block对应的sector号，sb为超级块变量 */
-#define SNUM_OF_BLOCK(n, sb) (2 + (sb).blks_bbitmap + (sb).blks_ibitmap + (sb).blks_inode + (n))
+#define SNUM_OF_BLOCK(n, sb) (SNUM_OF_GROUP(GROUP_OF_BLOCK(n, sb), sb) + \
+		(sb).blks_ibitmap + (sb).blks_bbitmap + (sb).blks_inode + (n) % (sb).blocks_per_group)
 
 /* 第n个disk inode所在的sector */
-#define SNUM_OF_INODE(n, sb) (2 + (sb).blks_bbitmap + (sb).blks_ibitmap + (n)/INODES_PER_BLOCK)
+#define SNUM_OF_INODE(n, sb) (SNUM_OF_GROUP(GROUP_OF_INODE(n, sb), sb) + \
+		(sb).blks_ibitmap + (sb).blks_bbitmap + (n) % (sb).inodes_per_group / INODES_PER_BLOCK)
 
 /* 每一个block(sector)的bit数 */
 #define BITS_PER_BLOCK		(BLOCK_SIZE*8)
 
-/* block bitmap中包含bit n的block的sector num */
-#define SNUM_OF_BLK_BITMAP(n, sb) (2 + (sb).blks_ibitmap + (n)/BITS_PER_BLOCK)
-
-/* disk inode bitmap中包含bit n的block的sector num */
-#define SNUM_OF_INODE_BITMAP(n, sb) (2 + (n)/BITS_PER_BLOCK)
+/*
+ * block bitmap/disk inode bitmap中包含bit n的block的sector num；
+ * 在该sector中对应的是第(n % blocks_per_group) % BITS_PER_BLOCK（或inodes_per_group）个bit
+ */
+#define SNUM_OF_BLK_BITMAP(n, sb) (SNUM_OF_GROUP(GROUP_OF_BLOCK(n, sb), sb) + \
+		(sb).blks_ibitmap + (n) % (sb).blocks_per_group / BITS_PER_BLOCK)
+#define SNUM_OF_INODE_BITMAP(n, sb) (SNUM_OF_GROUP(GROUP_OF_INODE(n, sb), sb) + \
+		(n) % (sb).inodes_per_group / BITS_PER_BLOCK)
 
 /* 0号block不可用，构建文件系统时会预置该位；便于初始化disk_inode_t.addrs成员 */
 #define NAVL_BLK_NUM	0
 
 /* 最大文件大小，字节单位 */
 #define MAX_FILE_SIZE	(12*512 + 512/sizeof(uint32_t)*512)
+/* extent映射的文件的最大大小，受限于read_inode/write_inode的返回值类型 */
+#define MAX_EXTENT_FILE_SIZE	0x7FFFFFFF
+
+
+/*
+ * extent树：每个节点由一个头部和若干项组成，树根位于磁盘i节点的addrs中，其余节点各占一个block。
+ * 叶子节点的项将从block开始的len个逻辑块映射到从start开始的连续数据块；
+ * 索引节点的项中start为子节点所在的数据块，block为子树中最小的逻辑块号，len不使用。
+ * 节点中的项按block升序排列。
+ */
+#define EXTENT_MAGIC	0xF30A
+
+typedef struct {
+	uint16_t magic;
+	uint16_t entries; //有效的项数
+	uint16_t max; //能容纳的项数
+	uint16_t depth; //到叶子节点的层数，叶子节点为0
+} __attribute__((packed)) extent_header_t;
+
+typedef struct {
+	uint32_t block; //起始逻辑块号
+	uint32_t start; //起始数据块号，或子节点所在的数据块
+	uint32_t len; //块数
+} __attribute__((packed)) extent_t;
+
+/* 树根/其他节点能容纳的项数 */
+#define EXTENT_ROOT_NUMBER	((sizeof(uint32_t) * (DIRECT_BLOCK_NUMBER + 1) - sizeof(extent_header_t)) / sizeof(extent_t))
+#define EXTENT_NODE_NUMBER	((BLOCK_SIZE - sizeof(extent_header_t)) / sizeof(extent_t))
+/* extent树的最大深度，足以映射MAX_EXTENT_FILE_SIZE */
+#define EXTENT_MAX_DEPTH	4
 
 /* i节点结构的使用状态 */
 #define INODE_BUSY	0x1	//表示已经被某个进程锁住
@@ -81,8 +148,11 @@ typedef struct {
 	uint16_t major;		//当inode指代设备时，使用major/minor指定何种设备
 	uint16_t minor;
 	uint16_t link_number;	//多少个目录项指向了该inode
+	uint16_t iflags;	//磁盘i节点type成员中的标志
 	uint32_t size;		//文件大小，字节单位
-	uint32_t addrs[DIRECT_BLOCK_NUMBER + 1]; //与该inode相关的数据块索引，最后一个作为间接索引
+	uint32_t addrs[DIRECT_BLOCK_NUMBER + 1]; //与该inode相关的数据块索引，最后一个作为间接索引；INODE_EXTENT_FL时为extent树根
+
+	extent_t ecache; //最近一次查找到的extent，len为0时无效
 	
 } mem_inode_t;
 
@@ -3,7 +3,30 @@
 
 #include "buf_cache.h"
 
+/* 同步请求的完成延迟（CPU时钟周期数） */
+typedef struct {
+	uint32_t count; //完成的请求数
+	uint64_t total; //延迟之和
+	uint64_t max; //最大延迟
+} ide_lat_t;
+
+/* ide驱动统计数据 */
+typedef struct {
+	uint32_t cmds; //提交给硬件的命令数
+	uint32_t dma; //其中以DMA方式传输的命令数
+	uint32_t sectors; //传输的扇区数
+	uint32_t merged; //被合并到前一个请求的命令中的扇区数
+	uint32_t irqs; //处理的中断数
+	uint32_t stale_irqs; //到达时命令已由轮询完成的中断数
+	uint32_t poll_timeouts; //轮询超时后改为等待中断的请求数
+	ide_lat_t lat_poll; //通过轮询完成的同步请求
+	ide_lat_t lat_intr; //通过中断完成的同步请求
+} ide_stats_t;
+
 void init_ide(void);
-void sync_ide(buf_t * buf);
+void get_ide_stats(ide_stats_t * st);
+
+/* DEBUG */
+void dump_ide_stats(void);
 
 #endif //_INCLUDE_IDE_H_
@@ -96,6 +96,7 @@ extern void idt_flush(idt_ptr_t *);
 
 void init_idt(void);
 void register_interrupt_handler(uint8_t int_vertor, interrupt_handler_t interrupt_handler);
+void register_shared_irq_handler(uint8_t IRline, interrupt_handler_t interrupt_handler);
 
 
 
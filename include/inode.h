@@ -17,7 +17,7 @@ extern chr_dev_opts_t chr_dev_opts_table[CHR_DEV_COUNT];
 
 mem_inode_t * acquire_inode(int32_t dev, uint32_t inum);
 
-mem_inode_t * alloc_inode(int32_t dev);
+mem_inode_t * alloc_inode(int32_t dev, uint32_t parent, uint16_t type);
 
 void lock_inode(mem_inode_t * ip);
 
@@ -33,6 +33,8 @@ mem_inode_t * dup_inode(mem_inode_t * ip);
 
 int32_t read_inode(mem_inode_t * ip, void * dst, uint32_t off, uint32_t n);
 
+uint32_t prefetch_inode(mem_inode_t * ip, uint32_t first, uint32_t count);
+
 int32_t write_inode(mem_inode_t * ip, void * src, uint32_t off, uint32_t n);
 
 void stat_inode(mem_inode_t * ip, stat_t * st);
@@ -0,0 +1,50 @@
+#ifndef _INCLUDE_IO_SCHED_H_
+#define _INCLUDE_IO_SCHED_H_
+
+#include <stdint.h>
+#include "buf_cache.h"
+
+/* 请求按buf_t.io_dev/io_sector调度 */
+
+/* 调度策略 */
+#define IO_SCHED_FIFO	0	//按到达顺序处理
+#define IO_SCHED_CLOOK	1	//按扇区号单向扫描，到达最大扇区号后回到最小的扇区号，带有超时保护
+
+/* 请求在最小堆中时，buf_t.qidx最高位表示所在的堆，其余位为在堆中的位置 */
+#define IO_SCHED_HEAP_BIT	0x80000000
+
+/* 调度器统计数据 */
+typedef struct {
+	uint32_t dispatched; //取出的请求数
+	uint32_t merged; //作为相邻扇区被合并取出的请求数
+	uint32_t expired; //因超时而被优先处理的请求数
+	uint32_t sweeps; //C-LOOK从头开始扫描的次数
+} io_sched_stats_t;
+
+/*
+ * 设备请求队列；
+ * 所有请求都按到达顺序挂在读/写两个FIFO链表上（FIFO策略只使用第一个）；
+ * C-LOOK策略下请求还位于两个按扇区号排序的最小堆中：heap[cur]为本次扫描中扇区号不小于pos的请求，
+ * 另一个为下一次扫描的请求；两个堆共用slots，一个从前向后，一个从后向前存放。
+ */
+typedef struct {
+	uint32_t policy;
+	buf_t ** slots; //堆的存储空间，由调用者提供
+	uint32_t capacity; //slots能容纳的请求数
+	uint32_t heap_count[2];
+	uint32_t cur; //本次扫描使用的堆
+	uint32_t pos; //上一个按扇区号取出的请求的扇区号
+	buf_t * fifo_head[2]; //读/写请求的FIFO链表
+	buf_t * fifo_tail[2];
+	uint32_t count; //队列中的请求数
+	io_sched_stats_t stats;
+} io_sched_t;
+
+void io_sched_init(io_sched_t * q, uint32_t policy, buf_t ** slots, uint32_t capacity);
+int32_t io_sched_policy(const char * name);
+const char * io_sched_policy_name(uint32_t policy);
+void io_sched_add(io_sched_t * q, buf_t * buf);
+buf_t * io_sched_next(io_sched_t * q);
+buf_t * io_sched_next_contig(io_sched_t * q, buf_t * prev);
+
+#endif //_INCLUDE_IO_SCHED_H_
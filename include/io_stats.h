@@ -0,0 +1,62 @@
+#ifndef _INCLUDE_IO_STATS_H_
+#define _INCLUDE_IO_STATS_H_
+
+#include <stdint.h>
+
+/* 块I/O统计数据，可以通过iostat系统调用被用户进程检索 */
+
+/* 延迟直方图的项数：第i项为延迟（CPU时钟周期数）在[2^i, 2^(i+1))之内的次数，第0项还包括延迟为0的次数 */
+#define IO_LAT_BUCKETS	32
+
+/* 对数刻度的延迟直方图 */
+typedef struct {
+	uint32_t count; //记录的次数
+	uint64_t total; //延迟之和
+	uint32_t buckets[IO_LAT_BUCKETS];
+} io_lat_hist_t;
+
+/* 块缓冲统计 */
+typedef struct {
+	uint32_t hits; //acquire_buf时dev/sector已经被cache的次数
+	uint32_t misses; //acquire_buf时需要替换buf的次数
+	uint32_t ghost_hits; //未命中但在A1out中，直接放入Am的次数
+	uint32_t a1in_count; //当前A1in中buf的个数
+	uint32_t am_count; //当前Am中buf的个数
+	uint32_t ra_issued; //提交的预读请求个数
+	uint32_t ra_hits; //预读的buf之后被acquire_buf命中的次数
+	uint32_t shared; //acquire_buf_shared直接共享已cache的buf的次数
+	io_lat_hist_t lat_hit; //acquire_buf返回时数据已经VALID（无需等待磁盘）的延迟
+	io_lat_hist_t lat_miss; //acquire_buf需要等待磁盘读取的延迟
+} buf_cache_stats_t;
+
+/* 块设备统计，0为读，1为写 */
+typedef struct {
+	uint32_t reqs[2]; //完成的请求（扇区）数
+	uint32_t inflight; //已提交给驱动尚未完成的请求数
+	uint32_t max_inflight; //inflight的最大值
+	uint32_t submits; //提交的请求数
+	uint64_t depth_total; //每次提交时（包括该请求）的inflight之和，除以submits为平均队列深度
+	io_lat_hist_t lat[2]; //请求从提交到完成的延迟
+} blk_stats_t;
+
+/* iostat系统调用返回的数据 */
+typedef struct {
+	buf_cache_stats_t cache;
+	blk_stats_t dev; //指定设备的统计
+} io_stats_t;
+
+/*
+ * 将一次延迟记录到直方图中
+ */
+static inline void io_lat_add(io_lat_hist_t * h, uint32_t cycles)
+{
+	uint32_t i = 0;
+
+	while(i < IO_LAT_BUCKETS - 1 && (cycles >> (i + 1)) != 0)
+		i++;
+	h->buckets[i]++;
+	h->count++;
+	h->total += cycles;
+}
+
+#endif //_INCLUDE_IO_STATS_H_
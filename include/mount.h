@@ -0,0 +1,56 @@
+#ifndef _INCLUDE_MOUNT_H_
+#define _INCLUDE_MOUNT_H_
+
+#include <stdint.h>
+#include "fs.h"
+#include "stat.h"
+#include "parameters.h"
+
+/* mount_t.flags */
+#define MOUNT_VALID	0x1	//超级块已经读入，空闲计数已经统计
+#define MOUNT_BUSY	0x2	//正在读入超级块、统计空闲计数
+#define MOUNT_DIRTY	0x4	//空闲计数已改变，尚未写回磁盘
+
+/* 块组的空闲计数，只保存在内存中，挂载时统计 */
+typedef struct {
+	uint32_t free_blocks;
+	uint32_t free_inodes;
+} group_info_t;
+
+/*
+ * 预分配窗口：为追加写入的文件预留的连续空闲block，只保存在内存中，位图中仍为空闲，
+ * 分配block时跳过其他文件的窗口；文件从第block个逻辑块继续追加时才真正分配。
+ */
+typedef struct {
+	uint32_t inum; //所属的i节点
+	uint32_t block; //窗口对应的起始逻辑块号
+	uint32_t start; //起始block
+	uint32_t len; //块数，为0时该项未使用
+} resv_t;
+
+/*
+ * 已挂载的文件系统，每个块设备一项；
+ * 超级块在第一次访问设备上的文件系统时读入并常驻内存，其中的空闲计数在分配/释放时更新，sync时写回。
+ */
+typedef struct {
+	uint32_t flags;
+	super_block_t sb;
+	group_info_t * groups; //各块组的空闲计数，占用一页
+	uint32_t * inode_cursors; //各块组中下一次分配i节点时开始查找的位置（块组内编号），占用一页
+	resv_t resv[FS_PREALLOC_COUNT]; //预分配窗口
+} mount_t;
+
+mount_t * get_mount(int32_t dev);
+void adjust_mount_free(mount_t * mp, uint32_t group, int32_t blocks, int32_t inodes);
+void sync_mount(int32_t dev);
+void statfs_mount(int32_t dev, statfs_t * st);
+
+/*
+ * 获取设备dev上文件系统的超级块副本
+ */
+static inline super_block_t * get_sb(int32_t dev)
+{
+	return &get_mount(dev)->sb;
+}
+
+#endif //_INCLUDE_MOUNT_H_
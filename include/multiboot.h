@@ -59,6 +59,10 @@ typedef struct{
 
 }__attribute__((packed)) multiboot_info_t;
 
+/* bits in flags member */
+#define MULTIBOOT_INFO_CMDLINE		0x00000004
+#define MULTIBOOT_INFO_MODS		0x00000008
+
 /* All other value for type member indicates reserved memory region.
  * Note: I assume the 'type' member occupies 4 bytes, but this is not specifed in Multiboot spec 0.6.96 */
 #define MULTIBOOT_MEMORY_AVAILABLE              1
@@ -76,11 +80,24 @@ typedef struct{
 	uint32_t type;
 }__attribute__((packed)) mmap_entry_t;
 
+/* Struct definition for boot module list */
+typedef struct{
+	uint32_t mod_start;
+	uint32_t mod_end;
+	uint32_t string;
+	uint32_t reserved;
+}__attribute__((packed)) module_entry_t;
+
 /* This variable is defined in init.c and is externed to any where this header file is included */
 extern multiboot_info_t * glb_mbi;
 
 
 void show_memory_map(void);
 int32_t mem_validate(uint32_t paddr);
+void init_boot_args(void);
+int32_t get_boot_arg(const char * name, char * value, uint32_t size);
+uint32_t get_boot_arg_uint(const char * name, uint32_t def);
+uint32_t get_boot_module(uint32_t index, uint32_t * start, uint32_t * end);
+int32_t in_boot_module(uint32_t paddr);
 
 #endif  //_INCLUDE_MULTIBOOT_H_
@@ -0,0 +1,22 @@
+#ifndef _INCLUDE_NVME_H_
+#define _INCLUDE_NVME_H_
+
+#include <stdint.h>
+
+/* nvme驱动统计数据 */
+typedef struct {
+	uint32_t cmds; //提交的I/O命令数
+	uint32_t doorbells; //写submission queue doorbell的次数
+	uint32_t irqs; //处理的中断数
+	uint32_t polled; //通过轮询完成的命令数
+	uint32_t max_batch; //一次处理的最多完成项数
+	uint32_t max_inflight; //同时在设备中的最多命令数
+} nvme_stats_t;
+
+void init_nvme(void);
+void get_nvme_stats(nvme_stats_t * st);
+
+/* DEBUG */
+void dump_nvme_stats(void);
+
+#endif //_INCLUDE_NVME_H_
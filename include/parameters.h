@@ -41,8 +41,95 @@ extern uint8_t kernel_start_addr[], kernel_end_addr[];
 /* 进程内核栈 */
 #define PROC_KERNEL_STACK_SIZE	PAGE_SIZE
 
-/* 块缓冲中块的数量 */
-#define BUF_COUNT	20
+/* 块缓冲中块的最少/最多数量，实际数量在启动时根据空闲内存确定 */
+#define BUF_MIN_COUNT	20
+#define BUF_MAX_COUNT	4096
+
+/* 块缓冲最多占用启动时空闲内存的1/BUF_MEM_RATIO */
+#define BUF_MEM_RATIO	8
+
+/* 2Q替换策略中A1in最多占buf总数的1/BUF_A1IN_RATIO，A1out最多记录的dev/sector个数 */
+#define BUF_A1IN_RATIO	4
+#define BUF_GHOST_COUNT	(BUF_MAX_COUNT / 2)
+
+/* 块缓冲散列表中桶的个数，必须为2的次幂 */
+#define BUF_HASH_SIZE	1024
+
+/* 块缓冲写回线程每隔BUF_FLUSH_INTERVAL个时钟滴答运行一次，
+ * 写回DIRTY时间超过BUF_DIRTY_EXPIRE个时钟滴答的buf（时钟频率为50Hz） */
+#define BUF_FLUSH_INTERVAL	250
+#define BUF_DIRTY_EXPIRE	1500
+
+/* read_inode一次最多同时提交的读请求个数 */
+#define FS_READ_BATCH	8
+
+/* 顺序读取时预读窗口的初始/最大块数，每次顺序读取后窗口大小加倍 */
+#define FS_RA_MIN	4
+#define FS_RA_MAX	64
+
+/* 追加写入时预分配窗口的最小/最大块数，在此范围内与文件已有的块数相同；每个文件系统最多同时存在的预分配窗口数 */
+#define FS_PREALLOC_MIN	8
+#define FS_PREALLOC_MAX	256
+#define FS_PREALLOC_COUNT	32
+
+/* 内核地址空间中用于映射设备寄存器（MMIO）的区域，以及最多的映射个数 */
+#define KERNEL_MMIO_BASE	0xF0000000
+#define KERNEL_MMIO_SIZE	0x400000
+#define MMIO_MAP_COUNT		8
+
+/* 最大支持块设备个数 */
+#define BLK_DEV_COUNT	16
+
+/* IDE硬盘的设备号：primary master为IDE_DEV_NO，其后依次为primary slave、secondary master、secondary slave */
+#define IDE_DEV_NO	0
+#define IDE_DRIVE_COUNT	4
+/* virtio-blk硬盘的设备号 */
+#define VIRTIO_BLK_DEV_NO	4
+
+/* AHCI SATA硬盘的设备号 */
+#define AHCI_DEV_NO	5
+/* NVMe硬盘（namespace 1）的设备号 */
+#define NVME_DEV_NO	6
+/* 由两个硬盘条带化组成的RAID-0设备的设备号，通过内核命令行参数raid0=<dev>,<dev>指定成员 */
+#define RAID0_DEV_NO	7
+/* RAID-0的条带大小（扇区数），即连续多少个扇区位于同一个成员硬盘上 */
+#define RAID0_CHUNK_SECTORS	16
+/* 内存盘的设备号，通过内核命令行参数ramdisk=<KB>指定大小，并用第一个GRUB模块的内容初始化 */
+#define RAMDISK_DEV_NO	8
+/* 内存盘的最大页面数 */
+#define RAMDISK_MAX_PAGES	(SUPPORT_MEM_SIZE / 0x1000)
+
+/* NVMe I/O队列的大小，同时提交给设备的命令数比它少1 */
+#define NVME_QUEUE_SIZE		64
+/* 同步读写NVMe硬盘时先轮询完成队列的最长时间（CPU时钟周期数），为0时只等待中断；可通过内核命令行参数nvme_poll指定 */
+#define NVME_POLL_CYCLES	200000
+
+/* virtio-blk同时提交给设备的最多请求数，以及每个请求最多包含的buf数 */
+#define VIRTIO_BLK_REQS		64
+#define VIRTIO_BLK_MAX_SEGS	32
+
+/* 块I/O跟踪环形缓冲区的记录数 */
+#define BLK_TRACE_COUNT		8192
+
+/* 保存的内核命令行的最大长度 */
+#define BOOT_CMDLINE_SIZE	256
+/* 记录的GRUB模块的最多个数 */
+#define BOOT_MODULE_COUNT	4
+
+/* C-LOOK调度时读/写请求的最长等待时间（时钟滴答数），超时的请求将被优先处理 */
+#define IO_SCHED_READ_EXPIRE	25
+#define IO_SCHED_WRITE_EXPIRE	250
+
+/* 同步读硬盘时先轮询状态寄存器的最长时间（CPU时钟周期数），超时后改为等待中断；为0时不轮询。
+ * 可通过内核命令行参数ide_poll指定 */
+#define IDE_POLL_CYCLES		200000
+/* 请求队列中等待的其他请求不超过该值时才轮询 */
+#define IDE_POLL_QUEUE_MAX	0
+
+/* 空闲页面少于该值时，分配页面前先回收块缓冲所占用的内存 */
+#define VMM_LOW_WATERMARK	64
+/* 空闲页面多于该值时，块缓冲才会重新增长 */
+#define VMM_HIGH_WATERMARK	256
 
 /* inode cache中inode结构个数(保持活动的个数) */
 #define CACHE_INODE_NUM	50
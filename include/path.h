@@ -13,4 +13,6 @@ int32_t get_last_element(const char * path, char * elem);
 mem_inode_t * resolve_path(const char * path, int32_t stop_at_parent, char * name);
 
 int32_t is_empty_dir(mem_inode_t * dp);
+
+void init_root_dev(void);
 #endif //_INCLUDE_PATH_H_
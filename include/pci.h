@@ -0,0 +1,41 @@
+#ifndef _INCLUDE_PCI_H_
+#define _INCLUDE_PCI_H_
+
+#include <stdint.h>
+
+/* PCI配置空间中的一些寄存器偏移 */
+#define PCI_VENDOR_ID		0x00	//16位，为0xFFFF时表示设备不存在
+#define PCI_DEVICE_ID		0x02	//16位
+#define PCI_COMMAND		0x04	//16位
+#define PCI_PROG_IF		0x09	//8位
+#define PCI_SUBCLASS		0x0A	//8位
+#define PCI_CLASS		0x0B	//8位
+#define PCI_HEADER_TYPE		0x0E	//8位
+#define PCI_BAR0		0x10	//32位，BAR1~BAR5依次相隔4字节
+#define PCI_INTERRUPT_LINE	0x3C	//8位
+
+/* PCI_COMMAND中的标志 */
+#define PCI_COMMAND_IO		0x1	//允许访问I/O空间
+#define PCI_COMMAND_MEMORY	0x2	//允许访问内存空间
+#define PCI_COMMAND_MASTER	0x4	//允许设备作为总线主控（DMA）
+
+/* BAR最低位为1时表示I/O空间 */
+#define PCI_BAR_IO		0x1
+
+/* 设备位置：总线号、设备号、功能号 */
+typedef struct {
+	uint8_t bus;
+	uint8_t dev;
+	uint8_t func;
+} pci_addr_t;
+
+uint32_t pci_read_config32(pci_addr_t addr, uint32_t off);
+uint16_t pci_read_config16(pci_addr_t addr, uint32_t off);
+uint8_t pci_read_config8(pci_addr_t addr, uint32_t off);
+void pci_write_config32(pci_addr_t addr, uint32_t off, uint32_t val);
+void pci_write_config16(pci_addr_t addr, uint32_t off, uint16_t val);
+int32_t pci_find_class(uint8_t class, uint8_t subclass, uint32_t index, pci_addr_t * addr);
+int32_t pci_find_device(uint16_t vendor, uint16_t device, uint32_t index, pci_addr_t * addr);
+void pci_enable(pci_addr_t addr, uint16_t flags);
+
+#endif //_INCLUDE_PCI_H_
@@ -133,6 +133,7 @@ int32_t wait(int32_t * retval);
 
 /* ========================================= */
 pcb_t * alloc_pcb_noint(void);
+pcb_t * create_kernel_thread_noint(const char * name, void (* entry_point)(void));
 void create_first_proc(void);
 
 /* ========================================= */
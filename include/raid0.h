@@ -0,0 +1,18 @@
+#ifndef _INCLUDE_RAID0_H_
+#define _INCLUDE_RAID0_H_
+
+#include <stdint.h>
+
+/* RAID-0统计数据 */
+typedef struct {
+	uint32_t reqs[2]; //分配到两个成员硬盘的请求数
+	uint32_t chunks; //相继的两个请求位于不同条带的次数
+} raid0_stats_t;
+
+void init_raid0(void);
+void get_raid0_stats(raid0_stats_t * st);
+
+/* DEBUG */
+void dump_raid0_stats(void);
+
+#endif //_INCLUDE_RAID0_H_
@@ -0,0 +1,18 @@
+#ifndef _INCLUDE_RAMDISK_H_
+#define _INCLUDE_RAMDISK_H_
+
+#include <stdint.h>
+
+/* 内存盘统计数据 */
+typedef struct {
+	uint32_t reads; //读取的扇区数
+	uint32_t writes; //写入的扇区数
+} ramdisk_stats_t;
+
+void init_ramdisk(void);
+void get_ramdisk_stats(ramdisk_stats_t * st);
+
+/* DEBUG */
+void dump_ramdisk_stats(void);
+
+#endif //_INCLUDE_RAMDISK_H_
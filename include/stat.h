@@ -14,4 +14,14 @@ typedef struct{
 	uint32_t size; //文件大小，字节单位
 } stat_t;
 
+/* 可以被用户进程检索的文件系统信息 */
+typedef struct{
+	int32_t dev;	//文件系统所在设备
+	uint32_t block_size; //block大小，字节单位
+	uint32_t blocks; //可用于分配的block总数
+	uint32_t free_blocks; //空闲的block数
+	uint32_t inodes; //可用于分配的i节点总数
+	uint32_t free_inodes; //空闲的i节点数
+} statfs_t;
+
 #endif //_INCLUDE_STAT_H_
@@ -22,6 +22,11 @@
 #define SYS_NUM_mknod	15
 #define SYS_NUM_chdir	16
 #define SYS_NUM_pipe	17
+#define SYS_NUM_sync	18
+#define SYS_NUM_fsync	19
+#define SYS_NUM_iostat	20
+#define SYS_NUM_blktrace	21
+#define SYS_NUM_statfs	22
 
 void syscall(void);
 
@@ -0,0 +1,22 @@
+#ifndef _INCLUDE_VIRTIO_BLK_H_
+#define _INCLUDE_VIRTIO_BLK_H_
+
+#include <stdint.h>
+
+/* virtio-blk驱动统计数据 */
+typedef struct {
+	uint32_t reqs; //提交给设备的请求数
+	uint32_t sectors; //传输的扇区数
+	uint32_t kicks; //通知设备的次数
+	uint32_t irqs; //处理的中断数
+	uint32_t max_batch; //一次中断中完成的最多请求数
+	uint32_t max_inflight; //同时在设备中的最多请求数
+} virtio_blk_stats_t;
+
+void init_virtio_blk(void);
+void get_virtio_blk_stats(virtio_blk_stats_t * st);
+
+/* DEBUG */
+void dump_virtio_blk_stats(void);
+
+#endif //_INCLUDE_VIRTIO_BLK_H_
@@ -32,6 +32,8 @@ void map_pages_noint(pde_t * pd, void * vaddr, uint32_t size, void * paddr, uint
 
 pde_t * create_init_kvm_noint(void);
 
+void * map_mmio_noint(uint32_t paddr, uint32_t size);
+
 void init_first_proc_uvm(pde_t * pd, uint32_t init_proc_start_addr, uint32_t init_proc_size);
 
 
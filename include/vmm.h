@@ -45,6 +45,9 @@ typedef uint32_t pte_t;
 #define PDE_USER	0x4
 #define PTE_USER	0x4
 
+#define PTE_PWT		0x8	//write-through
+#define PTE_PCD		0x10	//禁止缓存，用于映射设备寄存器
+
 
 /* 定义用于获取虚拟地址的页目录索引/页表索引/页内偏移量的宏*/
 #define PD_INDEX(x)	((uint32_t)(x) >> 22)
@@ -61,6 +64,10 @@ void * alloc_page_noint(void);
 
 void free_page_noint(void * vaddr);
 
+void reclaim_module_pages_noint(uint32_t start, uint32_t end);
+
+uint32_t count_free_pages(void);
+
 void * alloc_page(void);
 
 void free_page(void * vaddr);
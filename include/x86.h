@@ -55,6 +55,18 @@ static inline void sti(void)
 			:);
 }
 
+/*
+ * 读取时间戳计数器(TSC)，返回CPU上电以来经过的时钟周期数
+ */
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	asm volatile ( "rdtsc"
+			: "=a" (lo), "=d" (hi)
+			:);
+	return ((uint64_t)hi << 32) | lo;
+}
+
 /*
  * insl and outsl are copied and modified from xv6-v7/x86.h.
  * insl从port中依次读取count个uint32_t值并依次写入到addr中；outsl则与之相反。
@@ -120,5 +132,27 @@ static inline void outw( uint16_t port, uint16_t data )
 			: "a" (data), "d" (port) );
 }
 
+/*
+ * 从32位端口读取数据
+ */
+static inline uint32_t inl( uint16_t port )
+{
+	uint32_t data;
+	asm volatile ( "inl %1, %0"
+			: "=a" (data)
+			: "d" (port) );
+	return data;
+}
+
+/*
+ * 向32位端口写入数据
+ */
+static inline void outl( uint16_t port, uint32_t data )
+{
+	asm volatile ( "outl %0, %1"
+			:
+			: "a" (data), "d" (port) );
+}
+
 
 #endif //_INCLUDE_X86_H_
@@ -106,6 +106,13 @@ void interrupt_handler_switcher(trapframe_t * tf)
 					PANIC("interrupt_handler_switcher: timer/ide interrupt unhandled");
 				break;
 			default:
+				/* 其他设备（如PCI设备）的中断可能是电平触发的，处理函数清除中断源之后再发送EOI */
+				if(interrupt_handler_table[tf->trap_no])
+				{
+					interrupt_handler_table[tf->trap_no](tf);
+					send_EOI((uint8_t)tf->trap_no);
+					break;
+				}
 				//printk("Unexcepted IRQ %u eip %X errcode %X\n", tf->trap_no, tf->eip, tf->err_code);
 				print_log("Unexcepted IRQ %u eip %X errcode %X\n", tf->trap_no, tf->eip, tf->err_code);
 				break;
@@ -225,3 +232,40 @@ void register_interrupt_handler(uint8_t int_vector, interrupt_handler_t interrup
 {
 	interrupt_handler_table[int_vector] = interrupt_handler;
 }
+
+
+/* 可共享的IR line上注册的处理函数，PCI设备的中断线可能由多个设备共享 */
+#define SHARED_IRQ_HANDLER_COUNT	4
+static interrupt_handler_t shared_irq_handler_table[16][SHARED_IRQ_HANDLER_COUNT];
+
+/*
+ * 依次调用共享该IR line的所有处理函数，各处理函数应检查自己的设备是否产生了中断
+ */
+static void shared_irq_handler(trapframe_t * tf)
+{
+	interrupt_handler_t * handlers = shared_irq_handler_table[tf->trap_no - IRQ0_INT_VECTOR];
+
+	for(uint32_t i = 0; i < SHARED_IRQ_HANDLER_COUNT && handlers[i]; i++)
+		handlers[i](tf);
+}
+
+/*
+ * 在可共享的IR line（0-15）上注册中断处理函数，并打开该IR line
+ */
+void register_shared_irq_handler(uint8_t IRline, interrupt_handler_t interrupt_handler)
+{
+	interrupt_handler_t * handlers;
+	uint32_t i;
+
+	if(IRline > 15)
+		PANIC("register_shared_irq_handler: illegal IR line");
+	handlers = shared_irq_handler_table[IRline];
+	for(i = 0; i < SHARED_IRQ_HANDLER_COUNT && handlers[i]; i++)
+		;
+	if(i == SHARED_IRQ_HANDLER_COUNT)
+		PANIC("register_shared_irq_handler: too many handlers");
+	handlers[i] = interrupt_handler;
+
+	register_interrupt_handler(IRQ0_INT_VECTOR + IRline, shared_irq_handler);
+	enable_IRline(IRline);
+}
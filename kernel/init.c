@@ -14,6 +14,12 @@
 #include "vm_tools.h"
 #include "process.h"
 #include "ide.h"
+#include "virtio_blk.h"
+#include "ahci.h"
+#include "nvme.h"
+#include "raid0.h"
+#include "ramdisk.h"
+#include "blk_trace.h"
 #include "buf_cache.h"
 #include "block.h"
 #include "inode.h"
@@ -37,6 +43,9 @@
 
 /* pointer to Multiboot information struct which is passed by boot.asm */
 multiboot_info_t * glb_mbi;
+
+/* 时钟滴答数 */
+volatile uint32_t ticks = 0;
  
 
 /* 在init.data段中声明内核页目录/相关页表 */
@@ -139,6 +148,7 @@ void kernel_init2()
 	 * 之间的映射了 */
 	console_clear_screen();
 	printk("Hello, Tryos. Currently we are in paging mode\n");
+	init_boot_args();
 
 	init_gdt();
 	init_idt();
@@ -146,7 +156,17 @@ void kernel_init2()
 	init_8253pit(50);
 	init_vmm();
 	init_ide();
+	init_virtio_blk();
+	init_ahci();
+	init_nvme();
+	init_raid0();
+	init_ramdisk();
+	init_root_dev();
+	init_blk_trace();
 	init_buf_cache();
+	/* 缓冲区查找的自测，以bufselftest=1启动时运行 */
+	if(get_boot_arg_uint("bufselftest", 0))
+		test_buf_cache_lookup();
 	init_kbd();
 	init_tty();
 
@@ -188,6 +208,7 @@ void kernel_init2()
 	*/
 
 	create_first_proc();
+	start_buf_flusher();
 
 	scheduler();
 
@@ -265,9 +286,9 @@ void proc_CC(void)
 
 void timer_callback(trapframe_t * info)
 {
-	static uint32_t ticks = 0;
 	//printk("timer_callback: tick %u\n", ticks);
 	ticks++;
+	wakeup_noint((void *)&ticks);
 
 	/* DEBUG */
 	extern uint32_t delay(uint32_t);
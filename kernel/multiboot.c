@@ -8,6 +8,18 @@
 #include "multiboot.h"
 #include "terminal_io.h"
 #include "vmm.h"
+#include "string.h"
+#include "parameters.h"
+
+/* GRUB传递的内核命令行副本 */
+static char boot_cmdline[BOOT_CMDLINE_SIZE];
+
+/* GRUB加载的模块所占的物理地址范围[start, end)，只记录位于SUPPORT_MEM_SIZE以内的模块 */
+static struct {
+	uint32_t start;
+	uint32_t end;
+} boot_modules[BOOT_MODULE_COUNT];
+static uint32_t boot_module_count;
 
 
 /*
@@ -62,3 +74,111 @@ int32_t mem_validate(uint32_t paddr)
 	}
 	return 0;
 }
+
+
+/*
+ * 保存GRUB传递的内核命令行和模块列表，之后可以通过get_boot_arg/get_boot_module获取；
+ * 它们所在的内存可能会被分配出去，所以必须在init_vmm之前调用。
+ */
+void init_boot_args(void)
+{
+	module_entry_t * mods;
+
+	boot_cmdline[0] = '\0';
+	if(glb_mbi->flags & MULTIBOOT_INFO_CMDLINE)
+		sstrncpy(boot_cmdline, (char *)K_P2V(glb_mbi->cmdline), BOOT_CMDLINE_SIZE - 1);
+	boot_cmdline[BOOT_CMDLINE_SIZE - 1] = '\0';
+
+	boot_module_count = 0;
+	if( ! (glb_mbi->flags & MULTIBOOT_INFO_MODS))
+		return;
+	mods = (module_entry_t *)K_P2V(glb_mbi->mods_addr);
+	for(uint32_t i = 0; i < glb_mbi->mods_count && boot_module_count < BOOT_MODULE_COUNT; i++)
+	{
+		if(mods[i].mod_end <= mods[i].mod_start || mods[i].mod_end > SUPPORT_MEM_SIZE)
+			continue;
+		boot_modules[boot_module_count].start = mods[i].mod_start;
+		boot_modules[boot_module_count].end = mods[i].mod_end;
+		boot_module_count++;
+	}
+}
+
+
+/*
+ * 获取第index个模块的物理地址范围[start, end)，存在时返回1，否则返回0
+ */
+uint32_t get_boot_module(uint32_t index, uint32_t * start, uint32_t * end)
+{
+	if(index >= boot_module_count)
+		return 0;
+	*start = boot_modules[index].start;
+	*end = boot_modules[index].end;
+	return 1;
+}
+
+
+/*
+ * 检查paddr所在物理页框是否包含模块的数据，是则返回1，否则返回0；
+ * init_vmm不会分配这样的页面，由使用模块的代码决定是否回收。
+ */
+int32_t in_boot_module(uint32_t paddr)
+{
+	paddr = PAGE_DOWN_ALIGN(paddr);
+	for(uint32_t i = 0; i < boot_module_count; i++)
+	{
+		if(paddr < boot_modules[i].end && paddr + PAGE_SIZE > boot_modules[i].start)
+			return 1;
+	}
+	return 0;
+}
+
+
+/*
+ * 在内核命令行中查找形如name=value的参数，参数之间以空格分隔。
+ * 找到则将value复制到value中（最多size - 1个字符，以NUL结尾），返回value的长度；没有找到返回-1。
+ */
+int32_t get_boot_arg(const char * name, char * value, uint32_t size)
+{
+	uint32_t len = strlen(name);
+	char * p = boot_cmdline;
+	uint32_t n;
+
+	while(*p)
+	{
+		/* 跳过空格 */
+		while(*p == ' ')
+			p++;
+		if(strncmp(p, name, len) == 0 && p[len] == '=')
+		{
+			p += len + 1;
+			for(n = 0; p[n] != '\0' && p[n] != ' ' && n + 1 < size; n++)
+				value[n] = p[n];
+			value[n] = '\0';
+			return (int32_t)n;
+		}
+		/* 跳到下一个参数 */
+		while(*p && *p != ' ')
+			p++;
+	}
+	return -1;
+}
+
+
+/*
+ * 获取值为十进制整数的参数name，没有该参数或其值不是整数时返回def
+ */
+uint32_t get_boot_arg_uint(const char * name, uint32_t def)
+{
+	char value[12];
+	uint32_t n = 0;
+
+	if(get_boot_arg(name, value, sizeof(value)) <= 0)
+		return def;
+	for(char * p = value; *p; p++)
+	{
+		if(*p < '0' || *p > '9')
+			return def;
+		n = n * 10 + (*p - '0');
+	}
+	return n;
+}
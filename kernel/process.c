@@ -518,6 +518,35 @@ pcb_t * alloc_pcb_noint(void)
 }
 
 
+/*
+ * 创建一个从entry_point开始执行的内核线程，该线程只有内核地址空间，不会返回到用户模式。
+ * 成功返回其PCB，失败返回NULL。
+ *
+ * 注意：在使用该函数时，要保证没有其他进程在使用PCB表；
+ */
+pcb_t * create_kernel_thread_noint(const char * name, void (* entry_point)(void))
+{
+	pcb_t * proc;
+
+	if((proc = alloc_pcb_noint()) == NULL)
+		return NULL;
+
+	/* 从entry_point开始执行，而不是forkret */
+	proc->context->eip = (uint32_t)entry_point;
+
+	proc->pgdir = create_init_kvm_noint();
+	memset(proc->tf, 0, sizeof(trapframe_t));
+	strncpy(proc->name, name, PROC_NAME_LENGTH);
+	memset(proc->open_files, 0, sizeof(proc->open_files));
+	proc->cwd = NULL;
+	proc->size = 0;
+	proc->parent = NULL;
+
+	proc->state = PROC_STATE_RUNNABLE;
+	return proc;
+}
+
+
 /*
  * 构造第一个RUNNABLE的进程。
  */
@@ -28,6 +28,11 @@ extern int32_t sys_mkdir(void);
 extern int32_t sys_mknod(void);
 extern int32_t sys_chdir(void);
 extern int32_t sys_pipe(void);
+extern int32_t sys_sync(void);
+extern int32_t sys_fsync(void);
+extern int32_t sys_iostat(void);
+extern int32_t sys_blktrace(void);
+extern int32_t sys_statfs(void);
 
 /* 系统调用指针表 */
 static int32_t (* syscall_table[])(void) = {
@@ -48,7 +53,12 @@ static int32_t (* syscall_table[])(void) = {
 	[SYS_NUM_mkdir]		= sys_mkdir,
 	[SYS_NUM_mknod]		= sys_mknod,
 	[SYS_NUM_chdir]		= sys_chdir,
-	[SYS_NUM_pipe]		= sys_pipe
+	[SYS_NUM_pipe]		= sys_pipe,
+	[SYS_NUM_sync]		= sys_sync,
+	[SYS_NUM_fsync]		= sys_fsync,
+	[SYS_NUM_iostat]	= sys_iostat,
+	[SYS_NUM_blktrace]	= sys_blktrace,
+	[SYS_NUM_statfs]	= sys_statfs
 };
 
 static char * syscall_str_table[] = {
@@ -69,7 +79,12 @@ static char * syscall_str_table[] = {
 	[SYS_NUM_mkdir]		= "mkdir",
 	[SYS_NUM_mknod]		= "mknod",
 	[SYS_NUM_chdir]		= "chdir",
-	[SYS_NUM_pipe]		= "pipe"
+	[SYS_NUM_pipe]		= "pipe",
+	[SYS_NUM_sync]		= "sync",
+	[SYS_NUM_fsync]		= "fsync",
+	[SYS_NUM_iostat]	= "iostat",
+	[SYS_NUM_blktrace]	= "blktrace",
+	[SYS_NUM_statfs]	= "statfs"
 };
 
 /*
@@ -11,6 +11,18 @@
 #include "terminal_io.h"
 #include "process.h"
 
+/* 已映射的设备寄存器区域，每个新建的分页结构中都要建立这些映射 */
+static struct {
+	uint32_t vaddr;
+	uint32_t paddr;
+	uint32_t size;
+} mmio_regions[MMIO_MAP_COUNT];
+static uint32_t mmio_region_count;
+/* 下一个可用的MMIO虚拟地址 */
+static uint32_t mmio_next_vaddr = KERNEL_MMIO_BASE;
+
+static void map_mmio_regions(pde_t * pd, uint32_t noint);
+
 /*
  * 获得虚拟地址在指定分页结构中所对应的页表条目虚拟地址。
  * 如果need_create为真，则在需要时会创建中间页表；中间页表对应的页目录条目设置为用户特权级别的。
@@ -96,6 +108,7 @@ pde_t * create_init_kvm(void)
 	
 	/* 在pd中构建映射关系 */
 	map_pages(pd, (void *)KERNEL_VIRTUAL_ADDR_OFFSET, SUPPORT_MEM_SIZE, (void *)0x0, PTE_PRESENT | PTE_RW);
+	map_mmio_regions(pd, 0);
 
 	return pd;
 }
@@ -417,6 +430,7 @@ pde_t * create_init_kvm_noint(void)
 	
 	/* 在pd中构建映射关系 */
 	map_pages_noint(pd, (void *)KERNEL_VIRTUAL_ADDR_OFFSET, SUPPORT_MEM_SIZE, (void *)0x0, PTE_PRESENT | PTE_RW);
+	map_mmio_regions(pd, 1);
 
 	return pd;
 }
@@ -454,3 +468,46 @@ void init_first_proc_uvm(pde_t * pd, uint32_t init_proc_start_addr, uint32_t ini
 		map_pages_noint(pd, (void *)vaddr, PAGE_SIZE, (void *)K_V2P(pg), PTE_PRESENT | PTE_RW | PTE_USER);
 	}
 }
+
+
+/*
+ * 在pd中建立所有已映射的设备寄存器区域的映射，noint为真时使用不带锁的内存分配接口
+ */
+static void map_mmio_regions(pde_t * pd, uint32_t noint)
+{
+	for(uint32_t i = 0; i < mmio_region_count; i++)
+	{
+		if(noint)
+			map_pages_noint(pd, (void *)mmio_regions[i].vaddr, mmio_regions[i].size,
+					(void *)mmio_regions[i].paddr, PTE_PRESENT | PTE_RW | PTE_PCD | PTE_PWT);
+		else
+			map_pages(pd, (void *)mmio_regions[i].vaddr, mmio_regions[i].size,
+					(void *)mmio_regions[i].paddr, PTE_PRESENT | PTE_RW | PTE_PCD | PTE_PWT);
+	}
+}
+
+
+/*
+ * 将物理地址paddr开始的size字节设备寄存器映射到内核地址空间中，返回对应的虚拟地址，映射禁止缓存；
+ * 映射建立在调度器线程的分页结构中，之后新建的分页结构中也会建立该映射。
+ * 只能在创建第一个进程之前调用，空间不足时PANIC。
+ */
+void * map_mmio_noint(uint32_t paddr, uint32_t size)
+{
+	uint32_t offset = PG_OFFSET(paddr);
+	uint32_t vaddr = mmio_next_vaddr;
+
+	size = PAGE_UPPER_ALIGN(size + offset);
+	paddr = PAGE_DOWN_ALIGN(paddr);
+	if(mmio_region_count == MMIO_MAP_COUNT || vaddr + size > KERNEL_MMIO_BASE + KERNEL_MMIO_SIZE)
+		PANIC("map_mmio_noint: no space");
+
+	mmio_regions[mmio_region_count].vaddr = vaddr;
+	mmio_regions[mmio_region_count].paddr = paddr;
+	mmio_regions[mmio_region_count].size = size;
+	mmio_region_count++;
+	mmio_next_vaddr += size;
+
+	map_pages_noint(cpu.pgdir, (void *)vaddr, size, (void *)paddr, PTE_PRESENT | PTE_RW | PTE_PCD | PTE_PWT);
+	return (void *)(vaddr + offset);
+}
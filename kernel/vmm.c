@@ -11,6 +11,7 @@
 #include "string.h"
 #include "terminal_io.h"
 #include "process.h"
+#include "buf_cache.h"
 
 
 /* 可动态分配的内核内存中，每一个空闲页面头部均具有一个这样的结构 */
@@ -25,6 +26,7 @@ typedef struct _free_page_t{
 /* 链表头，用于描述可动态分配的内核内存区域 */
 typedef struct {
 	uint32_t flags; //该链表的状态
+	uint32_t count; //空闲页个数
 	uint32_t end_addr; //可动态分配的内存区域结束地址
 	free_page_t * head; //第一个空闲页地址
 } free_page_list_t;
@@ -51,11 +53,13 @@ void init_vmm(void)
 	
 	/* 清空标志位 */
 	free_page_list.flags = 0;
+	free_page_list.count = 0;
 	
-	/* 将所有空闲页链接起来 */
+	/* 将所有空闲页链接起来，GRUB加载的模块所占的页面除外 */
 	extern void free_page_noint(void * vaddr);
 	for(uint32_t vaddr = PAGE_UPPER_ALIGN(kernel_end_addr); vaddr < free_page_list.end_addr; vaddr += PAGE_SIZE)
-		free_page_noint((void *)vaddr);
+		if( ! in_boot_module(K_V2P(vaddr)))
+			free_page_noint((void *)vaddr);
 }
 
 /*
@@ -70,6 +74,7 @@ void * alloc_page_noint(void)
 		return NULL;
 	page = free_page_list.head;
 	free_page_list.head = free_page_list.head->next;
+	free_page_list.count--;
 	memset(page, 0, PAGE_SIZE);
 	
 	return (void *)page;
@@ -89,6 +94,27 @@ void free_page_noint(void * vaddr)
 	//memset(page, 1, PAGE_SIZE); //写入1便于检测错误
 	page->next = free_page_list.head;
 	free_page_list.head = page;
+	free_page_list.count++;
+}
+
+/*
+ * 无需锁，回收物理地址范围[start, end)所覆盖的、init_vmm因属于GRUB模块而保留的页面
+ */
+void reclaim_module_pages_noint(uint32_t start, uint32_t end)
+{
+	for(uint32_t vaddr = K_P2V(PAGE_DOWN_ALIGN(start)); vaddr < K_P2V(PAGE_UPPER_ALIGN(end)); vaddr += PAGE_SIZE)
+	{
+		if(vaddr >= PAGE_UPPER_ALIGN(kernel_end_addr) && vaddr < free_page_list.end_addr)
+			free_page_noint((void *)vaddr);
+	}
+}
+
+/*
+ * 返回当前空闲页个数，不加锁，结果仅供参考
+ */
+uint32_t count_free_pages(void)
+{
+	return free_page_list.count;
 }
 
 /*
@@ -117,12 +143,16 @@ static void unlock_free_page_list(void)
 }
 
 /*
- * 需要锁，分配一个清零过的空闲页，返回该页的起始虚拟地址
+ * 需要锁，分配一个清零过的空闲页，返回该页的起始虚拟地址；
+ * 空闲页不足VMM_LOW_WATERMARK时，先回收块缓冲所占用的内存。
  */
 void * alloc_page(void)
 {
 	void * vaddr;
 
+	if(free_page_list.count < VMM_LOW_WATERMARK)
+		shrink_buf_cache(VMM_LOW_WATERMARK - free_page_list.count);
+
 	lock_free_page_list();
 	vaddr = alloc_page_noint();
 	unlock_free_page_list();
@@ -182,5 +212,5 @@ uint32_t rcr3(void)
 /* DEBUG */
 void dump_free_page_list(void)
 {
-	printk("dump_free_page_list: flags %u end_addr %X head %X\n", free_page_list.flags, free_page_list.end_addr, free_page_list.head);
+	printk("dump_free_page_list: flags %u count %u end_addr %X head %X\n", free_page_list.flags, free_page_list.count, free_page_list.end_addr, free_page_list.head);
 }
@@ -3,58 +3,94 @@
 #include <unistd.h>
 #include <fcntl.h>
 
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 #include "./lib.h"
 #include "./block.h"
+#include "../include/bitmap.h"
+
+/* alloc_bit读写位图时使用的缓冲区 */
+typedef struct {
+	int fd;
+	uint32_t start_sector;
+	uint32_t map[BLOCK_SIZE / sizeof(uint32_t)];
+} bitmap_io_t;
+
+static uint32_t * get_bitmap_block(void * ctx, uint32_t k)
+{
+	bitmap_io_t * io = ctx;
+
+	if(raw_read(io->fd, io->start_sector + k, io->map, sizeof(io->map)) == -1)
+	{
+		printf("alloc_bit: read bitmap error\n");
+		return NULL;
+	}
+	return io->map;
+}
+
+static int32_t put_bitmap_block(void * ctx, uint32_t k, int32_t dirty)
+{
+	bitmap_io_t * io = ctx;
+
+	if(dirty && raw_write(io->fd, io->start_sector + k, io->map, sizeof(io->map)) == -1)
+	{
+		printf("alloc_bit: write bitmap error\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * 在fd上从start_sector开始、共nbits个bit的位图中分配一个为0的bit：
+ * 从第*cursor个bit开始向后查找，到达末尾后回到开头，找到时将其置1并返回其位置，同时将*cursor设为下一个bit；
+ * 没有为0的bit或读写出错时返回-1。
+ * 查找过程由bitmap_alloc实现，与内核共用。
+ */
+int64_t alloc_bit(int fd, uint32_t start_sector, uint32_t nbits, uint32_t * cursor)
+{
+	bitmap_io_t io;
+
+	io.fd = fd;
+	io.start_sector = start_sector;
+	return bitmap_alloc(nbits, cursor, get_bitmap_block, put_bitmap_block, &io);
+}
 
 /*
- * 在文件系统中分配所找到的第一个空闲数据块。
+ * 在文件系统中分配一个空闲数据块，尽量分配goal或其后最近的空闲块：
+ * 先在goal所在的块组中从goal开始查找，再依次查找之后的各个块组，与内核中的alloc_block相同。
  * fd必须引用一个为可读可写方式打开的文件，且已经通过make_fs调用格式化过。
  * sb为超级块指针。
  * 成功返回数据块号，失败返回_NAVL_BLK_NUM_ (不同于NAVL_BLK_NUM)
  */
-uint32_t alloc_block(int fd, super_block_t * sb)
+uint32_t alloc_block(int fd, super_block_t * sb, uint32_t goal)
 {
-	uint8_t mask;
 	uint8_t sector[BLOCK_SIZE];
+	uint32_t first, g, cursor;
+	int64_t b = -1;
 
-	for(uint32_t b = 0; b < sb->block_number; b += BITS_PER_BLOCK)
+	if(goal >= sb->block_number)
+		goal = 0;
+	first = GROUP_OF_BLOCK(goal, *sb);
+	for(uint32_t i = 0; i < sb->groups && b < 0; i++)
 	{
-		/* 读取block bitmap中b这个bit所在block */
-		if(raw_read(fd, SNUM_OF_BLK_BITMAP(b, *sb), sector, sizeof(sector)) == -1)
-		{
-			printf("alloc_block: read block bitmap error\n");
-			return _NAVL_BLK_NUM_;
-		}
-		
-		for(uint32_t bi = 0; bi < BITS_PER_BLOCK && b+bi < sb->block_number; bi++)
-		{
-			mask = 1 << (bi % 8);
-			if((sector[bi / 8] & mask) == 0)
-			{
-				/* 此时找到了一个空闲bit */
-				sector[bi / 8] |= mask;
-
-				/* 写回位图 */
-				if(raw_write(fd, SNUM_OF_BLK_BITMAP(b+bi, *sb), sector, sizeof(sector)) == -1)
-				{
-					printf("alloc_block: write block bitmap error\n");
-					return _NAVL_BLK_NUM_;
-				}
-
-				/* 清空所找到的数据块 */
-				memset(sector, 0, sizeof(sector));
-				if(raw_write(fd, SNUM_OF_BLOCK(b+bi, *sb), sector, sizeof(sector)) == -1)
-				{
-					printf("alloc_block: clear block error\n");
-					return _NAVL_BLK_NUM_;
-				}
-				return (b + bi);
-			}
-		}
+		g = (first + i) % sb->groups;
+		cursor = i == 0 ? goal % sb->blocks_per_group : 0;
+		if((b = alloc_bit(fd, SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb), GROUP_BLOCKS(g, *sb), &cursor)) >= 0)
+			b += g * sb->blocks_per_group;
 	}
-	printf("alloc_block: no free blocks\n");
-	return _NAVL_BLK_NUM_; //没有空闲block了
+	if(b < 0)
+	{
+		printf("alloc_block: no free blocks\n");
+		return _NAVL_BLK_NUM_; //没有空闲block了
+	}
+
+	/* 清空所找到的数据块 */
+	memset(sector, 0, sizeof(sector));
+	if(raw_write(fd, SNUM_OF_BLOCK(b, *sb), sector, sizeof(sector)) == -1)
+	{
+		printf("alloc_block: clear block error\n");
+		return _NAVL_BLK_NUM_;
+	}
+	return (uint32_t)b;
 }
 
 /*
@@ -65,24 +101,20 @@ uint32_t alloc_block(int fd, super_block_t * sb)
  */
 int32_t free_block(int fd, super_block_t * sb, uint32_t bnum)
 {
-	uint8_t mask;
-	uint8_t sector[BLOCK_SIZE];
-
+	uint32_t map[BLOCK_SIZE / sizeof(uint32_t)];
 
 	/* 读取该block对应的位图中的块 */
-	if(raw_read(fd, SNUM_OF_BLK_BITMAP(bnum, *sb), sector, sizeof(sector)) == -1)
+	if(raw_read(fd, SNUM_OF_BLK_BITMAP(bnum, *sb), map, sizeof(map)) == -1)
 	{
 		printf("free_block: read block bitmap error\n");
 		return -1;
 	}
 	
 	/* 修改位图 */
-	bnum = bnum % BITS_PER_BLOCK;
-	mask = 1 << ((bnum % BITS_PER_BLOCK) % 8);
-	sector[(bnum % BITS_PER_BLOCK) / 8] &= ~mask;
+	bitmap_clear(map, bnum % sb->blocks_per_group % BITS_PER_BLOCK);
 	
 	/* 写回 */
-	if(raw_write(fd, SNUM_OF_BLK_BITMAP(bnum, *sb), sector, sizeof(sector)) == -1)
+	if(raw_write(fd, SNUM_OF_BLK_BITMAP(bnum, *sb), map, sizeof(map)) == -1)
 	{
 		printf("free_block: write block bitmap error\n");
 		return -1;
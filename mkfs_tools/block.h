@@ -2,9 +2,11 @@
 #define _INCLUDE_BLOCK_H_
 
 #include <stdint.h>
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 
-uint32_t alloc_block(int fd, super_block_t * sb);
+int64_t alloc_bit(int fd, uint32_t start_sector, uint32_t nbits, uint32_t * cursor);
+
+uint32_t alloc_block(int fd, super_block_t * sb, uint32_t goal);
 
 int32_t free_block(int fd, super_block_t * sb, uint32_t bnum);
 
@@ -1,7 +1,7 @@
 #ifndef _INCLUDE_EXTVARS_H_
 #define _INCLUDE_EXTVARS_H_
 
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 extern int global_fd;
 extern super_block_t global_sb;
 
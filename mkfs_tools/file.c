@@ -3,7 +3,8 @@
 #include <string.h>
 #include <stdlib.h>
 
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
+#include "../include/extent.h"
 #include "inode.h"
 #include "path.h"
 
@@ -40,7 +41,7 @@ m_inode_t * create(m_inode_t * dp, uint16_t type, const char * name)
 	}
 
 	/* 分配一个新的i节点，获取与之关联的内存i节点结构 */
-	if((ip = alloc_inode()) == NULL)
+	if((ip = alloc_inode(dp->inum)) == NULL)
 	{
 		printf("create: alloc inode failed\n");
 		return NULL;
@@ -50,7 +51,14 @@ m_inode_t * create(m_inode_t * dp, uint16_t type, const char * name)
 	ip->type = type;
 	ip->link_number = 1;
 	ip->size = ip->major = ip->minor = 0;
+	ip->iflags = 0;
 	memset(ip->addrs, 0, sizeof(ip->addrs));
+	/* 普通文件和目录使用extent映射 */
+	if(type == FILE_INODE || type == DIR_INODE)
+	{
+		ip->iflags = INODE_EXTENT_FL;
+		ext_init_node(ip->addrs, EXTENT_ROOT_NUMBER, 0);
+	}
 
 	/* 如果新建的是目录，则还需要建立"."和".."这两个目录项 */
 	if(ip->type == DIR_INODE)
@@ -8,7 +8,7 @@
 #include <getopt.h>
 
 #include "./extvars.h"
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 #include "./lib.h"
 #include "./inode.h"
 #include "./path.h"
@@ -40,6 +40,8 @@ static void dump_inode(m_inode_t * ip)
 		default:
 			printf("UNKNOWN-TYPE, "); break;
 	}
+	if(ip->iflags & INODE_EXTENT_FL)
+		printf("EXTENT, ");
 	printf("<%hu, %hu>, %hu, %u)\n",
 			(unsigned short)(ip->major),
 			(unsigned short)(ip->minor),
@@ -54,10 +56,10 @@ static void dump_inode(m_inode_t * ip)
  *
  * fd必须引用一个为可读打开的文件，且已经通过make_fs调用格式化过，sb引用该文件系统上的超级块。
  * effect_bits为bitmap中从头开始被统计的bit个数
- * start_sector为该位图起始扇区号，count为该位图所占扇区数
+ * start_sector为该位图起始扇区号，base为第0个bit对应的i节点号/block号
  * is_ibitmap不为0表示目前处理的是inode bitmap，否则表示目前处理的是block bitmap
  */
-static uint32_t dump_bitmap(int fd, super_block_t * sb, uint32_t effect_bits, uint32_t start_sector, uint32_t count, int32_t is_ibitmap)
+static uint32_t dump_bitmap(int fd, super_block_t * sb, uint32_t effect_bits, uint32_t start_sector, uint32_t base, int32_t is_ibitmap)
 {
 	uint32_t free_bits = 0;
 	uint8_t mask;
@@ -83,16 +85,16 @@ static uint32_t dump_bitmap(int fd, super_block_t * sb, uint32_t effect_bits, ui
 			{
 				if(is_ibitmap) //目前dump的是inode bitmap
 				{
-					inode.inum = b + bi;
+					inode.inum = base + b + bi;
 					if(get_inode(&inode) == -1)
 					{
-						printf("dump_bitmap: get info of inode %u failed\n", (unsigned int)(b + bi));
+						printf("dump_bitmap: get info of inode %u failed\n", (unsigned int)(base + b + bi));
 						return -1;
 					}
 					dump_inode(&inode);
 				}
 				else //dump的是block bitmap
-					printf("%u ", (unsigned int)(b + bi));
+					printf("%u ", (unsigned int)(base + b + bi));
 			}
 		}
 	}
@@ -114,24 +116,50 @@ static uint32_t dump_bitmap(int fd, super_block_t * sb, uint32_t effect_bits, ui
 int32_t dump_fs(int fd, super_block_t * sb)
 {
 	
+	uint32_t avl_inode_num = 0, avl_block_num = 0, group_blocks;
+
 	printf("super block start at %u, occupies %u blocks\n", 1, 1);
-	printf("inode bitmap start at %u, occupies %u blocks\n", 2, (unsigned int)sb->blks_ibitmap);
-	printf("block bitmap start at %u, occupies %u blocks\n", 2+(unsigned int)(sb->blks_ibitmap), (unsigned int)(sb->blks_bbitmap));
-	
-	/* inode 相关 */
-	printf("inodes erea start at %u, occupies %u blocks, ", 
-			2+(unsigned int)(sb->blks_ibitmap + sb->blks_bbitmap), 
-			(unsigned int)(sb->blks_inode));
-	printf("%u inodes altogether\n", (unsigned int)(sb->inode_number));
-	uint32_t avl_inode_num = dump_bitmap(fd, sb, sb->inode_number, 2, sb->blks_ibitmap, 1);
-	printf("%u used, remain %u\n", (unsigned int)(sb->inode_number - avl_inode_num), (unsigned int)(avl_inode_num));
+	printf("%u block groups, %u inodes and %u blocks per group, %u inodes and %u blocks altogether\n",
+			(unsigned int)(sb->groups), (unsigned int)(sb->inodes_per_group), (unsigned int)(sb->blocks_per_group),
+			(unsigned int)(sb->inode_number), (unsigned int)(sb->block_number));
+
+	for(uint32_t g = 0; g < sb->groups; g++)
+	{
+		printf("group %u start at %u\n", (unsigned int)g, (unsigned int)SNUM_OF_GROUP(g, *sb));
+		printf("inode bitmap start at %u, occupies %u blocks\n",
+				(unsigned int)SNUM_OF_INODE_BITMAP(g * sb->inodes_per_group, *sb), (unsigned int)sb->blks_ibitmap);
+		printf("block bitmap start at %u, occupies %u blocks\n",
+				(unsigned int)SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb), (unsigned int)(sb->blks_bbitmap));
+
+		/* inode 相关 */
+		printf("inodes erea start at %u, occupies %u blocks, ",
+				(unsigned int)SNUM_OF_INODE(g * sb->inodes_per_group, *sb),
+				(unsigned int)(sb->blks_inode));
+		printf("inodes %u-%u\n", (unsigned int)(g * sb->inodes_per_group), (unsigned int)((g + 1) * sb->inodes_per_group - 1));
+		uint32_t avl_inodes = dump_bitmap(fd, sb, sb->inodes_per_group,
+				SNUM_OF_INODE_BITMAP(g * sb->inodes_per_group, *sb), g * sb->inodes_per_group, 1);
+		printf("%u used, remain %u\n", (unsigned int)(sb->inodes_per_group - avl_inodes), (unsigned int)(avl_inodes));
+
+		/* block 相关 */
+		group_blocks = GROUP_BLOCKS(g, *sb);
+		printf("data blocks erea start at %u, blocks %u-%u\n",
+				(unsigned int)SNUM_OF_BLOCK(g * sb->blocks_per_group, *sb),
+				(unsigned int)(g * sb->blocks_per_group), (unsigned int)(g * sb->blocks_per_group + group_blocks - 1));
+		uint32_t avl_blocks = dump_bitmap(fd, sb, group_blocks,
+				SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb), g * sb->blocks_per_group, 0);
+		printf("%u used, remain %u\n", (unsigned int)(group_blocks - avl_blocks), (unsigned int)(avl_blocks));
+
+		avl_inode_num += avl_inodes;
+		avl_block_num += avl_blocks;
+	}
+	printf("%u inodes used, remain %u; %u blocks used, remain %u\n",
+			(unsigned int)(sb->inode_number - avl_inode_num), (unsigned int)(avl_inode_num),
+			(unsigned int)(sb->block_number - avl_block_num), (unsigned int)(avl_block_num));
 
-	/* block 相关 */
-	printf("data blocks erea start at %u, %u blocks altogether\n", 
-			2 + (unsigned int)(sb->blks_ibitmap + sb->blks_bbitmap + sb->blks_inode), 
-			(unsigned int)(sb->block_number));
-	uint32_t avl_block_num = dump_bitmap(fd, sb, sb->block_number, 2 + sb->blks_ibitmap, sb->blks_bbitmap, 0);
-	printf("%u used, remain %u\n", (unsigned int)(sb->block_number - avl_block_num), (unsigned int)(avl_block_num));
+	/* 超级块中的空闲计数在sync时写回，可能落后于位图 */
+	printf("super block: %u inodes free, %u blocks free%s\n",
+			(unsigned int)(sb->free_inodes), (unsigned int)(sb->free_blocks),
+			sb->free_inodes == avl_inode_num && sb->free_blocks == avl_block_num ? "" : " (stale)");
 
 	return 0;
 }
@@ -230,6 +258,7 @@ int32_t dump_file(const char * path)
  * ./cmd fs_img [-d path] [-f path]
  * 
  * 当仅指定fs_img这个参数时，按如下方式输出其超级块信息：
+ * 	块组数，每个块组中的inode/block数；对每个块组：
  * 	disk inode bitmap起始位置，所占块数；
  * 	block bitmap起始位置，所占块数；
  * 	disk inode起始位置，所占块数，disk；
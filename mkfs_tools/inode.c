@@ -3,11 +3,12 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 #include "./lib.h"
 #include "./inode.h"
 #include "./block.h"
 #include "./extvars.h"
+#include "../include/extent.h"
 
 /*
  * 获取一个新的与指定i结点关联的内存i结点结构
@@ -25,45 +26,36 @@ m_inode_t * acquire_inode(uint32_t inum)
 }
 
 /*
- * 在当前操作的文件系统中寻找第一个空闲的磁盘i结点，返回一个与该i结点对应的内存i结点结构指针。
+ * 在当前操作的文件系统中为目录parent下的新文件分配一个空闲的磁盘i结点，返回一个与该i结点对应的内存i结点结构指针。
+ * 先在父目录所在的块组中查找，再依次查找之后的各个块组；
+ * mkfs只向根目录中复制文件，所以不像内核那样把新目录分散到其他块组。
  */
-m_inode_t * alloc_inode(void)
+m_inode_t * alloc_inode(uint32_t parent)
 {
-	uint8_t mask;
-	uint8_t sector[BLOCK_SIZE];
+	static uint32_t cursors[MAX_BLOCK_GROUPS]; //各块组中下一次分配i节点时开始查找的位置
+	uint32_t first = GROUP_OF_INODE(parent, global_sb) % global_sb.groups;
+	uint32_t g;
+	int64_t inum;
 
-	for(uint32_t b = 0; b < global_sb.block_number; b += BITS_PER_BLOCK)
+	for(uint32_t i = 0; i < global_sb.groups; i++)
 	{
-		/* 读取disk inode bitmap中b这个bit所在block */
-		if(raw_read(global_fd, SNUM_OF_INODE_BITMAP(b, global_sb), sector, sizeof(sector)) == -1)
-		{
-			printf("alloc_inode: read inode bitmap error\n");
-			return NULL;
-		}
-		
-		for(uint32_t bi = 0; bi < BITS_PER_BLOCK && b+bi < global_sb.block_number; bi++)
-		{
-			mask = 1 << (bi % 8);
-			if((sector[bi / 8] & mask) == 0)
-			{
-				/* 此时找到了一个空闲bit */
-				sector[bi / 8] |= mask;
-
-				/* 写回位图 */
-				if(raw_write(global_fd, SNUM_OF_INODE_BITMAP(b+bi, global_sb), sector, sizeof(sector)) == -1)
-				{
-					printf("alloc_inode: write inode bitmap error\n");
-					return NULL;
-				}
-				
-				return acquire_inode(b+bi);
-			}
-		}
+		g = (first + i) % global_sb.groups;
+		if((inum = alloc_bit(global_fd, SNUM_OF_INODE_BITMAP(g * global_sb.inodes_per_group, global_sb),
+						global_sb.inodes_per_group, &cursors[g])) >= 0)
+			return acquire_inode(g * global_sb.inodes_per_group + (uint32_t)inum);
 	}
 	printf("alloc_inode: no free inodes\n");
 	return NULL;
 }
 
+/*
+ * i节点所在块组中的第一个block，作为该i节点还没有数据块时的分配目标
+ */
+static uint32_t inode_goal(m_inode_t * ip)
+{
+	return GROUP_OF_INODE(ip->inum, *(ip->sb)) * ip->sb->blocks_per_group;
+}
+
 /*
  * 读取磁盘i结点到内存i结点结构中，成功返回0，失败返回-1。
  */
@@ -82,7 +74,8 @@ int32_t get_inode(m_inode_t * ip)
 	/* 定位到该inode位置 */
 	dip = (disk_inode_t *)buf + ip->inum % INODES_PER_BLOCK;
 	/* 读取 */
-	ip->type = dip->type;
+	ip->type = dip->type & INODE_TYPE_MASK;
+	ip->iflags = dip->type & ~INODE_TYPE_MASK;
 	ip->major = dip->major;
 	ip->minor = dip->minor;
 	ip->link_number = dip->link_number;
@@ -110,7 +103,7 @@ int32_t update_inode(m_inode_t * ip)
 	/* 定位到该inode位置 */
 	dip = (disk_inode_t *)buf + ip->inum % INODES_PER_BLOCK;
 	/* 写入 */
-	dip->type = ip->type;
+	dip->type = ip->type | ip->iflags;
 	dip->major = ip->major;
 	dip->minor = ip->minor;
 	dip->link_number = ip->link_number;
@@ -125,6 +118,186 @@ int32_t update_inode(m_inode_t * ip)
 	return 0;
 }
 
+/*
+ * 在extent映射的i节点中查找第n个逻辑块对应的数据块号，成功返回0并设置*bnum（尚未映射时为0），失败返回-1。
+ */
+static int32_t extent_lookup(m_inode_t * ip, uint32_t n, uint32_t * bnum)
+{
+	uint8_t buf[BLOCK_SIZE];
+	void * node = ip->addrs;
+	extent_t * e;
+	int32_t i;
+
+	*bnum = 0;
+	while((i = ext_search(node, n)) >= 0 && ext_header(node)->depth > 0)
+	{
+		if(raw_read(ip->fd, SNUM_OF_BLOCK(ext_entries(node)[i].start, *(ip->sb)), buf, BLOCK_SIZE) != 0
+				|| ! ext_check_node(buf, EXTENT_NODE_NUMBER))
+		{
+			printf("extent_lookup: read extent node failed\n");
+			return -1;
+		}
+		node = buf;
+	}
+
+	if(i >= 0 && ext_header(node)->depth == 0)
+	{
+		e = &ext_entries(node)[i];
+		if(n - e->block < e->len)
+			*bnum = e->start + (n - e->block);
+	}
+	return 0;
+}
+
+/*
+ * 为extent映射的i节点的第n个逻辑块（尚未映射）分配一个清零过的数据块，返回其块号，失败返回_NAVL_BLK_NUM_。
+ * 新分配的块紧接着前一个或后一个extent时直接延长该extent；否则插入新的extent，
+ * 节点已满时分裂，树根已满时将其中的项移到新节点中并增加树的深度。
+ */
+static uint32_t extent_insert(m_inode_t * ip, uint32_t n)
+{
+	static uint8_t bufs[EXTENT_MAX_DEPTH + 1][BLOCK_SIZE]; //路径上的节点，第0层为树根，位于i节点中
+	uint8_t nbuf[BLOCK_SIZE];
+	void * nodes[EXTENT_MAX_DEPTH + 1];
+	uint32_t snums[EXTENT_MAX_DEPTH + 1];
+	int32_t idx[EXTENT_MAX_DEPTH + 1];
+	uint32_t dirty = 0; //被修改的节点，第d位对应第d层
+	uint32_t depth = ext_header(ip->addrs)->depth;
+	uint32_t d, bnum, nb, block, start, goal;
+	uint16_t keep;
+	int32_t i, pos;
+	extent_t * e;
+
+	/* 从树根向下找到n所在的叶子节点 */
+	nodes[0] = ip->addrs;
+	for(d = 0; d < depth; d++)
+	{
+		e = ext_entries(nodes[d]);
+		if((i = ext_search(nodes[d], n)) < 0)
+		{
+			/* n小于所有子树中的逻辑块号，将其放入最左边的子树 */
+			i = 0;
+			e[0].block = n;
+			dirty |= 1 << d;
+		}
+		idx[d] = i;
+		snums[d + 1] = SNUM_OF_BLOCK(e[i].start, *(ip->sb));
+		nodes[d + 1] = bufs[d + 1];
+		if(raw_read(ip->fd, snums[d + 1], bufs[d + 1], BLOCK_SIZE) != 0 || ! ext_check_node(bufs[d + 1], EXTENT_NODE_NUMBER))
+		{
+			printf("extent_insert: read extent node failed\n");
+			return _NAVL_BLK_NUM_;
+		}
+	}
+
+	e = ext_entries(nodes[depth]);
+	i = ext_search(nodes[depth], n);
+	/* 尽量使逻辑上相邻的块在磁盘上也相邻 */
+	if(i >= 0)
+		goal = e[i].start + (n - e[i].block);
+	else if(ext_header(nodes[depth])->entries > 0 && e[0].start > e[0].block - n)
+		goal = e[0].start - (e[0].block - n);
+	else
+		goal = inode_goal(ip);
+	if((bnum = alloc_block(ip->fd, ip->sb, goal)) == _NAVL_BLK_NUM_)
+	{
+		printf("extent_insert: alloc block failed\n");
+		return _NAVL_BLK_NUM_;
+	}
+
+	if(i >= 0 && e[i].block + e[i].len == n && e[i].start + e[i].len == bnum)
+	{
+		/* 紧接在前一个extent之后 */
+		e[i].len++;
+		dirty |= 1 << depth;
+		goto out;
+	}
+	if(i + 1 < ext_header(nodes[depth])->entries && e[i + 1].block == n + 1 && e[i + 1].start == bnum + 1)
+	{
+		/* 紧接在后一个extent之前 */
+		e[i + 1].block--;
+		e[i + 1].start--;
+		e[i + 1].len++;
+		dirty |= 1 << depth;
+		goto out;
+	}
+
+	/* 插入新的extent，必要时逐层向上分裂 */
+	block = n;
+	start = bnum;
+	pos = i + 1;
+	for(d = depth; ; d--)
+	{
+		if(ext_header(nodes[d])->entries < (d == 0 ? EXTENT_ROOT_NUMBER : EXTENT_NODE_NUMBER))
+		{
+			ext_insert_at(nodes[d], pos, block, start, d == depth ? 1 : 0);
+			dirty |= 1 << d;
+			break;
+		}
+
+		if((nb = alloc_block(ip->fd, ip->sb, inode_goal(ip))) == _NAVL_BLK_NUM_)
+		{
+			printf("extent_insert: alloc extent node failed\n");
+			return _NAVL_BLK_NUM_;
+		}
+		memset(nbuf, 0, sizeof(nbuf));
+		ext_init_node(nbuf, EXTENT_NODE_NUMBER, ext_header(nodes[d])->depth);
+
+		if(d == 0)
+		{
+			/* 树根已满：将其中的项移到新节点中，树根只保留指向新节点的一项 */
+			if(depth == EXTENT_MAX_DEPTH)
+			{
+				printf("extent_insert: extent tree is too deep\n");
+				return _NAVL_BLK_NUM_;
+			}
+			ext_copy(nodes[0], nbuf);
+			ext_insert_at(nbuf, pos, block, start, d == depth ? 1 : 0);
+			ext_header(nodes[0])->entries = 0;
+			ext_header(nodes[0])->depth++;
+			ext_insert_at(nodes[0], 0, ext_entries(nbuf)[0].block, nb, 0);
+			dirty |= 1;
+		}
+		else
+		{
+			/* 节点已满：将后一半的项移到新节点中，再把新节点插入父节点 */
+			ext_split(nodes[d], nbuf);
+			keep = ext_header(nodes[d])->entries;
+			if(pos > keep)
+				ext_insert_at(nbuf, pos - keep, block, start, d == depth ? 1 : 0);
+			else
+				ext_insert_at(nodes[d], pos, block, start, d == depth ? 1 : 0);
+			dirty |= 1 << d;
+			block = ext_entries(nbuf)[0].block;
+			start = nb;
+			pos = idx[d - 1] + 1;
+		}
+		if(raw_write(ip->fd, SNUM_OF_BLOCK(nb, *(ip->sb)), nbuf, BLOCK_SIZE) != 0)
+		{
+			printf("extent_insert: write extent node failed\n");
+			return _NAVL_BLK_NUM_;
+		}
+		if(d == 0)
+			break;
+	}
+
+out:
+	for(d = 1; d <= depth; d++)
+	{
+		if((dirty & (1 << d)) && raw_write(ip->fd, snums[d], bufs[d], BLOCK_SIZE) != 0)
+		{
+			printf("extent_insert: write extent node failed\n");
+			return _NAVL_BLK_NUM_;
+		}
+	}
+	if((dirty & 1) && update_inode(ip) != 0)
+	{
+		printf("extent_insert: update inode failed\n");
+		return _NAVL_BLK_NUM_;
+	}
+	return bnum;
+}
+
 /*
  * 查找i结点所关联的第n个block，如果不存在则分配新的清零过的block并建立必要的映射，
  * 然后返回其扇区编号，n从0计算。
@@ -138,13 +311,23 @@ uint32_t get_inode_map(m_inode_t * ip, uint32_t n)
 	uint32_t * dp;
 
 
+	if(ip->iflags & INODE_EXTENT_FL)
+	{
+		if(extent_lookup(ip, n, &bnum) != 0)
+			return 0;
+		if(bnum == 0 && (bnum = extent_insert(ip, n)) == _NAVL_BLK_NUM_)
+			return 0;
+		return SNUM_OF_BLOCK(bnum, *(ip->sb));
+	}
+
 	if(n < DIRECT_BLOCK_NUMBER)
 	{
 		/* 在直接索引范围内 */
 		if((bnum = ip->addrs[n]) >= ip->sb->block_number || bnum == 0)
 		{
-			/* 但是n指定的索引无效 */
-			bnum = ip->addrs[n] = alloc_block(ip->fd, ip->sb);
+			/* 但是n指定的索引无效，尽量紧接着前一个数据块分配 */
+			bnum = n > 0 ? ip->addrs[n - 1] : 0;
+			bnum = ip->addrs[n] = alloc_block(ip->fd, ip->sb, bnum != 0 ? bnum + 1 : inode_goal(ip));
 			if(bnum == _NAVL_BLK_NUM_)
 			{
 				printf("get_inode_map: alloc zeroed block failed\n");
@@ -170,7 +353,8 @@ uint32_t get_inode_map(m_inode_t * ip, uint32_t n)
 		if(ip->addrs[DIRECT_BLOCK_NUMBER] >= ip->sb->block_number || ip->addrs[DIRECT_BLOCK_NUMBER] == 0)
 		{
 			/* 但是不存在间接索引块 */
-			ip->addrs[DIRECT_BLOCK_NUMBER] = alloc_block(ip->fd, ip->sb);
+			bnum = ip->addrs[DIRECT_BLOCK_NUMBER - 1];
+			ip->addrs[DIRECT_BLOCK_NUMBER] = alloc_block(ip->fd, ip->sb, bnum != 0 ? bnum + 1 : inode_goal(ip));
 			if(ip->addrs[DIRECT_BLOCK_NUMBER] == _NAVL_BLK_NUM_)
 			{
 				printf("get_inode_map: alloc indirect index block failed\n");
@@ -191,8 +375,9 @@ uint32_t get_inode_map(m_inode_t * ip, uint32_t n)
 		dp = (uint32_t *)buf;
 		if((bnum = dp[n]) >= ip->sb->block_number || bnum == 0)
 		{
-			/* 但n指定的索引无效 */
-			bnum = dp[n] = alloc_block(ip->fd, ip->sb);
+			/* 但n指定的索引无效，尽量紧接着前一个数据块分配 */
+			bnum = n > 0 ? dp[n - 1] : ip->addrs[DIRECT_BLOCK_NUMBER];
+			bnum = dp[n] = alloc_block(ip->fd, ip->sb, bnum + 1);
 			if(bnum == _NAVL_BLK_NUM_)
 			{
 				printf("get_inode_map: alloc block failed\n");
@@ -222,8 +407,8 @@ uint32_t get_inode_map(m_inode_t * ip, uint32_t n)
  * n: 读取的字节数
  *
  * 注意：
- * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，最大文件仅为70KB，
- * 这里返回值使用有符号类型（为能区别错误值），但仍能满足使用，使用时需要注意。
+ * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，间接索引的文件最大仅为70KB，
+ * extent映射的文件最大为MAX_EXTENT_FILE_SIZE，这里返回值使用有符号类型（为能区别错误值），但仍能满足使用，使用时需要注意。
  * 设备类型的i结点会如同普通文件/目录类型的i节点一样被操作。
  */
 int32_t read_inode(m_inode_t * ip, void * dst, uint32_t off, uint32_t n)
@@ -271,7 +456,7 @@ int32_t read_inode(m_inode_t * ip, void * dst, uint32_t off, uint32_t n)
  *
  * 注意：
  * 当写入出错时（比如off/n有误、写入数据会超出最大文件大小）返回-1。
- * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，最大文件仅为70KB，这里返回值使用有符号类型（为能区别错误值），但仍能满足使用，使用时需要注意。
+ * 在磁盘i结点结构定义中size成员为无符号的，但实际受限于设计，间接索引的文件最大仅为70KB，extent映射的文件最大为MAX_EXTENT_FILE_SIZE，这里返回值使用有符号类型（为能区别错误值），但仍能满足使用，使用时需要注意。
  * 设备类型的i结点会如同普通文件/目录类型的i节点一样被操作。
  */
 int32_t write_inode(m_inode_t * ip, void * src, uint32_t off, uint32_t n)
@@ -279,14 +464,15 @@ int32_t write_inode(m_inode_t * ip, void * src, uint32_t off, uint32_t n)
 	int32_t actual_write_bytes;
 	uint8_t buf[BLOCK_SIZE];
 	uint32_t m;
+	uint32_t max_size = (ip->iflags & INODE_EXTENT_FL) ? MAX_EXTENT_FILE_SIZE : MAX_FILE_SIZE;
 
 	/* 写入文件时不能超出文件最大大小 */
-	if(off > MAX_FILE_SIZE || off + n < off)
+	if(off > max_size || off + n < off)
 	{
 		printf("write_inode: arguments error\n");
 		return -1;
 	}
-	if(off + n > MAX_FILE_SIZE)
+	if(off + n > max_size)
 	{
 		printf("write_inode: exceed MAX_FILE_SIZE\n");
 		return -1;
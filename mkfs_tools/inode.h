@@ -2,7 +2,7 @@
 #define _INCLUDE_INODE_H_
 
 #include <stdint.h>
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 
 /* 内存i节点定义 */
 typedef struct{
@@ -15,13 +15,14 @@ typedef struct{
 	uint16_t major;		//当inode指代设备时，使用major/minor指定何种设备
 	uint16_t minor;
 	uint16_t link_number;	//多少个目录项指向了该inode
+	uint16_t iflags;	//磁盘i节点type成员中的标志
 	uint32_t size;		//文件大小，字节单位
-	uint32_t addrs[DIRECT_BLOCK_NUMBER + 1]; //与该inode相关的数据块索引，最后一个作为间接索引
+	uint32_t addrs[DIRECT_BLOCK_NUMBER + 1]; //与该inode相关的数据块索引，最后一个作为间接索引；INODE_EXTENT_FL时为extent树根
 } m_inode_t;
 
 m_inode_t * acquire_inode(uint32_t inum);
 
-m_inode_t * alloc_inode(void);
+m_inode_t * alloc_inode(uint32_t parent);
 
 int32_t get_inode(m_inode_t * ip);
 
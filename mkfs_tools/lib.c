@@ -5,7 +5,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 #include "lib.h"
 
 /*
@@ -39,5 +39,15 @@ int32_t raw_write(int fd, uint32_t snum, void * buf, size_t size)
  */
 int32_t read_sb(int fd, super_block_t * sb)
 {
-	return raw_read(fd, 1, sb, sizeof(*sb));
+	if(raw_read(fd, 1, sb, sizeof(*sb)) == -1)
+		return -1;
+
+	/* 旧格式的文件系统视为只有一个块组 */
+	if(sb->groups == 0)
+	{
+		sb->groups = 1;
+		sb->inodes_per_group = sb->inode_number;
+		sb->blocks_per_group = sb->block_number;
+	}
+	return 0;
 }
@@ -2,7 +2,7 @@
 #define _INCLUDE_LIB_H_
 
 #include <stdint.h>
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 
 int32_t read_sb(int fd, super_block_t * sb);
 
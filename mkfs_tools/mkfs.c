@@ -7,7 +7,9 @@
 #include <sys/stat.h>
 
 #include "./extvars.h"
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
+#include "../include/extent.h"
+#include "../include/bitmap.h"
 #include "./lib.h"
 #include "./block.h"
 #include "./inode.h"
@@ -21,43 +23,29 @@
 int global_fd; //引用当前正在处理的文件
 super_block_t global_sb; //当前文件系统中的超级块
 
+/* 每个块组的block数为BITS_PER_BLOCK的倍数，每BLOCKS_PER_INODE个block对应一个i节点 */
+#define BLOCKS_PER_INODE	64
+
 /*
- * 在fd的当前偏移处构建bitmap，该bitmap占据blks_bitmap个块，其中有avl_bits个bit被置为0，其余置为1，小端字节序写入。
- * fd必须是可写的。
- * 注意：这里假设avl_bits大于(blks_bitmap-1)*BLOCK_SIZE 且小于等于blks_bitmap*BLOCK_SIZE
+ * 从start_sector开始构建bitmap，该bitmap占据blks_bitmap个块，其中前avl_bits个bit被置为0，其余置为1，小端字节序写入。
+ * fd必须是可写的，avl_bits不超过blks_bitmap*BITS_PER_BLOCK。
  * 成功返回0，失败返回-1。
  */
-static int32_t build_bitmap(int fd, uint32_t blks_bitmap, uint32_t avl_bits)
+static int32_t build_bitmap(int fd, uint32_t start_sector, uint32_t blks_bitmap, uint32_t avl_bits)
 {
-	uint8_t sector[BLOCK_SIZE];
-	memset(sector, 0, sizeof(sector));
+	uint32_t map[BLOCK_SIZE / sizeof(uint32_t)];
 
-	for(uint32_t i = 0; i < blks_bitmap - 1; i++)
-		if(write(fd, sector, sizeof(sector)) != sizeof(sector))
+	for(uint32_t i = 0; i < blks_bitmap; i++)
+	{
+		memset(map, 0, sizeof(map));
+		for(uint32_t bi = 0; bi < BITS_PER_BLOCK; bi++)
+			if(i * BITS_PER_BLOCK + bi >= avl_bits)
+				bitmap_set(map, bi); //从低位开始构建，和搜索方法一致
+		if(raw_write(fd, start_sector + i, map, sizeof(map)) == -1)
 		{
 			printf("build_bitmap: write error\n");
 			return -1;
 		}
-	if(avl_bits % BITS_PER_BLOCK != 0)
-	{
-		uint32_t zero_byte_count = (avl_bits % BITS_PER_BLOCK) / 8;
-		for(uint32_t i = 0; i < zero_byte_count; i++)
-			sector[i] = 0;
-		if((avl_bits % BITS_PER_BLOCK) % 8 == 0)
-			for(uint32_t i = zero_byte_count; i < BLOCK_SIZE; i++)
-				sector[i] = 0xFF;
-		else
-		{
-			uint8_t mask = 0xFF << ((avl_bits % BITS_PER_BLOCK) % 8); //从低位开始构建，和搜索方法一致
-			sector[zero_byte_count] = mask;
-			for(uint32_t i = zero_byte_count + 1; i < BLOCK_SIZE; i++)
-				sector[i] = 0xFF;
-		}
-	}
-	if(write(fd, sector, sizeof(sector)) != sizeof(sector))
-	{
-		printf("build_bitmap: write error\n");
-		return -1;
 	}
 
 	return 0;
@@ -67,11 +55,16 @@ static int32_t build_bitmap(int fd, uint32_t blks_bitmap, uint32_t avl_bits)
  * 在指定文件上创建一个空的、符合格式的文件系统。
  * fd必须引用一个为可读可写方式打开的文件，且长度为512字节的倍数
  * 成功返回0，失败返回-1。
+ *
+ * 文件系统被划分为若干个块组，每个块组包含blocks_per_group个block和blocks_per_group/BLOCKS_PER_INODE个i节点；
+ * 文件很大时增大块组使块组数不超过MAX_BLOCK_GROUPS，不足一个块组时按其大小缩小块组；
+ * 最后剩余的空间放不下一个完整块组时作为一个较小的块组。
  */
 int32_t make_fs(int fd)
 {
 	struct stat st;
 	super_block_t sb;
+	uint32_t sectors, meta, rest;
 
 	if(fstat(fd, &st) == -1)
 	{
@@ -84,33 +77,53 @@ int32_t make_fs(int fd)
 		return -1;
 	}
 	
-	/* 计算可用于分配的磁盘i节点总数 */
-	sb.inode_number = (uint32_t)((st.st_size*8 - 2*8*BLOCK_SIZE)/(1 + 64 + 8*sizeof(disk_inode_t) + 512*BLOCK_SIZE));
-	
-	/* 计算inode bitmap占用的块数 */
-	sb.blks_ibitmap = UPPER_DIVIDE(sb.inode_number, BITS_PER_BLOCK);
-	
-	/* 计算block bitmap占用的块数 */
-	sb.blks_bbitmap = UPPER_DIVIDE(64*sb.inode_number, BITS_PER_BLOCK);
-
-	/* 计算i节点占用的块数 */
-	sb.blks_inode = UPPER_DIVIDE(sb.inode_number, INODES_PER_BLOCK);
+	/* 除引导扇区和超级块之外可用于块组的sector数 */
+	sectors = (uint32_t)(st.st_size/BLOCK_SIZE - 2);
+
+	/* 计算块组大小 */
+	sb.blks_bbitmap = 1;
+	while(sectors / (sb.blks_bbitmap * BITS_PER_BLOCK) >= MAX_BLOCK_GROUPS)
+		sb.blks_bbitmap++;
+	sb.blocks_per_group = sb.blks_bbitmap * BITS_PER_BLOCK;
+	sb.inodes_per_group = sb.blocks_per_group / BLOCKS_PER_INODE;
+	sb.blks_ibitmap = UPPER_DIVIDE(sb.inodes_per_group, BITS_PER_BLOCK);
+	sb.blks_inode = sb.inodes_per_group / INODES_PER_BLOCK;
+
+	if(sectors < GROUP_SECTORS(sb))
+	{
+		/* 不足一个块组，按照其大小计算i节点数 */
+		sb.inodes_per_group = UPPER_DIVIDE(sectors / (BLOCKS_PER_INODE + 1), INODES_PER_BLOCK) * INODES_PER_BLOCK;
+		if(sb.inodes_per_group == 0)
+			sb.inodes_per_group = INODES_PER_BLOCK;
+		sb.blks_ibitmap = sb.blks_bbitmap = 1;
+		sb.blks_inode = sb.inodes_per_group / INODES_PER_BLOCK;
+		sb.blocks_per_group = sectors - sb.blks_ibitmap - sb.blks_bbitmap - sb.blks_inode;
+	}
 
-	/* 计算可用于分配的数据块数 */
-	sb.block_number = (uint32_t)(st.st_size/BLOCK_SIZE - 2 - sb.blks_ibitmap - sb.blks_bbitmap - sb.blks_inode);
-	if(sb.block_number > sb.blks_bbitmap * BITS_PER_BLOCK)
+	/* 计算块组数，剩余部分还能容纳数据块时作为最后一个块组 */
+	meta = sb.blks_ibitmap + sb.blks_bbitmap + sb.blks_inode;
+	sb.groups = sectors / GROUP_SECTORS(sb);
+	rest = sectors % GROUP_SECTORS(sb);
+	sb.block_number = sb.groups * sb.blocks_per_group;
+	if(rest > meta)
 	{
-		uint32_t count = sb.block_number - sb.blks_bbitmap * BITS_PER_BLOCK;
-		count = UPPER_DIVIDE(count, BITS_PER_BLOCK);
-		
-		sb.block_number -= count;
-		sb.blks_bbitmap += count;
+		sb.groups++;
+		sb.block_number += rest - meta;
 	}
+	sb.inode_number = sb.groups * sb.inodes_per_group;
+
+	/* 0号block保留，其余都是空闲的 */
+	sb.free_inodes = sb.inode_number;
+	sb.free_blocks = sb.block_number - 1;
 
-	printf("blks_ibitmap: %u, blks_bbitmap: %u, blks_inode: %u, inode_number: %u, block_number: %u\n",
+	printf("groups: %u, blks_ibitmap: %u, blks_bbitmap: %u, blks_inode: %u, inodes_per_group: %u, blocks_per_group: %u, "
+			"inode_number: %u, block_number: %u\n",
+			(unsigned int)sb.groups,
 			(unsigned int)sb.blks_ibitmap,
 			(unsigned int)sb.blks_bbitmap,
 			(unsigned int)sb.blks_inode,
+			(unsigned int)sb.inodes_per_group,
+			(unsigned int)sb.blocks_per_group,
 			(unsigned int)sb.inode_number,
 			(unsigned int)sb.block_number);
 
@@ -127,22 +140,20 @@ int32_t make_fs(int fd)
 		return -1;
 	}
 	
-	/* 偏移到第一个bitmap起始处 */
-	if(lseek(fd, BLOCK_SIZE * 2, SEEK_SET) < 0)
+	/* 写入各块组的两个bitmap */
+	for(uint32_t g = 0; g < sb.groups; g++)
 	{
-		printf("make_fs: seek to bitmap error\n");
-		return -1;
-	}
-	/* 写入两个bitmap */
-	if( ! (build_bitmap(fd, sb.blks_ibitmap, sb.inode_number) == 0 && build_bitmap(fd, sb.blks_bbitmap, sb.block_number) == 0))
-	{
-		printf("make_fs: built_bitmap error\n");
-		return -1;
+		if( ! (build_bitmap(fd, SNUM_OF_INODE_BITMAP(g * sb.inodes_per_group, sb), sb.blks_ibitmap, sb.inodes_per_group) == 0
+					&& build_bitmap(fd, SNUM_OF_BLK_BITMAP(g * sb.blocks_per_group, sb), sb.blks_bbitmap, GROUP_BLOCKS(g, sb)) == 0))
+		{
+			printf("make_fs: built_bitmap error\n");
+			return -1;
+		}
 	}
 
 	/* 0号block保留 */
 	/* 第一次分配，成功时必定分配0号block */
-	if(alloc_block(fd, &sb) != 0 )
+	if(alloc_block(fd, &sb, 0) != 0 )
 	{
 		printf("make_fs: can not set block 0 to reserved\n");
 		return -1;
@@ -152,6 +163,59 @@ int32_t make_fs(int fd)
 
 }
 
+/*
+ * 统计从start_sector开始的位图中前nbits个bit中为0的个数，失败返回-1
+ */
+static int64_t count_free_bits(int fd, uint32_t start_sector, uint32_t nbits)
+{
+	uint32_t map[BLOCK_SIZE / sizeof(uint32_t)];
+	int64_t count = 0;
+
+	for(uint32_t b = 0; b < nbits; b += BITS_PER_BLOCK)
+	{
+		if(raw_read(fd, start_sector + b / BITS_PER_BLOCK, map, sizeof(map)) == -1)
+			return -1;
+		count += bitmap_count_zero(map, min(BITS_PER_BLOCK, nbits - b));
+	}
+	return count;
+}
+
+/*
+ * 根据位图重新统计超级块中的空闲计数并写回，成功返回0，失败返回-1。
+ */
+static int32_t update_free_counts(int fd, super_block_t * sb)
+{
+	uint8_t sector[BLOCK_SIZE];
+	int64_t free_inodes, free_blocks;
+
+	sb->free_inodes = sb->free_blocks = 0;
+	for(uint32_t g = 0; g < sb->groups; g++)
+	{
+		free_inodes = count_free_bits(fd, SNUM_OF_INODE_BITMAP(g * sb->inodes_per_group, *sb), sb->inodes_per_group);
+		free_blocks = count_free_bits(fd, SNUM_OF_BLK_BITMAP(g * sb->blocks_per_group, *sb), GROUP_BLOCKS(g, *sb));
+		if(free_inodes < 0 || free_blocks < 0)
+		{
+			printf("update_free_counts: read bitmap error\n");
+			return -1;
+		}
+		sb->free_inodes += (uint32_t)free_inodes;
+		sb->free_blocks += (uint32_t)free_blocks;
+	}
+
+	if(raw_read(fd, 1, sector, sizeof(sector)) == -1)
+	{
+		printf("update_free_counts: read super-block error\n");
+		return -1;
+	}
+	memcpy(sector, sb, sizeof(*sb));
+	if(raw_write(fd, 1, sector, sizeof(sector)) == -1)
+	{
+		printf("update_free_counts: write super-block error\n");
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * 将path指定文件复制到目录dp下，其文件名与path中给出的文件名相同
  * 成功返回0，失败返回-1。
@@ -261,7 +325,7 @@ int main(int argc, char * argv[])
 	}
 
 	/* 创建根目录 */
-	if((rip = alloc_inode()) == NULL || rip->inum != 0)
+	if((rip = alloc_inode(ROOT_INUM)) == NULL || rip->inum != ROOT_INUM)
 	{
 		printf("main: alloc inode for root dir failed\n");
 		return -1;
@@ -269,7 +333,8 @@ int main(int argc, char * argv[])
 	rip->type = DIR_INODE;
 	rip->link_number = 2;
 	rip->size = rip->major = rip->minor = 0;
-	memset(rip->addrs, 0, sizeof(rip->addrs));
+	rip->iflags = INODE_EXTENT_FL;
+	ext_init_node(rip->addrs, EXTENT_ROOT_NUMBER, 0);
 
 	if(add_link(rip, ".", rip->inum) == -1 || add_link(rip, "..", rip->inum) == -1)
 	{
@@ -295,6 +360,12 @@ int main(int argc, char * argv[])
 		printf("main: copy `%s' success\n", argv[i]);
 	}
 
+	if(update_free_counts(global_fd, &global_sb) == -1)
+	{
+		printf("main: update free counts failed\n");
+		return -1;
+	}
+
 
 	close(global_fd);
 	free(rip);
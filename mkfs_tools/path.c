@@ -3,7 +3,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-#include "../tryos/include/fs.h"
+#include "../include/fs.h"
 #include "./inode.h"
 
 /*
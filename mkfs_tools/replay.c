@@ -0,0 +1,523 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "./extvars.h"
+#include "../include/fs.h"
+#include "../include/blk_trace.h"
+#include "../include/parameters.h"
+#include "./lib.h"
+#include "./inode.h"
+#include "./path.h"
+
+/*
+ * 块I/O跟踪回放工具：读取内核blktrace命令保存的跟踪记录，
+ * 1. 用块缓冲访问记录模拟不同大小、不同替换策略的块缓冲，输出命中率；
+ * 2. 用设备请求记录模拟FIFO和C-LOOK调度，输出寻道距离和平均响应时间；
+ * 3. 将设备读请求按顺序在磁盘映像上重新读取一遍，输出耗时。
+ */
+
+extern char * optarg;
+extern int optind, opterr, optopt;
+
+
+/* 全局的fd变量/超级块结构体 */
+int global_fd; //引用当前正在处理的文件
+super_block_t global_sb; //当前文件系统中的超级块
+
+/* 模拟的块缓冲替换策略 */
+#define SIM_LRU		0
+#define SIM_FIFO	1
+#define SIM_2Q		2
+
+/* 模拟块缓冲中的队列：LRU/FIFO只使用SIM_Q_MAIN，2Q中SIM_Q_MAIN为Am */
+#define SIM_Q_MAIN	0
+#define SIM_Q_A1IN	1
+#define SIM_Q_A1OUT	2
+#define SIM_Q_NONE	3
+
+#define SIM_HASH_SIZE	4099
+
+/* 默认模拟的块缓冲大小 */
+#define MAX_SIM_SIZES	16
+static uint32_t default_sizes[] = {64, 256, 1024, BUF_MAX_COUNT};
+
+typedef struct sim_ent {
+	uint32_t dev;
+	uint32_t sector;
+	uint32_t queue;
+	struct sim_ent * hnext;
+	struct sim_ent * prev; //队列中，prev靠近头部（最近加入/使用）
+	struct sim_ent * next;
+} sim_ent_t;
+
+typedef struct {
+	sim_ent_t * head;
+	sim_ent_t * tail;
+	uint32_t count;
+} sim_list_t;
+
+/* 模拟的块缓冲 */
+typedef struct {
+	uint32_t policy;
+	uint32_t size; //能cache的块数
+	uint32_t a1in_max; //2Q中A1in最多的块数
+	uint32_t a1out_max; //2Q中A1out最多记录的块数
+	sim_ent_t * ents;
+	sim_ent_t * free;
+	sim_ent_t * hash[SIM_HASH_SIZE];
+	sim_list_t q[3];
+	uint32_t hits;
+	uint32_t misses;
+} sim_cache_t;
+
+
+static void list_remove(sim_list_t * l, sim_ent_t * e)
+{
+	if(e->prev)
+		e->prev->next = e->next;
+	else
+		l->head = e->next;
+	if(e->next)
+		e->next->prev = e->prev;
+	else
+		l->tail = e->prev;
+	l->count--;
+}
+
+
+static void list_push(sim_list_t * l, sim_ent_t * e)
+{
+	e->prev = NULL;
+	e->next = l->head;
+	if(l->head)
+		l->head->prev = e;
+	else
+		l->tail = e;
+	l->head = e;
+	l->count++;
+}
+
+
+static inline uint32_t hash_of(uint32_t dev, uint32_t sector)
+{
+	return (sector * 31 + dev) % SIM_HASH_SIZE;
+}
+
+
+static sim_ent_t * sim_lookup(sim_cache_t * c, uint32_t dev, uint32_t sector)
+{
+	sim_ent_t * e;
+
+	for(e = c->hash[hash_of(dev, sector)]; e; e = e->hnext)
+		if(e->dev == dev && e->sector == sector)
+			return e;
+	return NULL;
+}
+
+
+/*
+ * 将e从所在队列和哈希表中移除并释放
+ */
+static void sim_drop(sim_cache_t * c, sim_ent_t * e)
+{
+	sim_ent_t ** pp = &c->hash[hash_of(e->dev, e->sector)];
+
+	while(*pp != e)
+		pp = &(*pp)->hnext;
+	*pp = e->hnext;
+	list_remove(&c->q[e->queue], e);
+	e->queue = SIM_Q_NONE;
+	e->hnext = c->free;
+	c->free = e;
+}
+
+
+/*
+ * 腾出一个块的位置；2Q中A1in超过限额时将其最早的块移入A1out，只记录dev/sector
+ */
+static void sim_reclaim(sim_cache_t * c)
+{
+	sim_ent_t * e;
+
+	if(c->q[SIM_Q_MAIN].count + c->q[SIM_Q_A1IN].count < c->size)
+		return;
+
+	if(c->policy == SIM_2Q && (c->q[SIM_Q_A1IN].count > c->a1in_max || c->q[SIM_Q_MAIN].count == 0))
+	{
+		e = c->q[SIM_Q_A1IN].tail;
+		list_remove(&c->q[SIM_Q_A1IN], e);
+		e->queue = SIM_Q_A1OUT;
+		list_push(&c->q[SIM_Q_A1OUT], e);
+		if(c->q[SIM_Q_A1OUT].count > c->a1out_max)
+			sim_drop(c, c->q[SIM_Q_A1OUT].tail);
+		return;
+	}
+	sim_drop(c, c->q[SIM_Q_MAIN].tail);
+}
+
+
+static void sim_insert(sim_cache_t * c, uint32_t dev, uint32_t sector, uint32_t queue)
+{
+	sim_ent_t * e = c->free;
+	uint32_t h = hash_of(dev, sector);
+
+	c->free = e->hnext;
+	e->dev = dev;
+	e->sector = sector;
+	e->queue = queue;
+	e->hnext = c->hash[h];
+	c->hash[h] = e;
+	list_push(&c->q[queue], e);
+}
+
+
+/*
+ * 模拟对dev/sector的一次访问
+ */
+static void sim_access(sim_cache_t * c, uint32_t dev, uint32_t sector)
+{
+	sim_ent_t * e = sim_lookup(c, dev, sector);
+
+	if(e && e->queue != SIM_Q_A1OUT)
+	{
+		c->hits++;
+		if(e->queue == SIM_Q_MAIN && c->policy != SIM_FIFO)
+		{
+			list_remove(&c->q[SIM_Q_MAIN], e);
+			list_push(&c->q[SIM_Q_MAIN], e);
+		}
+		return;
+	}
+
+	c->misses++;
+	if(e) //A1out中记录过，说明被再次使用，直接加入Am
+	{
+		sim_drop(c, e);
+		sim_reclaim(c);
+		sim_insert(c, dev, sector, SIM_Q_MAIN);
+		return;
+	}
+	sim_reclaim(c);
+	sim_insert(c, dev, sector, c->policy == SIM_2Q ? SIM_Q_A1IN : SIM_Q_MAIN);
+}
+
+
+/*
+ * 用所有块缓冲访问记录模拟一个size块、策略为policy的块缓冲，返回命中率（万分之一为单位）
+ */
+static uint32_t sim_cache(blk_trace_t * recs, uint32_t n, uint32_t policy, uint32_t size)
+{
+	sim_cache_t * c = calloc(1, sizeof(sim_cache_t));
+	uint32_t total = size + size / 2 + 1;
+	uint32_t ratio;
+
+	c->policy = policy;
+	c->size = size;
+	c->a1in_max = size / BUF_A1IN_RATIO;
+	c->a1out_max = size / 2;
+	c->ents = calloc(total, sizeof(sim_ent_t));
+	for(uint32_t i = 0; i < total; i++)
+	{
+		c->ents[i].hnext = c->free;
+		c->free = &c->ents[i];
+	}
+
+	for(uint32_t i = 0; i < n; i++)
+		if(recs[i].flags & BLK_TRACE_ACCESS)
+			sim_access(c, recs[i].dev, recs[i].sector);
+
+	ratio = c->hits + c->misses ? (uint32_t)((uint64_t)c->hits * 10000 / (c->hits + c->misses)) : 0;
+	free(c->ents);
+	free(c);
+	return ratio;
+}
+
+
+/*
+ * 模拟设备dev上的请求在FIFO或C-LOOK调度下的处理过程：
+ * 请求按记录的提交时间到达，每个请求的服务时间取记录中它与前一个完成的请求的完成时间之差（不超过其自身的延迟），
+ * 磁盘空闲时从已到达的请求中按策略选择下一个；输出总寻道距离（扇区）和平均响应时间（时钟周期）。
+ */
+static void sim_sched(blk_trace_t * recs, uint32_t n, uint32_t dev, int clook)
+{
+	blk_trace_t ** reqs = malloc(n * sizeof(blk_trace_t *));
+	uint64_t * svc = malloc(n * sizeof(uint64_t));
+	uint8_t * done = calloc(n, 1);
+	uint32_t count = 0, finished = 0, pos = 0;
+	uint64_t now = 0, seek = 0, resp = 0, last_complete = 0;
+
+	/* 按完成时间排列的设备请求，记录中设备请求本来就是按完成顺序写入的 */
+	for(uint32_t i = 0; i < n; i++)
+		if( ! (recs[i].flags & BLK_TRACE_ACCESS) && recs[i].dev == dev)
+			reqs[count++] = &recs[i];
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uint64_t start = reqs[i]->submit > last_complete ? reqs[i]->submit : last_complete;
+		svc[i] = reqs[i]->complete - start;
+		last_complete = reqs[i]->complete;
+	}
+
+	while(finished < count)
+	{
+		int32_t pick = -1, first = -1;
+
+		/* 从已到达（提交时间不晚于now）的请求中选择 */
+		for(uint32_t i = 0; i < count; i++)
+		{
+			if(done[i] || reqs[i]->submit > now)
+				continue;
+			if( ! clook)
+			{
+				if(pick < 0 || reqs[i]->submit < reqs[pick]->submit)
+					pick = (int32_t)i;
+				continue;
+			}
+			if(reqs[i]->sector >= pos && (pick < 0 || reqs[i]->sector < reqs[pick]->sector))
+				pick = (int32_t)i;
+			if(first < 0 || reqs[i]->sector < reqs[first]->sector)
+				first = (int32_t)i;
+		}
+		if(pick < 0)
+			pick = first;
+		if(pick < 0) //磁盘空闲，等待下一个最早提交的请求
+		{
+			uint64_t next = UINT64_MAX;
+			for(uint32_t i = 0; i < count; i++)
+				if( ! done[i] && reqs[i]->submit < next)
+					next = reqs[i]->submit;
+			now = next;
+			continue;
+		}
+
+		seek += reqs[pick]->sector > pos ? reqs[pick]->sector - pos : pos - reqs[pick]->sector;
+		pos = reqs[pick]->sector;
+		now += svc[pick];
+		resp += now - reqs[pick]->submit;
+		done[pick] = 1;
+		finished++;
+	}
+
+	printf("  %-6s seek %llu sectors, avg response %llu cycles\n", clook ? "clook" : "fifo",
+			(unsigned long long)seek, count ? (unsigned long long)(resp / count) : 0ULL);
+	free(reqs);
+	free(svc);
+	free(done);
+}
+
+
+/*
+ * 在磁盘映像fd上按顺序重新读取设备dev的所有读请求，写请求不会被重放
+ */
+static void replay_reads(int fd, blk_trace_t * recs, uint32_t n, uint32_t dev)
+{
+	char buf[BLOCK_SIZE];
+	struct timespec t0, t1;
+	uint32_t reads = 0, skipped = 0;
+	uint64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(uint32_t i = 0; i < n; i++)
+	{
+		if((recs[i].flags & BLK_TRACE_ACCESS) || recs[i].dev != dev)
+			continue;
+		if(recs[i].flags & BLK_TRACE_WRITE)
+		{
+			skipped++;
+			continue;
+		}
+		if(pread(fd, buf, BLOCK_SIZE, (off_t)recs[i].sector * BLOCK_SIZE) != BLOCK_SIZE)
+		{
+			printf("replay_reads: read sector %u failed\n", (unsigned int)recs[i].sector);
+			return;
+		}
+		reads++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ULL + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+	printf("replay: %u reads in %llu us (%llu ns each), %u writes skipped\n", (unsigned int)reads,
+			(unsigned long long)(ns / 1000), reads ? (unsigned long long)(ns / reads) : 0ULL, (unsigned int)skipped);
+}
+
+
+/*
+ * 从磁盘映像中的文件path读取跟踪记录，成功返回记录数并设置*recsp，失败返回-1
+ */
+static int32_t load_trace_image(const char * path, blk_trace_t ** recsp)
+{
+	m_inode_t * ip = NULL;
+	blk_trace_t * recs;
+
+	if(resolve_path(path, &ip, 0, NULL) == -1 || ! ip)
+	{
+		printf("load_trace_image: `%s' doesn't exist\n", path);
+		return -1;
+	}
+	if((recs = malloc(ip->size + 1)) == NULL)
+		return -1;
+	if(read_inode(ip, recs, 0, ip->size) != (int32_t)ip->size)
+	{
+		printf("load_trace_image: read `%s' failed\n", path);
+		free(recs);
+		return -1;
+	}
+	*recsp = recs;
+	return (int32_t)(ip->size / sizeof(blk_trace_t));
+}
+
+
+/*
+ * 从主机上的文件path读取跟踪记录，成功返回记录数并设置*recsp，失败返回-1
+ */
+static int32_t load_trace_host(const char * path, blk_trace_t ** recsp)
+{
+	FILE * fp;
+	blk_trace_t * recs = NULL;
+	uint32_t n = 0, cap = 0;
+
+	if((fp = fopen(path, "rb")) == NULL)
+	{
+		printf("load_trace_host: can't open %s\n", path);
+		return -1;
+	}
+	for(;;)
+	{
+		if(n == cap)
+		{
+			cap = cap ? cap * 2 : BLK_TRACE_COUNT;
+			recs = realloc(recs, cap * sizeof(blk_trace_t));
+		}
+		if(fread(&recs[n], sizeof(blk_trace_t), 1, fp) != 1)
+			break;
+		n++;
+	}
+	fclose(fp);
+	*recsp = recs;
+	return (int32_t)n;
+}
+
+
+/*
+ * 解析以逗号分隔的块缓冲大小列表，返回个数
+ */
+static uint32_t parse_sizes(char * s, uint32_t * sizes)
+{
+	uint32_t n = 0;
+
+	for(char * p = strtok(s, ","); p && n < MAX_SIM_SIZES; p = strtok(NULL, ","))
+		if((sizes[n] = (uint32_t)strtoul(p, NULL, 0)) > 0)
+			n++;
+	return n;
+}
+
+
+int main(int argc, char * argv[])
+{
+	char * tpath = NULL;
+	char * rpath = NULL;
+	uint32_t sizes[MAX_SIM_SIZES];
+	uint32_t nsizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+	uint32_t dev = ROOT_DEV_NO;
+	uint32_t accesses = 0, hits = 0, reads = 0, writes = 0, async = 0;
+	blk_trace_t * recs = NULL;
+	int32_t n;
+	int opt;
+
+	memcpy(sizes, default_sizes, sizeof(default_sizes));
+
+	/* 解析参数 */
+	while((opt = getopt(argc, argv, "t:r:c:d:")) != -1)
+	{
+		switch(opt)
+		{
+			case 't':
+				tpath = optarg;
+				break;
+			case 'r':
+				rpath = optarg;
+				break;
+			case 'c':
+				nsizes = parse_sizes(optarg, sizes);
+				break;
+			case 'd':
+				dev = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			default:
+				printf("main: %s fs_img [-t path_in_img | -r host_file] [-c size,size,...] [-d dev]\n", argv[0]);
+				return -1;
+		}
+	}
+	if(optind >= argc || ( ! tpath && ! rpath) || nsizes == 0)
+	{
+		printf("main: %s fs_img [-t path_in_img | -r host_file] [-c size,size,...] [-d dev]\n", argv[0]);
+		return -1;
+	}
+
+	/* 准备fd/sb */
+	if((global_fd = open(argv[optind], O_RDONLY)) == -1)
+	{
+		printf("main: can't open %s\n", argv[optind]);
+		return -1;
+	}
+	if(tpath && read_sb(global_fd, &global_sb) == -1)
+	{
+		printf("main: can't read super block\n");
+		return -1;
+	}
+
+	/* 读取跟踪记录 */
+	n = tpath ? load_trace_image(tpath, &recs) : load_trace_host(rpath, &recs);
+	if(n <= 0)
+	{
+		printf("main: no trace records\n");
+		return -1;
+	}
+
+	for(int32_t i = 0; i < n; i++)
+	{
+		if(recs[i].flags & BLK_TRACE_ACCESS)
+		{
+			accesses++;
+			hits += (recs[i].flags & BLK_TRACE_HIT) ? 1 : 0;
+		}
+		else if(recs[i].flags & BLK_TRACE_WRITE)
+			writes++;
+		else
+			reads++;
+		async += (recs[i].flags & BLK_TRACE_ASYNC) ? 1 : 0;
+	}
+	printf("trace: %d records, %u accesses (%u hits), %u reads, %u writes, %u async\n",
+			n, accesses, hits, reads, writes, async);
+
+	/* 块缓冲模拟 */
+	printf("cache hit ratio (%%):\n  %-8s %-8s %-8s %-8s\n", "size", "lru", "fifo", "2q");
+	for(uint32_t i = 0; i < nsizes; i++)
+	{
+		printf("  %-8u", (unsigned int)sizes[i]);
+		for(uint32_t p = SIM_LRU; p <= SIM_2Q; p++)
+		{
+			uint32_t r = sim_cache(recs, (uint32_t)n, p, sizes[i]);
+			printf(" %3u.%02u  ", (unsigned int)(r / 100), (unsigned int)(r % 100));
+		}
+		printf("\n");
+	}
+
+	/* 调度模拟 */
+	printf("schedule dev %u:\n", (unsigned int)dev);
+	sim_sched(recs, (uint32_t)n, dev, 0);
+	sim_sched(recs, (uint32_t)n, dev, 1);
+
+	/* 在映像上重放读请求 */
+	replay_reads(global_fd, recs, (uint32_t)n, dev);
+
+	free(recs);
+	return 0;
+}
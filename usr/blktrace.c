@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sys.h"
+#include "ulib.h"
+#include "fcntl.h"
+#include "blk_trace.h"
+#include "parameters.h"
+
+/* 每次取出的记录数 */
+#define TRACE_BATCH	64
+
+
+/*
+ * cmd
+ * 取出内核中块I/O跟踪缓冲区的所有记录，从头写入参数指定的文件（内核需以blktrace=1启动）；
+ * 文件中的记录可以复制到主机上，用mkfs_tools中的replay工具回放、分析。
+ *
+ * 成功返回0，失败返回-1。
+ */
+int32_t main(int32_t argc, char * argv[])
+{
+	static blk_trace_t recs[TRACE_BATCH];
+	uint32_t lost, total_lost = 0, total = 0;
+	int32_t fd, n;
+
+	if(argc != 2)
+	{
+		printf("Usage: blktrace <file>\n");
+		return -1;
+	}
+	if((fd = open(argv[1], O_WRONLY | O_CREAT)) < 0)
+	{
+		printf("blktrace: open `%s' failed\n", argv[1]);
+		return -1;
+	}
+
+	/* 读取期间新产生的记录（包括写文件本身产生的）也会被取出，因此最多取出一个缓冲区大小的记录 */
+	while(total < BLK_TRACE_COUNT && (n = blktrace(recs, TRACE_BATCH, &lost)) > 0)
+	{
+		total_lost += lost;
+		if(write(fd, recs, (uint32_t)n * sizeof(blk_trace_t)) != n * (int32_t)sizeof(blk_trace_t))
+		{
+			printf("blktrace: write `%s' failed\n", argv[1]);
+			close(fd);
+			return -1;
+		}
+		total += (uint32_t)n;
+	}
+	close(fd);
+
+	printf("blktrace: %u records saved, %u lost\n", total, total_lost);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sys.h"
+#include "ulib.h"
+#include "stat.h"
+
+
+/*
+ * cmd
+ * 输出参数指定的文件（默认为根目录）所在文件系统的block和i节点的使用情况。
+ *
+ * 成功返回0，失败返回-1。
+ */
+int32_t main(int32_t argc, char * argv[])
+{
+	statfs_t st;
+	char * path = argc > 1 ? argv[1] : "/";
+
+	if(statfs(path, &st) < 0)
+	{
+		printf("df: statfs `%s' failed\n", path);
+		return -1;
+	}
+
+	printf("dev %d:\n", st.dev);
+	printf("  blocks: %u total, %u used, %u free (%u KB free)\n", st.blocks, st.blocks - st.free_blocks,
+			st.free_blocks, st.free_blocks / 1024 * st.block_size + st.free_blocks % 1024 * st.block_size / 1024);
+	printf("  inodes: %u total, %u used, %u free\n", st.inodes, st.inodes - st.free_inodes, st.free_inodes);
+	return 0;
+}
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include "stat.h"
+#include "io_stats.h"
+#include "blk_trace.h"
 
 extern int32_t debug(char * str);
 
@@ -40,4 +42,14 @@ extern int32_t chdir(const char * path);
 
 extern int32_t pipe(int32_t pfd[2]);
 
+extern int32_t sync(void);
+
+extern int32_t fsync(int32_t fd);
+
+extern int32_t iostat(int32_t dev, io_stats_t * st);
+
+extern int32_t blktrace(blk_trace_t * recs, uint32_t n, uint32_t * lost);
+
+extern int32_t statfs(const char * path, statfs_t * st);
+
 #endif //_INCLUDE_SYS_H_
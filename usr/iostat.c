@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sys.h"
+#include "ulib.h"
+#include "io_stats.h"
+#include "parameters.h"
+
+
+/*
+ * 输出延迟直方图中非零的项：[2^i, 2^(i+1))个时钟周期内的次数
+ */
+static void print_hist(const char * name, io_lat_hist_t * h)
+{
+	printf("  %s: %u, avg %u cycles\n", name, h->count, h->count ? (uint32_t)(h->total / h->count) : 0);
+	for(uint32_t i = 0; i < IO_LAT_BUCKETS; i++)
+		if(h->buckets[i])
+			printf("    2^%u: %u\n", i, h->buckets[i]);
+}
+
+
+/*
+ * cmd
+ * 输出块I/O统计数据：块缓冲的命中率和acquire_buf的延迟分布，
+ * 以及每个块设备（或参数指定的设备）读写的扇区数、队列深度和请求延迟分布。
+ *
+ * 成功返回0，指定的设备不存在时返回-1。
+ */
+int32_t main(int32_t argc, char * argv[])
+{
+	io_stats_t st;
+	int32_t dev = -1;
+	buf_cache_stats_t * c = &st.cache;
+	blk_stats_t * d = &st.dev;
+
+	if(argc > 1)
+	{
+		dev = 0;
+		for(char * p = argv[1]; *p >= '0' && *p <= '9'; p++)
+			dev = dev * 10 + (*p - '0');
+	}
+
+	iostat(-1, &st);
+	printf("buf_cache: hits %u misses %u (%u%% hit) ghost_hits %u shared %u\n", c->hits, c->misses,
+			c->hits + c->misses ? c->hits * 100 / (c->hits + c->misses) : 0, c->ghost_hits, c->shared);
+	printf("buf_cache: readahead issued %u used %u\n", c->ra_issued, c->ra_hits);
+	print_hist("acquire hit", &c->lat_hit);
+	print_hist("acquire miss", &c->lat_miss);
+
+	for(int32_t i = 0; i < BLK_DEV_COUNT; i++)
+	{
+		if(dev >= 0 && i != dev)
+			continue;
+		if(iostat(i, &st) < 0)
+		{
+			if(dev >= 0)
+			{
+				printf("iostat: no block device %d\n", dev);
+				return -1;
+			}
+			continue;
+		}
+		printf("blk %d: read %u write %u sectors, inflight %u max %u avg depth %u\n", i, d->reqs[0], d->reqs[1],
+				d->inflight, d->max_inflight, d->submits ? (uint32_t)(d->depth_total / d->submits) : 0);
+		print_hist("read", &d->lat[0]);
+		print_hist("write", &d->lat[1]);
+	}
+	return 0;
+}
@@ -39,4 +39,9 @@ SYSCALL mkdir
 SYSCALL mknod
 SYSCALL chdir
 SYSCALL pipe
+SYSCALL sync
+SYSCALL fsync
+SYSCALL iostat
+SYSCALL blktrace
+SYSCALL statfs
 
@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sys.h"
+#include "ulib.h"
+
+
+/*
+ * cmd
+ * 将块缓冲中所有被修改过的数据写回磁盘。
+ *
+ * 总是返回0。
+ */
+int32_t main(int32_t argc, char * argv[])
+{
+	(void)argc;
+	(void)argv;
+
+	sync();
+	return 0;
+}